@@ -0,0 +1,128 @@
+#include "allocation_counter.hpp"
+
+#ifdef NDEBUG
+
+uint64_t GetThreadAllocationCount() {
+  return 0;
+}
+
+#else
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace {
+// plain thread local, every thread only ever touches its own count
+thread_local uint64_t allocation_count = 0;
+
+void *CountedAllocate(std::size_t size) {
+  allocation_count++;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void *CountedAllocate(std::size_t size, std::align_val_t alignment) {
+  allocation_count++;
+  void *memory = nullptr;
+  const auto kAlignment = std::max(static_cast<std::size_t>(alignment), sizeof(void *));
+  if (posix_memalign(&memory, kAlignment, size == 0 ? 1 : size) != 0) {
+    return nullptr;
+  }
+  return memory;
+}
+
+void *CheckedAllocation(void *memory) {
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+}
+
+uint64_t GetThreadAllocationCount() {
+  return allocation_count;
+}
+
+void *operator new(std::size_t size) {
+  return CheckedAllocation(CountedAllocate(size));
+}
+
+void *operator new[](std::size_t size) {
+  return CheckedAllocation(CountedAllocate(size));
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return CountedAllocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return CountedAllocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  return CheckedAllocation(CountedAllocate(size, alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return CheckedAllocation(CountedAllocate(size, alignment));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return CountedAllocate(size, alignment);
+}
+
+void *operator new[](std::size_t size,
+                     std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+  return CountedAllocate(size, alignment);
+}
+
+void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t, std::align_val_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t, const std::nothrow_t &) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t, const std::nothrow_t &) noexcept {
+  std::free(memory);
+}
+
+#endif
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+
+// Number of global operator new calls made by the calling thread so far. Allocations of other
+// threads, e.g. runtime and driver threads, are not counted. The counting operators are only
+// installed in builds without NDEBUG, release builds always return 0.
+uint64_t GetThreadAllocationCount();
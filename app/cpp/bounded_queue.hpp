@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Blocking multi-producer multi-consumer queue with a fixed capacity. Once closed, Push fails
+// and Pop drains the remaining items before failing. Storage is allocated once, items are
+// moved in and out, so allocator aware items keep their allocator.
+template<typename T>
+class BoundedQueue {
+ private:
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::vector<std::optional<T>> items_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+  bool closed_ = false;
+ public:
+  explicit BoundedQueue(size_t capacity) : items_(capacity) {}
+  BoundedQueue(const BoundedQueue &) = delete;
+
+  bool Push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return closed_ || size_ < items_.size(); });
+    if (closed_) {
+      return false;
+    }
+    items_[(head_ + size_) % items_.size()].emplace(std::move(item));
+    size_++;
+    not_empty_.notify_one();
+    return true;
+  }
+
+  std::optional<T> Pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || size_ > 0; });
+    if (size_ == 0) {
+      return std::nullopt;
+    }
+    std::optional<T> item = std::move(items_[head_]);
+    items_[head_].reset();
+    head_ = (head_ + 1) % items_.size();
+    size_--;
+    not_full_.notify_one();
+    return item;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+  void Reopen() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &item: items_) {
+      item.reset();
+    }
+    head_ = 0;
+    size_ = 0;
+    closed_ = false;
+  }
+};
@@ -0,0 +1,77 @@
+#include "dynamic_resolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+// weight of the newest sample in the smoothed gpu time
+constexpr float kSmoothing = 0.2F;
+}
+
+DynamicResolution::DynamicResolution(const DynamicResolutionConfig &config)
+    : config_(config), scale_(1.0F) {
+  if (config_.min_scale <= 0.0F || config_.max_scale <= 0.0F
+      || config_.min_scale > config_.max_scale) {
+    throw std::invalid_argument("dynamic resolution scales must be in (0, max_scale]");
+  }
+  if (!config_.enabled) {
+    config_.min_scale = config_.max_scale;
+  }
+}
+
+const DynamicResolutionConfig &DynamicResolution::GetConfig() const {
+  return config_;
+}
+
+bool DynamicResolution::Update(std::chrono::nanoseconds gpu_frame_time,
+                               std::chrono::nanoseconds display_period) {
+  if (!config_.enabled || display_period.count() <= 0) {
+    return false;
+  }
+  if (settle_frames_ > 0) {
+    settle_frames_--;
+    return false;
+  }
+  const float kGpuMs = std::chrono::duration<float, std::milli>(gpu_frame_time).count();
+  smoothed_gpu_ms_ = has_sample_ ? smoothed_gpu_ms_ + kSmoothing * (kGpuMs - smoothed_gpu_ms_)
+                                 : kGpuMs;
+  has_sample_ = true;
+
+  const float kBudgetMs = config_.target_gpu_utilization
+      * std::chrono::duration<float, std::milli>(display_period).count();
+  const float kMinScale = config_.min_scale / config_.max_scale;
+  const float kPreviousScale = scale_;
+  if (smoothed_gpu_ms_ > kBudgetMs) {
+    under_budget_frames_ = 0;
+    if (++over_budget_frames_ >= config_.decrease_frames) {
+      // gpu cost follows the pixel count, which follows the square of the scale
+      const float kTarget = scale_ * std::sqrt(kBudgetMs / smoothed_gpu_ms_);
+      scale_ = std::max(kMinScale, std::min(kTarget, scale_ - config_.increase_step));
+    }
+  } else if (smoothed_gpu_ms_ < kBudgetMs * (1.0F - config_.increase_headroom)) {
+    over_budget_frames_ = 0;
+    if (++under_budget_frames_ >= config_.increase_frames) {
+      scale_ = std::min(1.0F, scale_ + config_.increase_step);
+    }
+  } else {
+    over_budget_frames_ = 0;
+    under_budget_frames_ = 0;
+  }
+  if (scale_ == kPreviousScale) {
+    return false;
+  }
+  over_budget_frames_ = 0;
+  under_budget_frames_ = 0;
+  settle_frames_ = config_.settle_frames;
+  has_sample_ = false;
+  return true;
+}
+
+float DynamicResolution::GetScale() const {
+  return scale_;
+}
+
+float DynamicResolution::GetSmoothedGpuMs() const {
+  return smoothed_gpu_ms_;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+struct DynamicResolutionConfig {
+  bool enabled = true;
+  // scales of the recommended view resolution, swapchains are sized for max_scale
+  float min_scale = 0.7F;
+  float max_scale = 1.0F;
+  // share of the display period the gpu may spend on a frame
+  float target_gpu_utilization = 0.85F;
+  // the scale only grows while the gpu stays below target * (1 - headroom)
+  float increase_headroom = 0.15F;
+  float increase_step = 0.05F;
+  // consecutive frames beyond the bounds before the scale changes
+  uint32_t decrease_frames = 3;
+  uint32_t increase_frames = 45;
+  // frames ignored after a change, their gpu work may still have used the old scale
+  uint32_t settle_frames = 4;
+};
+
+// Picks the share of the swapchain extent that is rendered from measured gpu frame times.
+// Over budget the scale drops quickly, proportional to the pixel cost, and grows back in small
+// steps once the gpu has had headroom for a while. Measuring restarts after a change, so
+// frames still in flight at the old scale do not cause a second one.
+class DynamicResolution {
+ private:
+  DynamicResolutionConfig config_;
+  float scale_;
+  float smoothed_gpu_ms_ = 0.0F;
+  bool has_sample_ = false;
+  uint32_t over_budget_frames_ = 0;
+  uint32_t under_budget_frames_ = 0;
+  uint32_t settle_frames_ = 0;
+ public:
+  // Throws when the scales are not within (0, max_scale].
+  explicit DynamicResolution(const DynamicResolutionConfig &config);
+
+  [[nodiscard]] const DynamicResolutionConfig &GetConfig() const;
+
+  // Returns true when the scale changed.
+  bool Update(std::chrono::nanoseconds gpu_frame_time, std::chrono::nanoseconds display_period);
+
+  // Share of the max sized swapchain extent to render, in [min_scale / max_scale, 1].
+  [[nodiscard]] float GetScale() const;
+
+  [[nodiscard]] float GetSmoothedGpuMs() const;
+};
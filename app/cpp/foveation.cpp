@@ -0,0 +1,43 @@
+#include "foveation.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+FoveationProfile GetFoveationProfile(FoveationLevel level) {
+  switch (level) {
+    case FoveationLevel::OFF:
+      return {};
+    // the lens blurs the periphery, low halves the rate only where that is hardly visible
+    case FoveationLevel::LOW:
+      return {level, 0.7F, 1.0F, 0.5F, 0.5F};
+    case FoveationLevel::MEDIUM:
+      return {level, 0.5F, 0.85F, 0.5F, 0.25F};
+    case FoveationLevel::HIGH:
+      return {level, 0.35F, 0.65F, 0.5F, 0.25F};
+  }
+  throw std::invalid_argument("unknown foveation level");
+}
+
+float GetFoveationDensity(const FoveationProfile &profile, float x, float y) {
+  const float kDistance = std::sqrt(x * x + y * y);
+  if (kDistance <= profile.inner_radius) {
+    return 1.0F;
+  }
+  return kDistance <= profile.outer_radius ? profile.middle_density : profile.outer_density;
+}
+
+FoveationLevel ParseFoveationLevel(const std::string &text) {
+  if (text == "off") {
+    return FoveationLevel::OFF;
+  }
+  if (text == "low") {
+    return FoveationLevel::LOW;
+  }
+  if (text == "medium") {
+    return FoveationLevel::MEDIUM;
+  }
+  if (text == "high") {
+    return FoveationLevel::HIGH;
+  }
+  throw std::invalid_argument("foveation level must be off, low, medium or high: " + text);
+}
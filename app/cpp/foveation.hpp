@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+enum class FoveationLevel {
+  // every pixel is shaded
+  OFF,
+  LOW,
+  MEDIUM,
+  HIGH,
+};
+
+// Radial falloff of the shading rate around the center of a view. Distances are relative to
+// the half extent of the rendered area, so 1 touches the middle of its edges. Densities are
+// the share of fragments shaded along each axis, 0.5 shades one fragment per 2x2 pixels.
+struct FoveationProfile {
+  FoveationLevel level = FoveationLevel::OFF;
+  // full density up to this distance
+  float inner_radius = 1.0F;
+  // middle_density up to this distance, outer_density beyond it
+  float outer_radius = 1.0F;
+  float middle_density = 1.0F;
+  float outer_density = 1.0F;
+};
+
+[[nodiscard]] FoveationProfile GetFoveationProfile(FoveationLevel level);
+
+// Density at x, y in [-1, 1] across the rendered area, the center of the view is at 0, 0.
+[[nodiscard]] float GetFoveationDensity(const FoveationProfile &profile, float x, float y);
+
+// Parses "off", "low", "medium" or "high". Throws std::invalid_argument for anything else.
+[[nodiscard]] FoveationLevel ParseFoveationLevel(const std::string &text);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Linear allocator for data that lives as long as one frame. Allocations come from a fixed
+// buffer, a frame that needs more is served by the heap until the next reset.
+class FrameArena {
+ private:
+  static constexpr size_t kCapacity = 64 * 1024;
+
+  std::vector<std::byte> buffer_;
+  std::pmr::monotonic_buffer_resource resource_;
+ public:
+  FrameArena() : buffer_(kCapacity), resource_(buffer_.data(), buffer_.size()) {}
+  FrameArena(const FrameArena &) = delete;
+
+  // Everything allocated from the arena must be released before.
+  void Reset() {
+    resource_.release();
+  }
+
+  std::pmr::memory_resource *GetResource() {
+    return &resource_;
+  }
+};
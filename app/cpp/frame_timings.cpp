@@ -0,0 +1,94 @@
+#include "frame_timings.hpp"
+
+#include "magic_enum.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+uint64_t FrameTimings::BeginFrame() {
+  const uint64_t kFrameId = frame_count_.load(std::memory_order_relaxed);
+  for (auto &phase_samples: samples_us_) {
+    phase_samples[kFrameId % kCapacity].store(kNotRecorded, std::memory_order_relaxed);
+  }
+  frame_count_.store(kFrameId + 1, std::memory_order_release);
+  return kFrameId;
+}
+
+void FrameTimings::Record(uint64_t frame_id,
+                          FramePhase phase,
+                          std::chrono::steady_clock::duration duration) {
+  const auto kMicroseconds =
+      std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+  samples_us_[static_cast<size_t>(phase)][frame_id % kCapacity].store(
+      static_cast<uint32_t>(std::min<int64_t>(kMicroseconds, kNotRecorded - 1)),
+      std::memory_order_relaxed);
+}
+
+PhasePercentiles FrameTimings::GetPercentiles(FramePhase phase) const {
+  const size_t kCount = std::min<uint64_t>(frame_count_.load(std::memory_order_acquire),
+                                           kCapacity);
+  std::vector<uint32_t> samples{};
+  samples.reserve(kCount);
+  for (size_t i = 0; i < kCount; i++) {
+    const uint32_t kSample =
+        samples_us_[static_cast<size_t>(phase)][i].load(std::memory_order_relaxed);
+    if (kSample != kNotRecorded) {
+      samples.push_back(kSample);
+    }
+  }
+  PhasePercentiles result{};
+  if (samples.empty()) {
+    return result;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&samples](float fraction) {
+    const auto kIndex = static_cast<size_t>(fraction * static_cast<float>(samples.size() - 1));
+    return static_cast<float>(samples[kIndex]) / 1000.0F;
+  };
+  result.p50_ms = percentile(0.50F);
+  result.p95_ms = percentile(0.95F);
+  result.p99_ms = percentile(0.99F);
+  return result;
+}
+
+void FrameTimings::LogPercentiles() const {
+  for (size_t i = 0; i < kPhaseCount; i++) {
+    const auto kPhase = static_cast<FramePhase>(i);
+    const auto kPercentiles = GetPercentiles(kPhase);
+    spdlog::info("{}: p50={:.3f}ms p95={:.3f}ms p99={:.3f}ms",
+                 magic_enum::enum_name(kPhase),
+                 kPercentiles.p50_ms,
+                 kPercentiles.p95_ms,
+                 kPercentiles.p99_ms);
+  }
+}
+
+void FrameTimings::DumpCsv(const std::string &path) const {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("failed to open " + path);
+  }
+  file << "frame";
+  for (size_t i = 0; i < kPhaseCount; i++) {
+    file << "," << magic_enum::enum_name(static_cast<FramePhase>(i)) << "_us";
+  }
+  file << "\n";
+  const uint64_t kLast = frame_count_.load(std::memory_order_acquire);
+  const uint64_t kFirst = kLast > kCapacity ? kLast - kCapacity : 0;
+  for (uint64_t frame = kFirst; frame < kLast; frame++) {
+    file << frame;
+    for (size_t i = 0; i < kPhaseCount; i++) {
+      file << ",";
+      const uint32_t kSample = samples_us_[i][frame % kCapacity].load(std::memory_order_relaxed);
+      if (kSample != kNotRecorded) {
+        file << kSample;
+      }
+    }
+    file << "\n";
+  }
+  spdlog::info("Frame timings of {} frames written to {}", kLast - kFirst, path);
+}
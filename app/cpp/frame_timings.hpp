@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+enum class FramePhase {
+  WAIT_FRAME,
+  BEGIN_FRAME,
+  LOCATE,
+  ACQUIRE_SWAPCHAIN,
+  RECORD,
+  // part of RECORD, the cpu blocked on the gpu to free the resources of an earlier frame
+  GPU_WAIT,
+  SUBMIT,
+  END_FRAME,
+  // execution of the frame's commands on the gpu, known a few frames later
+  GPU_FRAME,
+  COUNT,
+};
+
+struct PhasePercentiles {
+  float p50_ms = 0.0F;
+  float p95_ms = 0.0F;
+  float p99_ms = 0.0F;
+};
+
+// Keeps the phase durations of the last kCapacity frames. Recording is wait free and may
+// happen from any thread, readers copy the samples out and may see a frame that is half
+// written, which is fine for statistics. Phases a frame skipped are left out.
+class FrameTimings {
+ public:
+  static constexpr size_t kCapacity = 1024;
+ private:
+  static constexpr size_t kPhaseCount = static_cast<size_t>(FramePhase::COUNT);
+
+  static constexpr uint32_t kNotRecorded = UINT32_MAX;
+
+  std::array<std::array<std::atomic<uint32_t>, kCapacity>, kPhaseCount> samples_us_{};
+  std::atomic<uint64_t> frame_count_ = 0;
+ public:
+  FrameTimings() = default;
+  FrameTimings(const FrameTimings &) = delete;
+
+  // Returns the id of a new frame, phases of the frame are recorded against it. Only the thread
+  // waiting frames may call it.
+  uint64_t BeginFrame();
+
+  void Record(uint64_t frame_id, FramePhase phase, std::chrono::steady_clock::duration duration);
+
+  [[nodiscard]] PhasePercentiles GetPercentiles(FramePhase phase) const;
+
+  void LogPercentiles() const;
+
+  // One row per frame, oldest first, one column per phase in microseconds.
+  void DumpCsv(const std::string &path) const;
+};
+
+// Records the time between construction and destruction into the given phase.
+class ScopedPhaseTimer {
+ private:
+  FrameTimings &timings_;
+  uint64_t frame_id_;
+  FramePhase phase_;
+  std::chrono::steady_clock::time_point start_;
+ public:
+  ScopedPhaseTimer(FrameTimings &timings, uint64_t frame_id, FramePhase phase)
+      : timings_(timings),
+        frame_id_(frame_id),
+        phase_(phase),
+        start_(std::chrono::steady_clock::now()) {}
+  ScopedPhaseTimer(const ScopedPhaseTimer &) = delete;
+  ~ScopedPhaseTimer() {
+    timings_.Record(frame_id_, phase_, std::chrono::steady_clock::now() - start_);
+  }
+};
@@ -1,11 +1,30 @@
 #pragma once
 
 #include "openxr-include.hpp"
+#include "foveation.hpp"
 #include "math_utils.h"
 
+#include <chrono>
+#include <optional>
+#include <span>
 #include <vector>
 #include <string>
 
+struct GpuScopeTiming {
+  const char *name;
+  // view or layer the scope covers
+  uint32_t index;
+  // start relative to the start of the frame
+  std::chrono::nanoseconds start;
+  std::chrono::nanoseconds duration;
+};
+
+struct GpuFrameTiming {
+  uint64_t frame_id;
+  std::chrono::nanoseconds duration;
+  std::span<const GpuScopeTiming> scopes;
+};
+
 class GraphicsPlugin {
  public:
   virtual std::vector<std::string> GetOpenXrInstanceExtensions() const = 0;
@@ -13,19 +32,75 @@ class GraphicsPlugin {
   virtual const XrBaseInStructure *GetGraphicsBinding() const = 0;
   virtual int64_t SelectSwapchainFormat(const std::vector<int64_t> &runtime_formats) = 0;
 
+  virtual bool IsMultiviewSupported() const = 0;
+
+  // Must be called before SelectSwapchainFormat, all views are then rendered in a single pass
+  // into one swapchain with view_count array layers.
+  virtual void EnableMultiview(uint32_t view_count) = 0;
+
+  // Sample counts the device renders with, bit n is set when n samples are supported.
+  [[nodiscard]] virtual uint32_t GetSupportedMsaaSamples() const = 0;
+
+  // Renders with samples, lowered to the next supported count, 1 turns msaa off. Render
+  // targets, framebuffers and pipelines are rebuilt right away, the ones of frames in flight are
+  // released once the gpu is done with them. Must be called after SelectSwapchainFormat and not
+  // while a frame is recorded.
+  virtual void SetMsaaSamples(uint32_t samples) = 0;
+
+  // Shades the periphery of every view at the reduced rates of the level's profile. Devices
+  // without fragment density maps, like software drivers, keep rendering every pixel. Same
+  // constraints as SetMsaaSamples.
+  virtual void SetFoveationLevel(FoveationLevel level) = 0;
+
+  // Hidden area mesh of a view as a triangle list on the z = -1 plane of the view. It is drawn
+  // into depth at the start of the view so the scene skips the fragments the lenses hide, empty
+  // spans draw nothing. Must be called after SelectSwapchainFormat and not while a frame is
+  // recorded.
+  virtual void SetVisibilityMask(uint32_t view_index,
+                                 std::span<const XrVector2f> vertices,
+                                 std::span<const uint32_t> indices) = 0;
+
   virtual XrSwapchainImageBaseHeader *AllocateSwapchainImageStructs(uint32_t capacity,
                                                                     const XrSwapchainCreateInfo &swapchain_create_info) = 0;
 
   virtual void SwapchainImageStructsReady(XrSwapchainImageBaseHeader *images) = 0;
 
+  // Frame scoped rendering: views added between BeginFrame and EndFrame are recorded into one
+  // command buffer that EndFrame submits once. Swapchain images must stay acquired until
+  // EndFrame returns. cube_transforms are uploaded once and drawn instanced in every view.
+  // Only the subImage.imageRect of each layer view is rendered. frame_id identifies the frame
+  // in gpu timings.
+  virtual void BeginFrame(uint64_t frame_id, std::span<const math::Transform> cube_transforms) = 0;
+
   virtual void RenderView(const XrCompositionLayerProjectionView &layer_view,
                           XrSwapchainImageBaseHeader *swapchain_images,
-                          const uint32_t image_index,
-                          const std::vector<math::Transform> &cube_transforms) = 0;
+                          const uint32_t image_index) = 0;
+
+  virtual void RenderMultiView(std::span<const XrCompositionLayerProjectionView> layer_views,
+                               XrSwapchainImageBaseHeader *swapchain_images,
+                               const uint32_t image_index) = 0;
+
+  virtual void EndFrame() = 0;
+
+  // Gpu times of the most recent frame with results, a frame becomes available a few frames
+  // after its EndFrame. Scopes stay valid until the next BeginFrame. Empty when the device can
+  // not measure gpu times.
+  [[nodiscard]] virtual std::optional<GpuFrameTiming> GetLastGpuFrame() const = 0;
+
+  // Queue submissions issued by the last frame, expected to be 1 in steady state.
+  [[nodiscard]] virtual uint32_t GetLastFrameSubmitCount() const = 0;
+
+  // Number of frames the cpu may record ahead of the gpu, applied from the next BeginFrame on.
+  // Must not be called while a frame is recorded.
+  virtual void SetMaxFramesInFlight(uint32_t count) = 0;
+
+  // Time BeginFrame of the last frame was blocked on the gpu finishing an earlier frame.
+  [[nodiscard]] virtual std::chrono::nanoseconds GetLastFrameGpuWaitTime() const = 0;
 
   virtual void DeinitDevice() = 0;
 
   virtual ~GraphicsPlugin() = default;
 };
 
-std::shared_ptr<GraphicsPlugin> CreateGraphicsPlugin();
+// cache_directory is a writable directory for caches that outlive the process.
+std::shared_ptr<GraphicsPlugin> CreateGraphicsPlugin(const std::string &cache_directory);
@@ -1,16 +1,25 @@
 #include "graphics_plugin.hpp"
 
 #include "openxr_utils.hpp"
+#include "trace.hpp"
 
 #include "vulkan_swapchain_context.hpp"
 #include "vulkan/data_type.hpp"
+#include "vulkan/vulkan_command_batch.hpp"
 #include "vulkan/vulkan_rendering_context.hpp"
 #include "vulkan/vulkan_rendering_pipeline.hpp"
+#include "vulkan/vulkan_secondary_recorder.hpp"
 #include "vulkan/vulkan_utils.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstring>
 #include <map>
 #include <memory>
+#include <string>
+#include <thread>
+#include <utility>
 
 #include <spdlog/spdlog.h>
 
@@ -39,6 +48,11 @@ const std::vector<unsigned short> kCubeIndices{
     3, 2, 6,
     6, 7, 3
 };
+constexpr size_t kMinInstanceCapacity = 64;
+// vert_multiview.glsl holds a fixed size matrix array indexed by gl_ViewIndex
+constexpr uint32_t kMaxMultiviewViews = 2;
+// threads recording draws, the calling render thread included, the quest's big cores bound it
+constexpr uint32_t kMaxRecordingThreads = 4;
 
 VkResult CreateDebugUtilsMessengerExt(
     VkInstance instance,
@@ -69,7 +83,65 @@ void DestroyDebugUtilsMessengerExt(
   }
 }
 
+glm::mat4 GetProjection(const XrCompositionLayerProjectionView &layer_view) {
+  return math::CreateProjectionFov(layer_view.fov, 0.05f, 100.0f);
+}
+
+glm::mat4 GetViewProjection(const XrCompositionLayerProjectionView &layer_view) {
+  glm::mat4 proj = GetProjection(layer_view);
+  glm::mat4 view = math::InvertRigidBody(
+      glm::translate(glm::identity<glm::mat4>(), math::XrVector3FToGlm(layer_view.pose.position))
+          * glm::mat4_cast(math::XrQuaternionFToGlm(layer_view.pose.orientation))
+  );
+  return proj * view;
+}
+
+VkRect2D ToRenderArea(const XrRect2Di &image_rect) {
+  return {
+      {image_rect.offset.x, image_rect.offset.y},
+      {static_cast<uint32_t>(image_rect.extent.width),
+       static_cast<uint32_t>(image_rect.extent.height)},
+  };
+}
+
+// Hidden area mesh of one view, vertices lie on the z = -1 plane of the view.
+struct VisibilityMesh {
+  std::vector<XrVector2f> vertices{};
+  std::vector<uint32_t> indices{};
+  // offset of the indices in the index buffer shared by all views
+  uint32_t first_index = 0;
+  // the fraction of the view the mesh hides is logged on its first draw
+  bool logged = false;
+};
+
+// Part of the viewport the mesh covers, triangles are disjoint by construction.
+float GetHiddenFraction(const VisibilityMesh &mesh, const glm::mat4 &projection) {
+  float area = 0.0f;
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    std::array<glm::vec2, 3> corners{};
+    for (size_t j = 0; j < corners.size(); j++) {
+      const XrVector2f &kVertex = mesh.vertices[mesh.indices[i + j]];
+      const glm::vec4 kClip = projection * glm::vec4(kVertex.x, kVertex.y, -1.0f, 1.0f);
+      corners[j] = glm::vec2(kClip) / kClip.w;
+    }
+    const glm::vec2 kEdge0 = corners[1] - corners[0];
+    const glm::vec2 kEdge1 = corners[2] - corners[0];
+    area += 0.5f * std::abs(kEdge0.x * kEdge1.y - kEdge0.y * kEdge1.x);
+  }
+  // normalized device coordinates span an area of 4
+  return std::min(area / 4.0f, 1.0f);
+}
+
+glm::mat4 GetModel(const math::Transform &transform) {
+  return glm::scale(glm::translate(glm::identity<glm::mat4>(), transform.position)
+                        * glm::mat4_cast(transform.orientation), transform.scale);
+}
+
 class VulkanGraphicsPlugin : public GraphicsPlugin {
+ public:
+  explicit VulkanGraphicsPlugin(std::string cache_directory)
+      : cache_directory_(std::move(cache_directory)) {}
+
   [[nodiscard]] std::vector<std::string> GetOpenXrInstanceExtensions() const override {
     return {XR_KHR_VULKAN_ENABLE2_EXTENSION_NAME};
   }
@@ -245,6 +317,76 @@ class VulkanGraphicsPlugin : public GraphicsPlugin {
                                                    &vulkan_graphics_device_get_info_khr,
                                                    &physical_device_));
 
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(physical_device_, &device_properties);
+    const uint32_t kApiVersion = std::min(app_info.apiVersion, device_properties.apiVersion);
+    const auto kAvailableExtensions = vulkan::GetAvailableDeviceExtensions(physical_device_);
+    const auto kIsExtensionAvailable = [&kAvailableExtensions](const char *name) {
+      return std::any_of(kAvailableExtensions.begin(),
+                         kAvailableExtensions.end(),
+                         [name](const VkExtensionProperties &extension) {
+                           return strcmp(extension.extensionName, name) == 0;
+                         });
+    };
+    // frames are synchronized with a timeline semaphore, core since Vulkan 1.2
+    std::vector<const char *> device_extensions{};
+    if (kApiVersion < VK_API_VERSION_1_2) {
+      if (!kIsExtensionAvailable(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+        throw std::runtime_error("device does not support timeline semaphores");
+      }
+      device_extensions.emplace_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    }
+    // foveation needs VK_EXT_fragment_density_map, software drivers render without it
+    const bool kDensityMapExtensionAvailable =
+        kIsExtensionAvailable(VK_EXT_FRAGMENT_DENSITY_MAP_EXTENSION_NAME);
+    bool timeline_semaphore_supported = false;
+    if (kApiVersion >= VK_API_VERSION_1_1) {
+      VkPhysicalDeviceFragmentDensityMapFeaturesEXT density_map_features{
+          .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_DENSITY_MAP_FEATURES_EXT,
+      };
+      VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_semaphore_features{
+          .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+          .pNext = kDensityMapExtensionAvailable ? &density_map_features : nullptr,
+      };
+      VkPhysicalDeviceMultiviewFeatures multiview_features{
+          .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES,
+          .pNext = &timeline_semaphore_features,
+      };
+      VkPhysicalDeviceFeatures2 features2{
+          .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+          .pNext = &multiview_features,
+      };
+      vkGetPhysicalDeviceFeatures2(physical_device_, &features2);
+
+      VkPhysicalDeviceMultiviewProperties multiview_properties{
+          .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_PROPERTIES,
+      };
+      VkPhysicalDeviceProperties2 properties2{
+          .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+          .pNext = &multiview_properties,
+      };
+      vkGetPhysicalDeviceProperties2(physical_device_, &properties2);
+
+      multiview_supported_ = multiview_features.multiview == VK_TRUE;
+      max_multiview_view_count_ = multiview_properties.maxMultiviewViewCount;
+      timeline_semaphore_supported = timeline_semaphore_features.timelineSemaphore == VK_TRUE;
+      // the density map is used with swapchain images and render targets that are not
+      // subsampled, which needs the non subsampled images feature as well
+      fragment_density_map_supported_ = kDensityMapExtensionAvailable
+          && density_map_features.fragmentDensityMap == VK_TRUE
+          && density_map_features.fragmentDensityMapNonSubsampledImages == VK_TRUE;
+    }
+    if (!timeline_semaphore_supported) {
+      throw std::runtime_error("device does not support the timeline semaphore feature");
+    }
+    spdlog::info("Multiview supported={} MaxViewCount={}",
+                 multiview_supported_,
+                 max_multiview_view_count_);
+    spdlog::info("Fragment density map supported={}", fragment_density_map_supported_);
+    if (fragment_density_map_supported_) {
+      device_extensions.emplace_back(VK_EXT_FRAGMENT_DENSITY_MAP_EXTENSION_NAME);
+    }
+
     PFN_xrCreateVulkanDeviceKHR pfn_xr_create_vulkan_device_khr = nullptr;
     CHECK_XRCMD(xrGetInstanceProcAddr(xr_instance, "xrCreateVulkanDeviceKHR",
                                       reinterpret_cast<PFN_xrVoidFunction *>(&pfn_xr_create_vulkan_device_khr)));
@@ -274,14 +416,39 @@ class VulkanGraphicsPlugin : public GraphicsPlugin {
 
     VkPhysicalDeviceFeatures features{};
 
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR enabled_timeline_semaphore_features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+        .timelineSemaphore = VK_TRUE,
+    };
+    VkPhysicalDeviceMultiviewFeatures enabled_multiview_features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES,
+        .pNext = &enabled_timeline_semaphore_features,
+        .multiview = VK_TRUE,
+    };
+
+    void *enabled_features = multiview_supported_
+                             ? static_cast<void *>(&enabled_multiview_features)
+                             : static_cast<void *>(&enabled_timeline_semaphore_features);
+    VkPhysicalDeviceFragmentDensityMapFeaturesEXT enabled_density_map_features{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_DENSITY_MAP_FEATURES_EXT,
+        .pNext = enabled_features,
+        .fragmentDensityMap = VK_TRUE,
+        .fragmentDensityMapNonSubsampledImages = VK_TRUE,
+    };
+    if (fragment_density_map_supported_) {
+      enabled_features = &enabled_density_map_features;
+    }
+
     VkDeviceCreateInfo device_create_info{};
     device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_create_info.pNext = enabled_features;
     device_create_info.queueCreateInfoCount = 1;
     device_create_info.pQueueCreateInfos = &queue_info;
     device_create_info.enabledLayerCount = 0;
     device_create_info.ppEnabledLayerNames = nullptr;
-    device_create_info.enabledExtensionCount = 0;
-    device_create_info.ppEnabledExtensionNames = nullptr;
+    device_create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
+    device_create_info.ppEnabledExtensionNames =
+        device_extensions.empty() ? nullptr : device_extensions.data();
     device_create_info.pEnabledFeatures = &features;
 
     XrVulkanDeviceCreateInfoKHR vulkan_device_create_info_khr{};
@@ -308,6 +475,10 @@ class VulkanGraphicsPlugin : public GraphicsPlugin {
     pool_info.queueFamilyIndex = graphics_queue_family_index_;
     pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     CHECK_VKCMD(vkCreateCommandPool(logical_device_, &pool_info, nullptr, &graphics_command_pool_));
+    secondary_recorder_ = std::make_shared<vulkan::VulkanSecondaryRecorder>(
+        logical_device_,
+        graphics_queue_family_index_,
+        std::clamp(std::thread::hardware_concurrency(), 1u, kMaxRecordingThreads));
 
     graphics_binding_.type = XR_TYPE_GRAPHICS_BINDING_VULKAN2_KHR;
     graphics_binding_.instance = vulkan_instance_;
@@ -321,13 +492,18 @@ class VulkanGraphicsPlugin : public GraphicsPlugin {
 
     const std::vector<uint32_t> kVertexShader = {
 #include "vert.spv"
+    };
+    const std::vector<uint32_t> kVertexMultiviewShader = {
+#include "vert_multiview.spv"
     };
     const std::vector<uint32_t> kFragmentShader = {
 #include "frag.spv"
     };
 
     auto vertex_shader = std::make_shared<vulkan::VulkanShader>(rendering_context_,
-                                                                kVertexShader,
+                                                                view_count_ > 1
+                                                                ? kVertexMultiviewShader
+                                                                : kVertexShader,
                                                                 "main");
     auto fragment_shader = std::make_shared<vulkan::VulkanShader>(rendering_context_,
                                                                   kFragmentShader,
@@ -337,6 +513,14 @@ class VulkanGraphicsPlugin : public GraphicsPlugin {
     vertex_buffer_layout.Push({0, vulkan::DataType::FLOAT, 3});
     vertex_buffer_layout.Push({1, vulkan::DataType::FLOAT, 3});
 
+    // model matrix, a mat4 attribute occupies 4 consecutive locations
+    vulkan::VertexBufferLayout instance_buffer_layout =
+        vulkan::VertexBufferLayout(vulkan::VertexInputRate::INSTANCE);
+    instance_buffer_layout.Push({2, vulkan::DataType::FLOAT, 4});
+    instance_buffer_layout.Push({3, vulkan::DataType::FLOAT, 4});
+    instance_buffer_layout.Push({4, vulkan::DataType::FLOAT, 4});
+    instance_buffer_layout.Push({5, vulkan::DataType::FLOAT, 4});
+
     auto pipeline_config = vulkan::RenderingPipelineConfig{
         .draw_mode = vulkan::DrawMode::TRIANGLE_LIST,
         .cull_mode = vulkan::CullMode::BACK,
@@ -348,7 +532,7 @@ class VulkanGraphicsPlugin : public GraphicsPlugin {
         rendering_context_,
         vertex_shader,
         fragment_shader,
-        vertex_buffer_layout,
+        std::vector<vulkan::VertexBufferLayout>{vertex_buffer_layout, instance_buffer_layout},
         pipeline_config
     );
     auto vertex_buffer = std::make_shared<vulkan::VulkanBuffer>(
@@ -366,6 +550,44 @@ class VulkanGraphicsPlugin : public GraphicsPlugin {
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
     index_buffer->Update(kCubeIndices.data());
     pipeline_->SetIndexBuffer(index_buffer, vulkan::DataType::UINT_16);
+
+    instance_buffers_.resize(vulkan::VulkanRenderingContext::kMaxFramesInFlight);
+
+    const std::vector<uint32_t> kMaskVertexShader = {
+#include "mask_vert.spv"
+    };
+    const std::vector<uint32_t> kMaskVertexMultiviewShader = {
+#include "mask_vert_multiview.spv"
+    };
+    const std::vector<uint32_t> kMaskFragmentShader = {
+#include "mask_frag.spv"
+    };
+    auto mask_vertex_shader = std::make_shared<vulkan::VulkanShader>(rendering_context_,
+                                                                     view_count_ > 1
+                                                                     ? kMaskVertexMultiviewShader
+                                                                     : kMaskVertexShader,
+                                                                     "main");
+    auto mask_fragment_shader = std::make_shared<vulkan::VulkanShader>(rendering_context_,
+                                                                       kMaskFragmentShader,
+                                                                       "main");
+    // xy on the z = -1 plane and the view index
+    vulkan::VertexBufferLayout mask_buffer_layout = vulkan::VertexBufferLayout();
+    mask_buffer_layout.Push({0, vulkan::DataType::FLOAT, 3});
+    auto mask_pipeline_config = vulkan::RenderingPipelineConfig{
+        .draw_mode = vulkan::DrawMode::TRIANGLE_LIST,
+        .cull_mode = vulkan::CullMode::NONE,
+        .front_face = vulkan::FrontFace::CCW,
+        .enable_depth_test = true,
+        .depth_function = vulkan::CompareOp::LESS,
+        .enable_color_write = false,
+    };
+    mask_pipeline_ = std::make_shared<vulkan::VulkanRenderingPipeline>(
+        rendering_context_,
+        mask_vertex_shader,
+        mask_fragment_shader,
+        std::vector<vulkan::VertexBufferLayout>{mask_buffer_layout},
+        mask_pipeline_config
+    );
   }
 
   [[nodiscard]] int64_t SelectSwapchainFormat(const std::vector<int64_t> &runtime_formats) override {
@@ -389,20 +611,109 @@ class VulkanGraphicsPlugin : public GraphicsPlugin {
         logical_device_,
         graphic_queue_,
         graphics_command_pool_,
-        (VkFormat) (*swapchain_format_it));
+        (VkFormat) (*swapchain_format_it),
+        view_count_,
+        fragment_density_map_supported_,
+        cache_directory_ + "/pipeline_cache.bin");
     InitializeResources();
+    rendering_context_->SavePipelineCache();
     return *swapchain_format_it;
   }
 
+  [[nodiscard]] bool IsMultiviewSupported() const override {
+    return multiview_supported_;
+  }
+
+  void EnableMultiview(uint32_t view_count) override {
+    if (rendering_context_ != nullptr) {
+      throw std::runtime_error("multiview must be enabled before selecting swapchain format");
+    }
+    if (!multiview_supported_ || view_count > max_multiview_view_count_
+        || view_count > kMaxMultiviewViews) {
+      throw std::runtime_error("multiview is not supported for the requested view count");
+    }
+    view_count_ = view_count;
+  }
+
   [[nodiscard]] const XrBaseInStructure *GetGraphicsBinding() const override {
     return reinterpret_cast <const XrBaseInStructure *>(&graphics_binding_);
   }
 
+  [[nodiscard]] uint32_t GetSupportedMsaaSamples() const override {
+    return rendering_context_->GetSupportedMsaaSamples();
+  }
+
+  void SetMsaaSamples(uint32_t samples) override {
+    const VkSampleCountFlagBits kPreviousSamples = rendering_context_->GetMsaaSamples();
+    rendering_context_->SetMsaaSamples(samples);
+    if (rendering_context_->GetMsaaSamples() == kPreviousSamples) {
+      return;
+    }
+    pipeline_->Recreate();
+    mask_pipeline_->Recreate();
+    // a quest app is usually killed rather than shut down, the new pipelines are saved now
+    rendering_context_->SavePipelineCache();
+    // swapchains that are not ready yet get targets of the new sample count when they are
+    if (setup_batch_ == nullptr) {
+      setup_batch_ = std::make_unique<vulkan::VulkanCommandBatch>(rendering_context_);
+    }
+    for (const auto &[images, swapchain_context]: image_to_context_mapping_) {
+      if (swapchain_context->IsInited()) {
+        swapchain_context->RecreateRenderTargets(*setup_batch_);
+      }
+    }
+  }
+
+  void SetFoveationLevel(FoveationLevel level) override {
+    if (level != FoveationLevel::OFF && !rendering_context_->IsFoveationSupported()) {
+      spdlog::warn("Foveation is not available, the device has no fragment density maps");
+      level = FoveationLevel::OFF;
+    }
+    foveation_profile_ = GetFoveationProfile(level);
+    const bool kWasEnabled = rendering_context_->IsFoveationEnabled();
+    rendering_context_->SetFoveationEnabled(level != FoveationLevel::OFF);
+    const bool kRenderPassChanged = rendering_context_->IsFoveationEnabled() != kWasEnabled;
+    if (kRenderPassChanged) {
+      pipeline_->Recreate();
+      mask_pipeline_->Recreate();
+      rendering_context_->SavePipelineCache();
+    }
+    if (setup_batch_ == nullptr) {
+      setup_batch_ = std::make_unique<vulkan::VulkanCommandBatch>(rendering_context_);
+    }
+    for (const auto &[images, swapchain_context]: image_to_context_mapping_) {
+      swapchain_context->SetFoveationProfile(foveation_profile_);
+      if (kRenderPassChanged && swapchain_context->IsInited()) {
+        swapchain_context->RecreateRenderTargets(*setup_batch_);
+      }
+    }
+  }
+
+  void SetVisibilityMask(uint32_t view_index,
+                         std::span<const XrVector2f> vertices,
+                         std::span<const uint32_t> indices) override {
+    if (indices.size() % 3 != 0
+        || std::any_of(indices.begin(), indices.end(),
+                       [&](uint32_t index) { return index >= vertices.size(); })) {
+      throw std::invalid_argument("visibility mask must be a triangle list of its vertices");
+    }
+    if (visibility_meshes_.size() <= view_index) {
+      visibility_meshes_.resize(view_index + 1);
+    }
+    visibility_meshes_[view_index] = {
+        .vertices = std::vector<XrVector2f>(vertices.begin(), vertices.end()),
+        .indices = std::vector<uint32_t>(indices.begin(), indices.end()),
+    };
+    UpdateVisibilityMaskBuffers();
+  }
+
   XrSwapchainImageBaseHeader *AllocateSwapchainImageStructs(uint32_t capacity,
                                                             const XrSwapchainCreateInfo &swapchain_create_info) override {
     auto swapchain_context = std::make_shared<VulkanSwapchainContext>(rendering_context_,
+                                                                      secondary_recorder_,
                                                                       capacity,
                                                                       swapchain_create_info);
+    swapchain_context->SetFoveationProfile(foveation_profile_);
     auto images = swapchain_context->GetFirstImagePointer();
     image_to_context_mapping_.insert(std::make_pair(images, swapchain_context));
     return images;
@@ -413,38 +724,177 @@ class VulkanGraphicsPlugin : public GraphicsPlugin {
     if (context->IsInited()) {
       throw std::runtime_error("trying to init same image twice");
     }
-    context->InitSwapchainImageViews();
+    // render targets of all swapchains are prepared by one submission before the first frame
+    if (setup_batch_ == nullptr) {
+      setup_batch_ = std::make_unique<vulkan::VulkanCommandBatch>(rendering_context_);
+    }
+    context->InitSwapchainImageViews(*setup_batch_);
+    rendering_context_->LogMemoryStats();
+  }
+  void BeginFrame(uint64_t frame_id, std::span<const math::Transform> cube_transforms) override {
+    TRACE_SCOPE("BeginGraphicsFrame");
+    if (setup_batch_ != nullptr) {
+      setup_batch_->Submit();
+      setup_batch_ = nullptr;
+    }
+    {
+      // waits for the gpu to finish the frame that used the slot before
+      TRACE_SCOPE("WaitFrameSlot");
+      frame_command_buffer_ = rendering_context_->BeginFrame(frame_id);
+    }
+    secondary_recorder_->BeginFrame(rendering_context_->GetFrameSlot());
+    view_index_ = 0;
+
+    // the slot buffer is no longer read by the gpu once the frame has begun
+    auto &instance_buffer = instance_buffers_[rendering_context_->GetFrameSlot()];
+    const size_t kRequiredSize = sizeof(glm::mat4) * cube_transforms.size();
+    if (instance_buffer == nullptr || instance_buffer->GetSizeInBytes() < kRequiredSize) {
+      size_t capacity = instance_buffer == nullptr ? kMinInstanceCapacity
+                                                   : instance_buffer->GetSizeInBytes()
+                                                       / sizeof(glm::mat4);
+      while (capacity < cube_transforms.size()) {
+        capacity *= 2;
+      }
+      instance_buffer = std::make_shared<vulkan::VulkanBuffer>(
+          rendering_context_,
+          sizeof(glm::mat4) * capacity,
+          VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+          vulkan::GetVkMemoryType(vulkan::MemoryType::HOST_VISIBLE));
+    }
+    instance_models_.clear();
+    for (const math::Transform &cube: cube_transforms) {
+      instance_models_.emplace_back(GetModel(cube));
+    }
+    if (!instance_models_.empty()) {
+      instance_buffer->Update(instance_models_.data(), kRequiredSize, 0);
+    }
+    instance_buffer_ = instance_buffer;
+    instance_count_ = static_cast<uint32_t>(instance_models_.size());
   }
+
   void RenderView(const XrCompositionLayerProjectionView &layer_view,
                   XrSwapchainImageBaseHeader *swapchain_images,
-                  const uint32_t image_index,
-                  const std::vector<math::Transform> &cube_transforms) override {
+                  const uint32_t image_index) override {
+    TRACE_SCOPE("RenderView");
     if (layer_view.subImage.imageArrayIndex != 0) {
       throw std::runtime_error("Texture arrays not supported");
     }
-    glm::mat4 proj = math::CreateProjectionFov(layer_view.fov, 0.05f, 100.0f);
-    glm::mat4 view = math::InvertRigidBody(
-        glm::translate(glm::identity<glm::mat4>(), math::XrVector3FToGlm(layer_view.pose.position))
-            * glm::mat4_cast(math::XrQuaternionFToGlm(layer_view.pose.orientation))
-    );
-    std::vector<glm::mat4> transforms{};
-    for (const math::Transform &cube: cube_transforms) {
-      glm::mat4 model = glm::scale(glm::translate(glm::identity<glm::mat4>(), cube.position)
-                                       * glm::mat4_cast(cube.orientation), cube.scale);
-      transforms.emplace_back(proj * view * model);
+    const glm::mat4 kViewProjection = GetViewProjection(layer_view);
+    const glm::mat4 kProjection = GetProjection(layer_view);
+    const auto &swapchain_context = image_to_context_mapping_[swapchain_images];
+
+    VisibilityMaskDraw visibility_mask{};
+    if (view_index_ < visibility_meshes_.size()) {
+      const VisibilityMesh &kMesh = visibility_meshes_[view_index_];
+      LogHiddenFraction(view_index_, kProjection);
+      visibility_mask = {
+          .pipeline = mask_pipeline_.get(),
+          .first_index = kMesh.first_index,
+          .index_count = static_cast<uint32_t>(kMesh.indices.size()),
+          .projections = std::span<const glm::mat4>(&kProjection, 1),
+      };
     }
-    auto swapchain_context = image_to_context_mapping_[swapchain_images];
+    swapchain_context->Draw(frame_command_buffer_,
+                            image_index,
+                            view_index_++,
+                            ToRenderArea(layer_view.subImage.imageRect),
+                            visibility_mask,
+                            pipeline_,
+                            kCubeIndices.size(),
+                            instance_buffer_,
+                            instance_count_,
+                            std::span<const glm::mat4>(&kViewProjection, 1));
+  }
 
-    swapchain_context->Draw(image_index,
+  void RenderMultiView(std::span<const XrCompositionLayerProjectionView> layer_views,
+                       XrSwapchainImageBaseHeader *swapchain_images,
+                       const uint32_t image_index) override {
+    TRACE_SCOPE("RenderMultiView");
+    if (layer_views.size() != view_count_) {
+      throw std::runtime_error("layer view count does not match multiview view count");
+    }
+    std::array<glm::mat4, kMaxMultiviewViews> view_projections{};
+    std::array<glm::mat4, kMaxMultiviewViews> projections{};
+    const XrRect2Di &kImageRect = layer_views[0].subImage.imageRect;
+    for (uint32_t i = 0; i < layer_views.size(); i++) {
+      if (layer_views[i].subImage.imageArrayIndex != i) {
+        throw std::runtime_error("layer view must be rendered into its own array layer");
+      }
+      // one render area is shared by all layers of a multiview pass
+      if (std::memcmp(&layer_views[i].subImage.imageRect, &kImageRect, sizeof(XrRect2Di)) != 0) {
+        throw std::runtime_error("multiview layer views must use the same image rect");
+      }
+      view_projections[i] = GetViewProjection(layer_views[i]);
+      projections[i] = GetProjection(layer_views[i]);
+      LogHiddenFraction(i, projections[i]);
+    }
+    const auto &swapchain_context = image_to_context_mapping_[swapchain_images];
+
+    // the vertex shader drops the triangles of the meshes of other views
+    const VisibilityMaskDraw kVisibilityMask{
+        .pipeline = mask_pipeline_.get(),
+        .first_index = 0,
+        .index_count = mask_index_count_,
+        .projections = std::span<const glm::mat4>(projections.data(), layer_views.size()),
+    };
+    swapchain_context->Draw(frame_command_buffer_,
+                            image_index,
+                            0,
+                            ToRenderArea(kImageRect),
+                            kVisibilityMask,
                             pipeline_,
                             kCubeIndices.size(),
-                            transforms);
+                            instance_buffer_,
+                            instance_count_,
+                            std::span<const glm::mat4>(view_projections.data(),
+                                                       layer_views.size()));
+  }
+
+  void EndFrame() override {
+    TRACE_SCOPE("EndGraphicsFrame");
+    rendering_context_->EndFrame();
+    frame_command_buffer_ = VK_NULL_HANDLE;
+  }
+
+  [[nodiscard]] std::optional<GpuFrameTiming> GetLastGpuFrame() const override {
+    const std::optional<vulkan::GpuFrameTime> kFrame =
+        rendering_context_->GetGpuTimer().GetLastFrame();
+    if (!kFrame.has_value()) {
+      return std::nullopt;
+    }
+    for (size_t i = 0; i < kFrame->scopes.size(); i++) {
+      const vulkan::GpuScopeTime &kScope = kFrame->scopes[i];
+      gpu_scopes_[i] = {kScope.name, kScope.index, kScope.start, kScope.duration};
+    }
+    return GpuFrameTiming{
+        kFrame->frame_id,
+        kFrame->duration,
+        std::span<const GpuScopeTiming>(gpu_scopes_.data(), kFrame->scopes.size()),
+    };
+  }
+
+  [[nodiscard]] uint32_t GetLastFrameSubmitCount() const override {
+    return rendering_context_->GetFrameSubmitCount();
+  }
+
+  void SetMaxFramesInFlight(uint32_t count) override {
+    rendering_context_->SetMaxFramesInFlight(count);
+  }
+
+  [[nodiscard]] std::chrono::nanoseconds GetLastFrameGpuWaitTime() const override {
+    return rendering_context_->GetFrameGpuWaitTime();
   }
 
   void DeinitDevice() override {
+    setup_batch_ = nullptr;
     image_to_context_mapping_.clear();
+    instance_buffer_ = nullptr;
+    instance_buffers_.clear();
     pipeline_ = nullptr;
+    mask_pipeline_ = nullptr;
+    visibility_meshes_.clear();
     rendering_context_ = nullptr;
+    secondary_recorder_ = nullptr;
     vkDestroyCommandPool(logical_device_, graphics_command_pool_, nullptr);
     vkDestroyDevice(logical_device_, nullptr);
     if (debug_messenger_ != VK_NULL_HANDLE) {
@@ -454,25 +904,100 @@ class VulkanGraphicsPlugin : public GraphicsPlugin {
   }
 
  private:
+  // Rebuilds the buffers holding the meshes of all views, the previous ones are released once
+  // frames in flight are done with them.
+  void UpdateVisibilityMaskBuffers() {
+    std::vector<glm::vec3> vertices{};
+    std::vector<uint32_t> indices{};
+    for (uint32_t view = 0; view < visibility_meshes_.size(); view++) {
+      VisibilityMesh &mesh = visibility_meshes_[view];
+      const auto kBaseVertex = static_cast<uint32_t>(vertices.size());
+      mesh.first_index = static_cast<uint32_t>(indices.size());
+      mesh.logged = false;
+      for (const XrVector2f &vertex: mesh.vertices) {
+        vertices.emplace_back(vertex.x, vertex.y, static_cast<float>(view));
+      }
+      for (uint32_t index: mesh.indices) {
+        indices.push_back(kBaseVertex + index);
+      }
+    }
+    mask_index_count_ = static_cast<uint32_t>(indices.size());
+    if (indices.empty()) {
+      return;
+    }
+    auto vertex_buffer = std::make_shared<vulkan::VulkanBuffer>(
+        rendering_context_,
+        sizeof(glm::vec3) * vertices.size(),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    vertex_buffer->Update(vertices.data());
+    mask_pipeline_->SetVertexBuffer(vertex_buffer);
+    auto index_buffer = std::make_shared<vulkan::VulkanBuffer>(
+        rendering_context_,
+        sizeof(uint32_t) * indices.size(),
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    index_buffer->Update(indices.data());
+    mask_pipeline_->SetIndexBuffer(index_buffer, vulkan::DataType::UINT_32);
+  }
+
+  void LogHiddenFraction(uint32_t view_index, const glm::mat4 &projection) {
+    if (view_index >= visibility_meshes_.size() || visibility_meshes_[view_index].logged) {
+      return;
+    }
+    VisibilityMesh &mesh = visibility_meshes_[view_index];
+    mesh.logged = true;
+    spdlog::info("Visibility mask of view {} skips {:.1f}% of its fragments",
+                 view_index,
+                 100.0f * GetHiddenFraction(mesh, projection));
+  }
+
   XrGraphicsBindingVulkan2KHR graphics_binding_{};
 
   VkInstance vulkan_instance_ = VK_NULL_HANDLE;
   VkDebugUtilsMessengerEXT debug_messenger_ = VK_NULL_HANDLE;
   VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
 
+  const std::string cache_directory_;
   std::shared_ptr<vulkan::VulkanRenderingContext> rendering_context_ = nullptr;
   std::shared_ptr<vulkan::VulkanRenderingPipeline> pipeline_ = nullptr;
+  // draws the hidden area of each view into depth before the scene
+  std::shared_ptr<vulkan::VulkanRenderingPipeline> mask_pipeline_ = nullptr;
+  std::vector<VisibilityMesh> visibility_meshes_{};
+  // indices of the meshes of all views
+  uint32_t mask_index_count_ = 0;
+  VkCommandBuffer frame_command_buffer_ = VK_NULL_HANDLE;
+  // views rendered in the current frame, labels their gpu timer scopes
+  uint32_t view_index_ = 0;
+  mutable std::array<GpuScopeTiming, vulkan::VulkanGpuTimer::kMaxScopes> gpu_scopes_{};
+
+  // per frame slot model matrices of all instances
+  std::vector<std::shared_ptr<vulkan::VulkanBuffer>> instance_buffers_{};
+  std::shared_ptr<vulkan::VulkanBuffer> instance_buffer_ = nullptr;
+  uint32_t instance_count_ = 0;
+  std::vector<glm::mat4> instance_models_{};
+
+  bool multiview_supported_ = false;
+  bool fragment_density_map_supported_ = false;
+  FoveationProfile foveation_profile_{};
+  uint32_t max_multiview_view_count_ = 0;
+  uint32_t view_count_ = 1;
 
   VkDevice logical_device_ = VK_NULL_HANDLE;
   uint32_t graphics_queue_family_index_ = 0;
   VkQueue graphic_queue_ = VK_NULL_HANDLE;
   VkCommandPool graphics_command_pool_ = VK_NULL_HANDLE;
+  // per thread and frame slot pools of the secondary command buffers of the draws
+  std::shared_ptr<vulkan::VulkanSecondaryRecorder> secondary_recorder_ = nullptr;
 
   std::map<XrSwapchainImageBaseHeader *, std::shared_ptr<VulkanSwapchainContext>>
       image_to_context_mapping_{};
+  // swapchain setup and render target changes recorded since the last frame, submitted by the
+  // next BeginFrame
+  std::unique_ptr<vulkan::VulkanCommandBatch> setup_batch_;
 };
 }  // namespace
 
-std::shared_ptr<GraphicsPlugin> CreateGraphicsPlugin() {
-  return std::make_shared<VulkanGraphicsPlugin>();
+std::shared_ptr<GraphicsPlugin> CreateGraphicsPlugin(const std::string &cache_directory) {
+  return std::make_shared<VulkanGraphicsPlugin>(cache_directory);
 }
@@ -0,0 +1,136 @@
+#include "input_log.hpp"
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+constexpr std::array<char, 4> kMagic = {'Q', 'X', 'R', 'I'};
+constexpr uint32_t kVersion = 1;
+
+struct InputLogHeader {
+  std::array<char, 4> magic;
+  uint32_t version;
+  uint32_t view_count;
+  uint32_t space_count;
+};
+
+// fixed part of a frame record, followed by the views and the spaces
+struct InputFrameRecord {
+  XrTime predicted_display_time;
+  XrBool32 should_render;
+  XrBool32 views_valid;
+  std::array<RecordedHand, 2> hands;
+  XrBool32 quit_requested;
+};
+
+static_assert(std::is_trivially_copyable_v<InputFrameRecord>);
+static_assert(std::is_trivially_copyable_v<RecordedView>);
+static_assert(std::is_trivially_copyable_v<RecordedSpace>);
+
+template<typename T>
+void WriteRaw(std::ofstream &file, const T *data, size_t count) {
+  file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(sizeof(T) * count));
+}
+
+template<typename T>
+bool ReadRaw(std::ifstream &file, T *data, size_t count) {
+  file.read(reinterpret_cast<char *>(data), static_cast<std::streamsize>(sizeof(T) * count));
+  return static_cast<bool>(file);
+}
+}
+
+InputRecorder::InputRecorder(const std::string &path, uint32_t view_count, uint32_t space_count)
+    : file_(path, std::ios::binary | std::ios::trunc),
+      path_(path),
+      view_count_(view_count),
+      space_count_(space_count) {
+  if (!file_) {
+    throw std::runtime_error("failed to open " + path);
+  }
+  const InputLogHeader kHeader{kMagic, kVersion, view_count, space_count};
+  WriteRaw(file_, &kHeader, 1);
+  spdlog::info("Recording inputs to {}", path);
+}
+
+InputRecorder::~InputRecorder() {
+  file_.flush();
+  if (!file_) {
+    spdlog::error("Failed to write the input log {}", path_);
+    return;
+  }
+  spdlog::info("Recorded inputs of {} frames to {}", frame_count_, path_);
+}
+
+void InputRecorder::Write(const InputFrame &frame) {
+  if (frame.views.size() != view_count_ || frame.spaces.size() != space_count_) {
+    throw std::runtime_error("input frame does not match the input log");
+  }
+  const InputFrameRecord kRecord{
+      frame.predicted_display_time,
+      frame.should_render,
+      frame.views_valid,
+      frame.hands,
+      frame.quit_requested,
+  };
+  WriteRaw(file_, &kRecord, 1);
+  WriteRaw(file_, frame.views.data(), frame.views.size());
+  WriteRaw(file_, frame.spaces.data(), frame.spaces.size());
+  frame_count_++;
+}
+
+InputReplay::InputReplay(const std::string &path, uint32_t view_count, uint32_t space_count)
+    : file_(path, std::ios::binary), path_(path) {
+  if (!file_) {
+    throw std::runtime_error("failed to open " + path);
+  }
+  InputLogHeader header{};
+  if (!ReadRaw(file_, &header, 1) || header.magic != kMagic) {
+    throw std::runtime_error(path + " is not an input log");
+  }
+  if (header.version != kVersion) {
+    throw std::runtime_error(fmt::format("{} has version {}, expected {}",
+                                         path,
+                                         header.version,
+                                         kVersion));
+  }
+  if (header.view_count != view_count || header.space_count != space_count) {
+    throw std::runtime_error(fmt::format("{} was recorded with {} views and {} spaces, "
+                                         "the session has {} views and {} spaces",
+                                         path,
+                                         header.view_count,
+                                         header.space_count,
+                                         view_count,
+                                         space_count));
+  }
+  view_count_ = view_count;
+  space_count_ = space_count;
+  spdlog::info("Replaying inputs from {}", path);
+}
+
+bool InputReplay::Read(InputFrame *frame) {
+  InputFrameRecord record{};
+  if (!ReadRaw(file_, &record, 1)) {
+    return false;
+  }
+  frame->views.resize(view_count_);
+  frame->spaces.resize(space_count_);
+  if (!ReadRaw(file_, frame->views.data(), frame->views.size())
+      || !ReadRaw(file_, frame->spaces.data(), frame->spaces.size())) {
+    spdlog::warn("Input log {} ends with a truncated frame", path_);
+    return false;
+  }
+  frame->predicted_display_time = record.predicted_display_time;
+  frame->should_render = record.should_render;
+  frame->views_valid = record.views_valid;
+  frame->hands = record.hands;
+  frame->quit_requested = record.quit_requested;
+  frame_count_++;
+  return true;
+}
+
+uint64_t InputReplay::GetFrameCount() const {
+  return frame_count_;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "openxr-include.hpp"
+#include "math_utils.h"
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct RecordedView {
+  XrPosef pose;
+  XrFovf fov;
+};
+
+struct RecordedSpace {
+  uint32_t valid;
+  XrResult result;
+  glm::quat orientation;
+  glm::vec3 position;
+};
+
+struct RecordedHand {
+  XrBool32 grab_active;
+  float grab_value;
+  XrBool32 pose_active;
+};
+
+// Everything a frame consumed from the runtime: the action states of PollActions and the
+// views and space locations of WaitFrame. Views and spaces keep the counts the log was
+// opened with, so the frame is written and read without allocating.
+struct InputFrame {
+  XrTime predicted_display_time = 0;
+  XrBool32 should_render = XR_FALSE;
+  XrBool32 views_valid = XR_FALSE;
+  // left and right, indexed by side
+  std::array<RecordedHand, 2> hands{};
+  XrBool32 quit_requested = XR_FALSE;
+  std::vector<RecordedView> views{};
+  std::vector<RecordedSpace> spaces{};
+};
+
+// Binary log of input frames, a header with the view and space counts followed by one fixed
+// size record per frame. Records use the layout of the host, logs are not meant to be moved
+// between architectures.
+class InputRecorder {
+ private:
+  std::ofstream file_;
+  std::string path_;
+  uint32_t view_count_;
+  uint32_t space_count_;
+  uint64_t frame_count_ = 0;
+ public:
+  // Throws when the file can not be created.
+  InputRecorder(const std::string &path, uint32_t view_count, uint32_t space_count);
+  InputRecorder(const InputRecorder &) = delete;
+  ~InputRecorder();
+
+  void Write(const InputFrame &frame);
+};
+
+class InputReplay {
+ private:
+  std::ifstream file_;
+  std::string path_;
+  uint32_t view_count_ = 0;
+  uint32_t space_count_ = 0;
+  uint64_t frame_count_ = 0;
+ public:
+  // Throws when the file can not be read or was recorded with other view or space counts.
+  InputReplay(const std::string &path, uint32_t view_count, uint32_t space_count);
+  InputReplay(const InputReplay &) = delete;
+
+  // Returns false once all frames were read.
+  bool Read(InputFrame *frame);
+
+  [[nodiscard]] uint64_t GetFrameCount() const;
+};
@@ -4,10 +4,26 @@
 #include "platform.hpp"
 
 #include "openxr_program.hpp"
+#include "trace.hpp"
 
 #include <spdlog/sinks/android_sink.h>
 #include <spdlog/spdlog.h>
 
+#include <sys/system_properties.h>
+
+#include <cstring>
+
+// The frame pipeline overlaps xrWaitFrame and simulation of the next frame with recording and
+// submission of the current one on separate threads. It is on unless turned off with
+// adb shell setprop debug.questxr.frame_pipeline 0
+static bool IsFramePipelineEnabled() {
+  char value[PROP_VALUE_MAX] = {};
+  if (__system_property_get("debug.questxr.frame_pipeline", value) <= 0) {
+    return true;
+  }
+  return std::strcmp(value, "0") != 0;
+}
+
 struct AndroidAppState {
   bool resumed = false;
 };
@@ -53,6 +69,7 @@ void android_main(struct android_app *app) {
     auto android_logger = spdlog::android_logger_mt("android", "spdlog-android");
     android_logger->set_level(spdlog::level::info);
     spdlog::set_default_logger(android_logger);
+    TRACE_THREAD_NAME("main");
 
     JNIEnv *env;
     app->activity->vm->AttachCurrentThread(&env, nullptr);
@@ -65,6 +82,7 @@ void android_main(struct android_app *app) {
     std::shared_ptr<PlatformData> data = std::make_shared<PlatformData>();
     data->application_vm = app->activity->vm;
     data->application_activity = app->activity->clazz;
+    data->application_data_path = app->activity->internalDataPath;
 
     std::shared_ptr<OpenXrProgram> program = CreateOpenXrProgram(CreatePlatform(data));
 
@@ -72,14 +90,20 @@ void android_main(struct android_app *app) {
     program->InitializeSystem();
     program->InitializeSession();
     program->CreateSwapchains();
+    const bool kUseFramePipeline = IsFramePipelineEnabled();
+    spdlog::info("Frame pipeline {}", kUseFramePipeline ? "enabled" : "disabled");
     while (app->destroyRequested == 0) {
       for (;;) {
         int events;
         struct android_poll_source *source;
-        const int kTimeoutMilliseconds =
+        int timeout_milliseconds =
             (!app_state.resumed && !program->IsSessionRunning() &&
                 app->destroyRequested == 0) ? -1 : 0;
-        if (ALooper_pollAll(kTimeoutMilliseconds, nullptr, &events, (void **) &source) < 0) {
+        // frames are produced on other threads, only events need attention here
+        if (timeout_milliseconds == 0 && program->IsFramePipelineRunning()) {
+          timeout_milliseconds = 5;
+        }
+        if (ALooper_pollAll(timeout_milliseconds, nullptr, &events, (void **) &source) < 0) {
           break;
         }
         if (source != nullptr) {
@@ -92,10 +116,15 @@ void android_main(struct android_app *app) {
         continue;
       }
 
+      if (kUseFramePipeline) {
+        program->StartFramePipeline();
+        continue;
+      }
       program->PollActions();
       program->RenderFrame();
     }
 
+    program->StopFramePipeline();
     app->activity->vm->DetachCurrentThread();
   } catch (const std::exception &ex) {
     spdlog::error(ex.what());
@@ -0,0 +1,113 @@
+#include "platform_data.hpp"
+#include "platform.hpp"
+
+#include "openxr_program.hpp"
+#include "trace.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Usage: quest-xr-host [frame_count] [data_directory] [record|replay input_log]
+// Renders frame_count frames and writes frame timings into data_directory. Fails when the
+// session does not run for too long, e.g. without a runtime.
+// With record the inputs of every frame are written to input_log, replay renders them again
+// and stops early when the log ends.
+// Select a runtime with XR_RUNTIME_JSON, e.g. the manifest of quest-xr-mock-runtime.
+// QUEST_XR_FRAMES_IN_FLIGHT sets how many frames the gpu may lag behind, QUEST_XR_MSAA the
+// msaa policy (off, recommended, <samples> or max:<samples>) and QUEST_XR_FOVEATION the
+// foveation level (off, low, medium or high). QUEST_XR_FRAME_PIPELINE=1 renders with the
+// frame pipeline instead of the serial frame loop.
+int main(int argc, char **argv) {
+  try {
+    spdlog::set_level(spdlog::level::info);
+    TRACE_THREAD_NAME("main");
+    const uint64_t kFrameCount = argc > 1 ? std::stoull(argv[1]) : 1000;
+
+    std::shared_ptr<PlatformData> data = std::make_shared<PlatformData>();
+    data->application_data_path = argc > 2 ? argv[2] : ".";
+
+    std::shared_ptr<OpenXrProgram> program = CreateOpenXrProgram(CreatePlatform(data));
+
+    program->CreateInstance();
+    program->InitializeSystem();
+    program->InitializeSession();
+    if (const char *msaa = std::getenv("QUEST_XR_MSAA")) {
+      program->SetMsaaPolicy(ParseMsaaPolicy(msaa));
+    }
+    if (const char *foveation = std::getenv("QUEST_XR_FOVEATION")) {
+      program->SetFoveationLevel(ParseFoveationLevel(foveation));
+    }
+    program->CreateSwapchains();
+    if (const char *frames_in_flight = std::getenv("QUEST_XR_FRAMES_IN_FLIGHT")) {
+      program->SetMaxFramesInFlight(static_cast<uint32_t>(std::stoul(frames_in_flight)));
+    }
+    if (argc > 4) {
+      const std::string kMode = argv[3];
+      if (kMode == "record") {
+        program->RecordInputs(argv[4]);
+      } else if (kMode == "replay") {
+        program->ReplayInputs(argv[4]);
+      } else {
+        throw std::runtime_error("unknown input mode " + kMode);
+      }
+    }
+
+    const char *frame_pipeline = std::getenv("QUEST_XR_FRAME_PIPELINE");
+    const bool kUseFramePipeline = frame_pipeline != nullptr && std::string(frame_pipeline) == "1";
+
+    constexpr auto kSessionTimeout = std::chrono::seconds(10);
+    auto last_progress = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point first_frame{};
+    uint64_t rendered_frames = 0;
+    while (rendered_frames < kFrameCount) {
+      program->PollEvents();
+      if (program->IsSessionExiting()) {
+        break;
+      }
+      if (!program->IsSessionRunning()) {
+        if (std::chrono::steady_clock::now() - last_progress > kSessionTimeout) {
+          throw std::runtime_error("session is not running");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        continue;
+      }
+      if (first_frame == std::chrono::steady_clock::time_point{}) {
+        first_frame = std::chrono::steady_clock::now();
+      }
+      if (kUseFramePipeline) {
+        // frames are produced on other threads, this one only polls events
+        program->StartFramePipeline();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      } else {
+        program->PollActions();
+        program->RenderFrame();
+      }
+      const uint64_t kSubmittedFrames = program->GetSubmittedFrameCount();
+      if (kSubmittedFrames != rendered_frames) {
+        rendered_frames = kSubmittedFrames;
+        last_progress = std::chrono::steady_clock::now();
+      } else if (std::chrono::steady_clock::now() - last_progress > kSessionTimeout) {
+        throw std::runtime_error("no frames were submitted");
+      }
+    }
+    program->StopFramePipeline();
+
+    const std::chrono::duration<double> kElapsed = last_progress - first_frame;
+    spdlog::info("Rendered {} frames in {:.3f}s, {:.3f}ms per frame",
+                 rendered_frames,
+                 kElapsed.count(),
+                 kElapsed.count() * 1000.0 / static_cast<double>(rendered_frames));
+    program->DumpFrameTimings();
+    return EXIT_SUCCESS;
+  } catch (const std::exception &ex) {
+    spdlog::error(ex.what());
+  } catch (...) {
+    spdlog::error("Unknown Error");
+  }
+  return EXIT_FAILURE;
+}
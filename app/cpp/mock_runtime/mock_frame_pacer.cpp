@@ -0,0 +1,169 @@
+#include "mock_frame_pacer.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+XrTime mock_runtime::GetCurrentTime() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+mock_runtime::MockFramePacer::MockFramePacer(XrTime epoch,
+                                             XrDuration display_period,
+                                             XrDuration wake_jitter,
+                                             uint64_t seed)
+    : epoch_(epoch),
+      display_period_(display_period),
+      wake_jitter_(wake_jitter),
+      random_(seed),
+      records_(kRecordCapacity) {}
+
+mock_runtime::MockFramePacer::FrameRecord &
+mock_runtime::MockFramePacer::GetRecord(uint64_t frame_index) {
+  return records_[frame_index % kRecordCapacity];
+}
+
+void mock_runtime::MockFramePacer::WaitFrame(XrTime *predicted_display_time,
+                                             XrDuration *predicted_display_period) {
+  const XrTime kCallTime = GetCurrentTime();
+  XrTime wake_time = 0;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    frame_begun_.wait(lock, [this] { return begun_count_ == waited_count_; });
+
+    // a frame that missed its vsync is woken at the next one
+    const int64_t kVsyncIndex = std::max((GetCurrentTime() - epoch_) / display_period_ + 1,
+                                         last_vsync_index_ + 1);
+    std::uniform_int_distribution<XrDuration> jitter(0, wake_jitter_);
+    wake_time = epoch_ + kVsyncIndex * display_period_ + jitter(random_);
+    last_vsync_index_ = kVsyncIndex;
+
+    GetRecord(waited_count_) = {
+        .vsync_index = kVsyncIndex,
+        .wait_call_time = kCallTime,
+        .wake_time = wake_time,
+        .begin_time = 0,
+        .end_time = 0,
+        .display_time = epoch_ + (kVsyncIndex + 1) * display_period_,
+        .layer_count = 0,
+        .discarded = false,
+    };
+    *predicted_display_time = GetRecord(waited_count_).display_time;
+    *predicted_display_period = display_period_;
+    waited_count_++;
+  }
+  std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+      std::chrono::nanoseconds(wake_time)));
+}
+
+XrResult mock_runtime::MockFramePacer::BeginFrame() {
+  XrResult result = XR_SUCCESS;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (begun_count_ == waited_count_) {
+      return XR_ERROR_CALL_ORDER_INVALID;
+    }
+    if (frame_in_progress_) {
+      GetRecord(begun_count_ - 1).discarded = true;
+      result = XR_FRAME_DISCARDED;
+    }
+    GetRecord(begun_count_).begin_time = GetCurrentTime();
+    begun_count_++;
+    frame_in_progress_ = true;
+  }
+  frame_begun_.notify_one();
+  return result;
+}
+
+XrResult mock_runtime::MockFramePacer::EndFrame(XrTime display_time, uint32_t layer_count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!frame_in_progress_) {
+    return XR_ERROR_CALL_ORDER_INVALID;
+  }
+  FrameRecord &record = GetRecord(begun_count_ - 1);
+  if (display_time != record.display_time) {
+    return XR_ERROR_TIME_INVALID;
+  }
+  record.end_time = GetCurrentTime();
+  record.layer_count = layer_count;
+  frame_in_progress_ = false;
+  ended_count_++;
+  return XR_SUCCESS;
+}
+
+uint64_t mock_runtime::MockFramePacer::GetEndedFrameCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return ended_count_;
+}
+
+void mock_runtime::MockFramePacer::LogSummary() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint64_t kFirst = waited_count_ > kRecordCapacity ? waited_count_ - kRecordCapacity : 0;
+  std::vector<XrDuration> wake_to_end{};
+  uint64_t late_count = 0;
+  uint64_t discarded_count = 0;
+  int64_t missed_vsyncs = 0;
+  for (uint64_t frame = kFirst; frame < waited_count_; frame++) {
+    const FrameRecord &record = GetRecord(frame);
+    if (frame > kFirst) {
+      missed_vsyncs += record.vsync_index - GetRecord(frame - 1).vsync_index - 1;
+    }
+    discarded_count += record.discarded ? 1 : 0;
+    if (record.end_time != 0) {
+      wake_to_end.push_back(record.end_time - record.wake_time);
+      late_count += record.end_time > record.display_time ? 1 : 0;
+    }
+  }
+  if (wake_to_end.empty()) {
+    spdlog::info("mock runtime: no frame was ended");
+    return;
+  }
+  std::sort(wake_to_end.begin(), wake_to_end.end());
+  auto percentile_ms = [&wake_to_end](float fraction) {
+    const auto kIndex = static_cast<size_t>(fraction * static_cast<float>(wake_to_end.size() - 1));
+    return static_cast<double>(wake_to_end[kIndex]) / 1e6;
+  };
+  spdlog::info("mock runtime: {} frames ended, {} late, {} discarded, {} vsyncs missed",
+               wake_to_end.size(),
+               late_count,
+               discarded_count,
+               missed_vsyncs);
+  spdlog::info("mock runtime: wake to xrEndFrame p50={:.3f}ms p95={:.3f}ms p99={:.3f}ms",
+               percentile_ms(0.50F),
+               percentile_ms(0.95F),
+               percentile_ms(0.99F));
+}
+
+void mock_runtime::MockFramePacer::WriteCsv(const std::string &path) {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("failed to open " + path);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  file << "frame,vsync,wait_call_us,wake_us,begin_us,end_us,display_us,layers,discarded,late\n";
+  auto write_time = [&file, this](XrTime time) {
+    file << ",";
+    if (time != 0) {
+      file << (time - epoch_) / 1000;
+    }
+  };
+  const uint64_t kFirst = waited_count_ > kRecordCapacity ? waited_count_ - kRecordCapacity : 0;
+  for (uint64_t frame = kFirst; frame < waited_count_; frame++) {
+    const FrameRecord &record = GetRecord(frame);
+    file << frame << "," << record.vsync_index;
+    write_time(record.wait_call_time);
+    write_time(record.wake_time);
+    write_time(record.begin_time);
+    write_time(record.end_time);
+    write_time(record.display_time);
+    file << "," << record.layer_count
+         << "," << (record.discarded ? 1 : 0)
+         << "," << (record.end_time > record.display_time ? 1 : 0) << "\n";
+  }
+  spdlog::info("mock runtime: timings of {} frames written to {}", waited_count_ - kFirst, path);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <openxr/openxr.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace mock_runtime {
+// Current time on the clock XrTime values of the mock runtime are taken from.
+XrTime GetCurrentTime();
+
+// Frame timing of a simulated display refreshing every display period from the epoch on.
+// xrWaitFrame wakes the application at the next vsync, delayed by a random jitter, and
+// predicts the frame to be displayed one period later. Timings of every frame are kept in a
+// preallocated ring, frames never allocate memory.
+class MockFramePacer {
+ private:
+  static constexpr size_t kRecordCapacity = 1 << 16;
+
+  struct FrameRecord {
+    int64_t vsync_index;
+    XrTime wait_call_time;
+    XrTime wake_time;
+    XrTime begin_time;
+    XrTime end_time;
+    XrTime display_time;
+    uint32_t layer_count;
+    bool discarded;
+  };
+
+  XrTime epoch_;
+  XrDuration display_period_;
+  XrDuration wake_jitter_;
+  std::mt19937_64 random_;
+
+  std::mutex mutex_;
+  std::condition_variable frame_begun_;
+  int64_t last_vsync_index_ = -1;
+  uint64_t waited_count_ = 0;
+  uint64_t begun_count_ = 0;
+  uint64_t ended_count_ = 0;
+  bool frame_in_progress_ = false;
+  std::vector<FrameRecord> records_;
+
+  FrameRecord &GetRecord(uint64_t frame_index);
+ public:
+  MockFramePacer(XrTime epoch, XrDuration display_period, XrDuration wake_jitter, uint64_t seed);
+  MockFramePacer(const MockFramePacer &) = delete;
+
+  // Blocks until xrBeginFrame of the previously waited frame was called and the display wakes
+  // the application. Only one thread may wait at a time.
+  void WaitFrame(XrTime *predicted_display_time, XrDuration *predicted_display_period);
+
+  // Returns XR_FRAME_DISCARDED when the previous frame was begun but never ended.
+  XrResult BeginFrame();
+
+  // display_time must be the predicted display time of the begun frame.
+  XrResult EndFrame(XrTime display_time, uint32_t layer_count);
+
+  [[nodiscard]] uint64_t GetEndedFrameCount();
+
+  void LogSummary();
+
+  // One row per recorded frame, oldest first, times in microseconds since the epoch.
+  void WriteCsv(const std::string &path);
+};
+}
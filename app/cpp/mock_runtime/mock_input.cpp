@@ -0,0 +1,511 @@
+#include "mock_runtime.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+using mock_runtime::FromHandle;
+using mock_runtime::MockAction;
+using mock_runtime::MockActionSet;
+using mock_runtime::MockActionState;
+using mock_runtime::MockInstance;
+using mock_runtime::MockSession;
+using mock_runtime::ToHandle;
+using mock_runtime::TrackedDevice;
+
+constexpr const char *kPreferredInteractionProfile = "/interaction_profiles/oculus/touch_controller";
+
+bool IsSessionFocused(MockSession *session) {
+  std::lock_guard<std::mutex> lock(session->state_mutex);
+  return session->state == XR_SESSION_STATE_FOCUSED;
+}
+
+bool IsAttached(const MockSession &session, const MockActionSet *action_set) {
+  return std::find(session.attached_action_sets.begin(),
+                   session.attached_action_sets.end(),
+                   action_set) != session.attached_action_sets.end();
+}
+
+// Resolves the action and subaction index of get info like structures.
+template<typename GetInfo>
+XrResult GetActionState(const MockSession &session,
+                        const GetInfo &get_info,
+                        XrActionType type,
+                        const MockActionState **state) {
+  if (get_info.action == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  const MockAction &action = *FromHandle<MockAction>(get_info.action);
+  if (action.type != type) {
+    return XR_ERROR_ACTION_TYPE_MISMATCH;
+  }
+  if (!IsAttached(session, action.action_set)) {
+    return XR_ERROR_ACTIONSET_NOT_ATTACHED;
+  }
+  if (get_info.subactionPath != XR_NULL_PATH
+      && std::find(action.subaction_paths.begin(),
+                   action.subaction_paths.end(),
+                   get_info.subactionPath) == action.subaction_paths.end()) {
+    return XR_ERROR_PATH_UNSUPPORTED;
+  }
+  *state = &action.states[mock_runtime::GetSubactionIndex(*session.instance,
+                                                           get_info.subactionPath)];
+  return XR_SUCCESS;
+}
+
+// Scripted value of the action, boolean inputs are never pressed so scripts can not end the
+// session by accident.
+float GetScriptedValue(const MockSession &session,
+                       const MockAction &action,
+                       size_t subaction,
+                       XrTime time) {
+  if (action.type != XR_ACTION_TYPE_FLOAT_INPUT) {
+    return 0.0F;
+  }
+  const mock_runtime::MockTrajectory &trajectory = *session.instance->trajectory;
+  const double kSeconds = mock_runtime::GetSessionSeconds(session, time);
+  const float kLeft = trajectory.GetGrab(TrackedDevice::LEFT_HAND, kSeconds);
+  const float kRight = trajectory.GetGrab(TrackedDevice::RIGHT_HAND, kSeconds);
+  switch (subaction) {
+    case mock_runtime::kLeftSubaction:return kLeft;
+    case mock_runtime::kRightSubaction:return kRight;
+    default:return std::max(kLeft, kRight);
+  }
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL CreateActionSet(XrInstance instance,
+                                               const XrActionSetCreateInfo *create_info,
+                                               XrActionSet *action_set) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (create_info == nullptr || action_set == nullptr
+      || create_info->type != XR_TYPE_ACTION_SET_CREATE_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (create_info->actionSetName[0] == '\0') {
+    return XR_ERROR_NAME_INVALID;
+  }
+  MockInstance *mock_instance = FromHandle<MockInstance>(instance);
+  auto mock_action_set = std::make_unique<MockActionSet>();
+  mock_action_set->instance = mock_instance;
+  mock_action_set->name = create_info->actionSetName;
+  *action_set = ToHandle<XrActionSet>(mock_action_set.get());
+  mock_instance->action_sets.push_back(std::move(mock_action_set));
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL DestroyActionSet(XrActionSet action_set) {
+  if (action_set == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  MockActionSet *mock_action_set = FromHandle<MockActionSet>(action_set);
+  auto &action_sets = mock_action_set->instance->action_sets;
+  action_sets.erase(std::remove_if(action_sets.begin(), action_sets.end(),
+                                   [mock_action_set](const std::unique_ptr<MockActionSet> &owned) {
+                                     return owned.get() == mock_action_set;
+                                   }),
+                    action_sets.end());
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL CreateAction(XrActionSet action_set,
+                                            const XrActionCreateInfo *create_info,
+                                            XrAction *action) {
+  if (action_set == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (create_info == nullptr || action == nullptr
+      || create_info->type != XR_TYPE_ACTION_CREATE_INFO
+      || (create_info->countSubactionPaths > 0 && create_info->subactionPaths == nullptr)) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (create_info->actionName[0] == '\0') {
+    return XR_ERROR_NAME_INVALID;
+  }
+  MockActionSet *mock_action_set = FromHandle<MockActionSet>(action_set);
+  if (mock_action_set->attached) {
+    return XR_ERROR_ACTIONSETS_ALREADY_ATTACHED;
+  }
+  const MockInstance &instance = *mock_action_set->instance;
+  for (uint32_t i = 0; i < create_info->countSubactionPaths; i++) {
+    if (create_info->subactionPaths[i] != instance.left_hand_path
+        && create_info->subactionPaths[i] != instance.right_hand_path) {
+      return XR_ERROR_PATH_UNSUPPORTED;
+    }
+  }
+  auto mock_action = std::make_unique<MockAction>();
+  mock_action->action_set = mock_action_set;
+  mock_action->type = create_info->actionType;
+  mock_action->name = create_info->actionName;
+  mock_action->subaction_paths.assign(create_info->subactionPaths,
+                                      create_info->subactionPaths
+                                          + create_info->countSubactionPaths);
+  *action = ToHandle<XrAction>(mock_action.get());
+  mock_action_set->actions.push_back(std::move(mock_action));
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL DestroyAction(XrAction action) {
+  if (action == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  MockAction *mock_action = FromHandle<MockAction>(action);
+  auto &actions = mock_action->action_set->actions;
+  actions.erase(std::remove_if(actions.begin(), actions.end(),
+                               [mock_action](const std::unique_ptr<MockAction> &owned) {
+                                 return owned.get() == mock_action;
+                               }),
+                actions.end());
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL SuggestInteractionProfileBindings(XrInstance instance,
+                                                                 const XrInteractionProfileSuggestedBinding *suggested_bindings) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (suggested_bindings == nullptr
+      || suggested_bindings->type != XR_TYPE_INTERACTION_PROFILE_SUGGESTED_BINDING
+      || suggested_bindings->countSuggestedBindings == 0
+      || suggested_bindings->suggestedBindings == nullptr) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  MockInstance *mock_instance = FromHandle<MockInstance>(instance);
+  if (std::any_of(mock_instance->action_sets.begin(), mock_instance->action_sets.end(),
+                  [](const std::unique_ptr<MockActionSet> &action_set) {
+                    return action_set->attached;
+                  })) {
+    return XR_ERROR_ACTIONSETS_ALREADY_ATTACHED;
+  }
+  if (mock_runtime::GetPathString(mock_instance, suggested_bindings->interactionProfile)
+      .rfind("/interaction_profiles/", 0) != 0) {
+    return XR_ERROR_PATH_UNSUPPORTED;
+  }
+  mock_instance->suggested_bindings[suggested_bindings->interactionProfile].assign(
+      suggested_bindings->suggestedBindings,
+      suggested_bindings->suggestedBindings + suggested_bindings->countSuggestedBindings);
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL AttachSessionActionSets(XrSession session,
+                                                       const XrSessionActionSetsAttachInfo *attach_info) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (attach_info == nullptr || attach_info->type != XR_TYPE_SESSION_ACTION_SETS_ATTACH_INFO
+      || attach_info->countActionSets == 0 || attach_info->actionSets == nullptr) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  if (!mock_session->attached_action_sets.empty()) {
+    return XR_ERROR_ACTIONSETS_ALREADY_ATTACHED;
+  }
+  MockInstance *instance = mock_session->instance;
+
+  // the touch controllers are connected when the application supports them, otherwise the
+  // first profile it suggested bindings for is used
+  XrPath profile = mock_runtime::InternPath(instance, kPreferredInteractionProfile);
+  if (instance->suggested_bindings.count(profile) == 0) {
+    profile = instance->suggested_bindings.empty() ? XR_NULL_PATH
+                                                   : instance->suggested_bindings.begin()->first;
+  }
+  mock_session->interaction_profile = profile;
+
+  for (uint32_t i = 0; i < attach_info->countActionSets; i++) {
+    if (attach_info->actionSets[i] == XR_NULL_HANDLE) {
+      return XR_ERROR_HANDLE_INVALID;
+    }
+    MockActionSet *action_set = FromHandle<MockActionSet>(attach_info->actionSets[i]);
+    action_set->attached = true;
+    mock_session->attached_action_sets.push_back(action_set);
+    for (const auto &action: action_set->actions) {
+      action->bound_sources.clear();
+      if (profile == XR_NULL_PATH) {
+        continue;
+      }
+      for (const XrActionSuggestedBinding &binding: instance->suggested_bindings[profile]) {
+        if (binding.action == ToHandle<XrAction>(action.get())) {
+          action->bound_sources.push_back(binding.binding);
+        }
+      }
+    }
+  }
+
+  if (profile != XR_NULL_PATH) {
+    XrEventDataInteractionProfileChanged event{
+        .type = XR_TYPE_EVENT_DATA_INTERACTION_PROFILE_CHANGED,
+        .session = session,
+    };
+    mock_runtime::PushEvent(instance, event);
+  }
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetCurrentInteractionProfile(XrSession session,
+                                                            XrPath top_level_user_path,
+                                                            XrInteractionProfileState *profile_state) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (profile_state == nullptr || profile_state->type != XR_TYPE_INTERACTION_PROFILE_STATE) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  const MockSession &mock_session = *FromHandle<MockSession>(session);
+  if (mock_session.attached_action_sets.empty()) {
+    return XR_ERROR_ACTIONSET_NOT_ATTACHED;
+  }
+  const bool kHand = top_level_user_path == mock_session.instance->left_hand_path
+      || top_level_user_path == mock_session.instance->right_hand_path;
+  profile_state->interactionProfile = kHand ? mock_session.interaction_profile : XR_NULL_PATH;
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL SyncActions(XrSession session, const XrActionsSyncInfo *sync_info) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (sync_info == nullptr || sync_info->type != XR_TYPE_ACTIONS_SYNC_INFO
+      || (sync_info->countActiveActionSets > 0 && sync_info->activeActionSets == nullptr)) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  for (uint32_t i = 0; i < sync_info->countActiveActionSets; i++) {
+    const XrActiveActionSet &active_action_set = sync_info->activeActionSets[i];
+    if (active_action_set.actionSet == XR_NULL_HANDLE) {
+      return XR_ERROR_HANDLE_INVALID;
+    }
+    if (!IsAttached(*mock_session, FromHandle<MockActionSet>(active_action_set.actionSet))) {
+      return XR_ERROR_ACTIONSET_NOT_ATTACHED;
+    }
+  }
+
+  // inputs are only active while the session has focus
+  const bool kFocused = IsSessionFocused(mock_session);
+  const XrTime kNow = mock_runtime::GetCurrentTime();
+  for (MockActionSet *action_set: mock_session->attached_action_sets) {
+    bool set_active = false;
+    for (uint32_t i = 0; i < sync_info->countActiveActionSets; i++) {
+      set_active = set_active
+          || FromHandle<MockActionSet>(sync_info->activeActionSets[i].actionSet) == action_set;
+    }
+    for (const auto &action: action_set->actions) {
+      for (size_t subaction = 0; subaction < action->states.size(); subaction++) {
+        const bool kHasSubaction = subaction == mock_runtime::kNoSubaction
+            || std::find(action->subaction_paths.begin(),
+                         action->subaction_paths.end(),
+                         subaction == mock_runtime::kLeftSubaction
+                         ? mock_session->instance->left_hand_path
+                         : mock_session->instance->right_hand_path)
+                != action->subaction_paths.end();
+        MockActionState &state = action->states[subaction];
+        const bool kActive = kFocused && set_active && kHasSubaction
+            && !action->bound_sources.empty();
+        const float kValue = kActive ? GetScriptedValue(*mock_session, *action, subaction, kNow)
+                                     : 0.0F;
+        state.changed = kActive && state.active && kValue != state.value;
+        if (state.changed) {
+          state.last_change_time = kNow;
+        }
+        state.active = kActive;
+        state.value = kValue;
+      }
+    }
+  }
+  return kFocused ? XR_SUCCESS : XR_SESSION_NOT_FOCUSED;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetActionStateBoolean(XrSession session,
+                                                     const XrActionStateGetInfo *get_info,
+                                                     XrActionStateBoolean *state) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (get_info == nullptr || state == nullptr || get_info->type != XR_TYPE_ACTION_STATE_GET_INFO
+      || state->type != XR_TYPE_ACTION_STATE_BOOLEAN) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  const MockActionState *action_state = nullptr;
+  const XrResult kResult = GetActionState(*FromHandle<MockSession>(session),
+                                          *get_info,
+                                          XR_ACTION_TYPE_BOOLEAN_INPUT,
+                                          &action_state);
+  if (XR_FAILED(kResult)) {
+    return kResult;
+  }
+  state->currentState = action_state->value > 0.5F ? XR_TRUE : XR_FALSE;
+  state->changedSinceLastSync = action_state->changed ? XR_TRUE : XR_FALSE;
+  state->lastChangeTime = action_state->last_change_time;
+  state->isActive = action_state->active ? XR_TRUE : XR_FALSE;
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetActionStateFloat(XrSession session,
+                                                   const XrActionStateGetInfo *get_info,
+                                                   XrActionStateFloat *state) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (get_info == nullptr || state == nullptr || get_info->type != XR_TYPE_ACTION_STATE_GET_INFO
+      || state->type != XR_TYPE_ACTION_STATE_FLOAT) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  const MockActionState *action_state = nullptr;
+  const XrResult kResult = GetActionState(*FromHandle<MockSession>(session),
+                                          *get_info,
+                                          XR_ACTION_TYPE_FLOAT_INPUT,
+                                          &action_state);
+  if (XR_FAILED(kResult)) {
+    return kResult;
+  }
+  state->currentState = action_state->value;
+  state->changedSinceLastSync = action_state->changed ? XR_TRUE : XR_FALSE;
+  state->lastChangeTime = action_state->last_change_time;
+  state->isActive = action_state->active ? XR_TRUE : XR_FALSE;
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetActionStatePose(XrSession session,
+                                                  const XrActionStateGetInfo *get_info,
+                                                  XrActionStatePose *state) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (get_info == nullptr || state == nullptr || get_info->type != XR_TYPE_ACTION_STATE_GET_INFO
+      || state->type != XR_TYPE_ACTION_STATE_POSE) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  const MockActionState *action_state = nullptr;
+  const XrResult kResult = GetActionState(*FromHandle<MockSession>(session),
+                                          *get_info,
+                                          XR_ACTION_TYPE_POSE_INPUT,
+                                          &action_state);
+  if (XR_FAILED(kResult)) {
+    return kResult;
+  }
+  state->isActive = action_state->active ? XR_TRUE : XR_FALSE;
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL ApplyHapticFeedback(XrSession session,
+                                                   const XrHapticActionInfo *haptic_action_info,
+                                                   const XrHapticBaseHeader *haptic_feedback) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (haptic_action_info == nullptr || haptic_feedback == nullptr
+      || haptic_action_info->type != XR_TYPE_HAPTIC_ACTION_INFO
+      || haptic_feedback->type != XR_TYPE_HAPTIC_VIBRATION) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  const MockActionState *action_state = nullptr;
+  const XrResult kResult = GetActionState(*mock_session,
+                                          *haptic_action_info,
+                                          XR_ACTION_TYPE_VIBRATION_OUTPUT,
+                                          &action_state);
+  if (XR_FAILED(kResult)) {
+    return kResult;
+  }
+  // there is nothing to vibrate
+  return IsSessionFocused(mock_session) ? XR_SUCCESS : XR_SESSION_NOT_FOCUSED;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL StopHapticFeedback(XrSession session,
+                                                  const XrHapticActionInfo *haptic_action_info) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (haptic_action_info == nullptr || haptic_action_info->type != XR_TYPE_HAPTIC_ACTION_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  const MockActionState *action_state = nullptr;
+  const XrResult kResult = GetActionState(*mock_session,
+                                          *haptic_action_info,
+                                          XR_ACTION_TYPE_VIBRATION_OUTPUT,
+                                          &action_state);
+  if (XR_FAILED(kResult)) {
+    return kResult;
+  }
+  return IsSessionFocused(mock_session) ? XR_SUCCESS : XR_SESSION_NOT_FOCUSED;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL EnumerateBoundSourcesForAction(XrSession session,
+                                                              const XrBoundSourcesForActionEnumerateInfo *enumerate_info,
+                                                              uint32_t capacity,
+                                                              uint32_t *count_output,
+                                                              XrPath *sources) {
+  if (session == XR_NULL_HANDLE || enumerate_info == nullptr
+      || enumerate_info->action == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (enumerate_info->type != XR_TYPE_BOUND_SOURCES_FOR_ACTION_ENUMERATE_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  const MockAction &action = *FromHandle<MockAction>(enumerate_info->action);
+  if (!IsAttached(*FromHandle<MockSession>(session), action.action_set)) {
+    return XR_ERROR_ACTIONSET_NOT_ATTACHED;
+  }
+  return mock_runtime::Enumerate(static_cast<uint32_t>(action.bound_sources.size()),
+                                 capacity,
+                                 count_output,
+                                 [&action, sources](uint32_t i) {
+                                   sources[i] = action.bound_sources[i];
+                                 });
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetInputSourceLocalizedName(XrSession session,
+                                                           const XrInputSourceLocalizedNameGetInfo *get_info,
+                                                           uint32_t capacity,
+                                                           uint32_t *count_output,
+                                                           char *buffer) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (get_info == nullptr || get_info->type != XR_TYPE_INPUT_SOURCE_LOCALIZED_NAME_GET_INFO
+      || get_info->whichComponents == 0) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  // the path itself serves as the name, whatever components were asked for
+  const std::string kName = mock_runtime::GetPathString(FromHandle<MockSession>(session)->instance,
+                                                        get_info->sourcePath);
+  if (kName.empty()) {
+    return XR_ERROR_PATH_INVALID;
+  }
+  return mock_runtime::EnumerateString(kName, capacity, count_output, buffer);
+}
+
+const std::array kInputFunctions{
+    MOCK_ENTRY_POINT(CreateActionSet),
+    MOCK_ENTRY_POINT(DestroyActionSet),
+    MOCK_ENTRY_POINT(CreateAction),
+    MOCK_ENTRY_POINT(DestroyAction),
+    MOCK_ENTRY_POINT(SuggestInteractionProfileBindings),
+    MOCK_ENTRY_POINT(AttachSessionActionSets),
+    MOCK_ENTRY_POINT(GetCurrentInteractionProfile),
+    MOCK_ENTRY_POINT(SyncActions),
+    MOCK_ENTRY_POINT(GetActionStateBoolean),
+    MOCK_ENTRY_POINT(GetActionStateFloat),
+    MOCK_ENTRY_POINT(GetActionStatePose),
+    MOCK_ENTRY_POINT(ApplyHapticFeedback),
+    MOCK_ENTRY_POINT(StopHapticFeedback),
+    MOCK_ENTRY_POINT(EnumerateBoundSourcesForAction),
+    MOCK_ENTRY_POINT(GetInputSourceLocalizedName),
+};
+}
+
+PFN_xrVoidFunction mock_runtime::GetInputFunction(const MockInstance &, const char *name) {
+  return FindFunction(kInputFunctions, name);
+}
+
+size_t mock_runtime::GetSubactionIndex(const MockInstance &instance, XrPath subaction_path) {
+  if (subaction_path == instance.left_hand_path) {
+    return kLeftSubaction;
+  }
+  if (subaction_path == instance.right_hand_path) {
+    return kRightSubaction;
+  }
+  return kNoSubaction;
+}
@@ -0,0 +1,518 @@
+#include "mock_runtime.hpp"
+
+#include <openxr/openxr_loader_negotiation.h>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <exception>
+
+namespace {
+using mock_runtime::FromHandle;
+using mock_runtime::MockInstance;
+using mock_runtime::NamedFunction;
+using mock_runtime::ToHandle;
+
+constexpr XrSystemId kSystemId = 1;
+constexpr XrViewConfigurationType kViewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+constexpr uint32_t kViewCount = 2;
+constexpr uint32_t kMaxImageDimension = 4096;
+
+struct Extension {
+  const char *name;
+  uint32_t version;
+};
+
+constexpr Extension kExtensions[] = {
+    {XR_KHR_VULKAN_ENABLE2_EXTENSION_NAME, XR_KHR_vulkan_enable2_SPEC_VERSION},
+    {XR_KHR_VISIBILITY_MASK_EXTENSION_NAME, XR_KHR_visibility_mask_SPEC_VERSION},
+#ifdef XR_KHR_locate_spaces
+    {XR_KHR_LOCATE_SPACES_EXTENSION_NAME, XR_KHR_locate_spaces_SPEC_VERSION},
+#endif
+};
+
+XRAPI_ATTR XrResult XRAPI_CALL EnumerateInstanceExtensionProperties(const char *layer_name,
+                                                                    uint32_t capacity,
+                                                                    uint32_t *count_output,
+                                                                    XrExtensionProperties *properties) {
+  if (layer_name != nullptr) {
+    return XR_ERROR_API_LAYER_NOT_PRESENT;
+  }
+  return mock_runtime::Enumerate(std::size(kExtensions), capacity, count_output,
+                                 [properties](uint32_t i) {
+                                   std::strncpy(properties[i].extensionName,
+                                                kExtensions[i].name,
+                                                XR_MAX_EXTENSION_NAME_SIZE - 1);
+                                   properties[i].extensionVersion = kExtensions[i].version;
+                                 });
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL CreateInstance(const XrInstanceCreateInfo *create_info,
+                                              XrInstance *instance) {
+  if (create_info == nullptr || instance == nullptr
+      || create_info->type != XR_TYPE_INSTANCE_CREATE_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (XR_VERSION_MAJOR(create_info->applicationInfo.apiVersion) != 1) {
+    return XR_ERROR_API_VERSION_UNSUPPORTED;
+  }
+  try {
+    auto mock_instance = std::make_unique<MockInstance>();
+    for (uint32_t i = 0; i < create_info->enabledExtensionCount; i++) {
+      const std::string kName = create_info->enabledExtensionNames[i];
+      if (kName == XR_KHR_VULKAN_ENABLE2_EXTENSION_NAME) {
+        mock_instance->vulkan_enable2_enabled = true;
+      } else if (kName == XR_KHR_VISIBILITY_MASK_EXTENSION_NAME) {
+        mock_instance->visibility_mask_enabled = true;
+#ifdef XR_KHR_locate_spaces
+      } else if (kName == XR_KHR_LOCATE_SPACES_EXTENSION_NAME) {
+        mock_instance->locate_spaces_enabled = true;
+#endif
+      } else {
+        spdlog::error("mock runtime: extension {} is not supported", kName);
+        return XR_ERROR_EXTENSION_NOT_SUPPORTED;
+      }
+    }
+    mock_instance->config = mock_runtime::LoadMockRuntimeConfig();
+    mock_instance->trajectory = mock_instance->config.trajectory_path.empty()
+        ? std::make_unique<mock_runtime::MockTrajectory>()
+        : std::make_unique<mock_runtime::MockTrajectory>(mock_instance->config.trajectory_path);
+    mock_instance->left_hand_path = mock_runtime::InternPath(mock_instance.get(), "/user/hand/left");
+    mock_instance->right_hand_path = mock_runtime::InternPath(mock_instance.get(), "/user/hand/right");
+    *instance = ToHandle<XrInstance>(mock_instance.release());
+    return XR_SUCCESS;
+  } catch (const std::exception &ex) {
+    spdlog::error("mock runtime: failed to create the instance, {}", ex.what());
+    return XR_ERROR_RUNTIME_FAILURE;
+  }
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL DestroyInstance(XrInstance instance) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  delete FromHandle<MockInstance>(instance);
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetInstanceProperties(XrInstance instance,
+                                                     XrInstanceProperties *properties) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (properties == nullptr || properties->type != XR_TYPE_INSTANCE_PROPERTIES) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  properties->runtimeVersion = XR_MAKE_VERSION(0, 1, 0);
+  std::strncpy(properties->runtimeName, "quest-xr mock runtime", XR_MAX_RUNTIME_NAME_SIZE - 1);
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL PollEvent(XrInstance instance, XrEventDataBuffer *event_data) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (event_data == nullptr) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  MockInstance *mock_instance = FromHandle<MockInstance>(instance);
+  std::lock_guard<std::mutex> lock(mock_instance->event_mutex);
+  if (mock_instance->events.empty()) {
+    return XR_EVENT_UNAVAILABLE;
+  }
+  *event_data = mock_instance->events.front();
+  mock_instance->events.pop_front();
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL StringToPath(XrInstance instance,
+                                            const char *path_string,
+                                            XrPath *path) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (path_string == nullptr || path == nullptr) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  const size_t kLength = std::strlen(path_string);
+  if (kLength < 2 || path_string[0] != '/' || path_string[kLength - 1] == '/'
+      || kLength >= XR_MAX_PATH_LENGTH) {
+    return XR_ERROR_PATH_FORMAT_INVALID;
+  }
+  *path = mock_runtime::InternPath(FromHandle<MockInstance>(instance), path_string);
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL PathToString(XrInstance instance,
+                                            XrPath path,
+                                            uint32_t capacity,
+                                            uint32_t *count_output,
+                                            char *buffer) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  const std::string kPathString = mock_runtime::GetPathString(FromHandle<MockInstance>(instance),
+                                                              path);
+  if (kPathString.empty()) {
+    return XR_ERROR_PATH_INVALID;
+  }
+  return mock_runtime::EnumerateString(kPathString, capacity, count_output, buffer);
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetSystem(XrInstance instance,
+                                         const XrSystemGetInfo *get_info,
+                                         XrSystemId *system_id) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (get_info == nullptr || system_id == nullptr || get_info->type != XR_TYPE_SYSTEM_GET_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (get_info->formFactor != XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY) {
+    return XR_ERROR_FORM_FACTOR_UNSUPPORTED;
+  }
+  *system_id = kSystemId;
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetSystemProperties(XrInstance instance,
+                                                   XrSystemId system_id,
+                                                   XrSystemProperties *properties) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (system_id != kSystemId) {
+    return XR_ERROR_SYSTEM_INVALID;
+  }
+  if (properties == nullptr || properties->type != XR_TYPE_SYSTEM_PROPERTIES) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  properties->systemId = kSystemId;
+  properties->vendorId = 0;
+  std::strncpy(properties->systemName, "quest-xr mock HMD", XR_MAX_SYSTEM_NAME_SIZE - 1);
+  properties->graphicsProperties.maxSwapchainImageWidth = kMaxImageDimension;
+  properties->graphicsProperties.maxSwapchainImageHeight = kMaxImageDimension;
+  properties->graphicsProperties.maxLayerCount = XR_MIN_COMPOSITION_LAYERS_SUPPORTED;
+  properties->trackingProperties.orientationTracking = XR_TRUE;
+  properties->trackingProperties.positionTracking = XR_TRUE;
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL EnumerateViewConfigurations(XrInstance instance,
+                                                           XrSystemId system_id,
+                                                           uint32_t capacity,
+                                                           uint32_t *count_output,
+                                                           XrViewConfigurationType *types) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (system_id != kSystemId) {
+    return XR_ERROR_SYSTEM_INVALID;
+  }
+  return mock_runtime::Enumerate(1, capacity, count_output, [types](uint32_t i) {
+    types[i] = kViewConfigurationType;
+  });
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetViewConfigurationProperties(XrInstance instance,
+                                                              XrSystemId system_id,
+                                                              XrViewConfigurationType type,
+                                                              XrViewConfigurationProperties *properties) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (system_id != kSystemId) {
+    return XR_ERROR_SYSTEM_INVALID;
+  }
+  if (type != kViewConfigurationType) {
+    return XR_ERROR_VIEW_CONFIGURATION_TYPE_UNSUPPORTED;
+  }
+  if (properties == nullptr || properties->type != XR_TYPE_VIEW_CONFIGURATION_PROPERTIES) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  properties->viewConfigurationType = type;
+  properties->fovMutable = XR_FALSE;
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL EnumerateViewConfigurationViews(XrInstance instance,
+                                                               XrSystemId system_id,
+                                                               XrViewConfigurationType type,
+                                                               uint32_t capacity,
+                                                               uint32_t *count_output,
+                                                               XrViewConfigurationView *views) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (system_id != kSystemId) {
+    return XR_ERROR_SYSTEM_INVALID;
+  }
+  if (type != kViewConfigurationType) {
+    return XR_ERROR_VIEW_CONFIGURATION_TYPE_UNSUPPORTED;
+  }
+  const mock_runtime::MockRuntimeConfig &config = FromHandle<MockInstance>(instance)->config;
+  return mock_runtime::Enumerate(kViewCount, capacity, count_output, [&](uint32_t i) {
+    views[i].recommendedImageRectWidth = config.view_width;
+    views[i].maxImageRectWidth = kMaxImageDimension;
+    views[i].recommendedImageRectHeight = config.view_height;
+    views[i].maxImageRectHeight = kMaxImageDimension;
+    views[i].recommendedSwapchainSampleCount = 1;
+    views[i].maxSwapchainSampleCount = 4;
+  });
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL EnumerateEnvironmentBlendModes(XrInstance instance,
+                                                              XrSystemId system_id,
+                                                              XrViewConfigurationType type,
+                                                              uint32_t capacity,
+                                                              uint32_t *count_output,
+                                                              XrEnvironmentBlendMode *modes) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (system_id != kSystemId) {
+    return XR_ERROR_SYSTEM_INVALID;
+  }
+  if (type != kViewConfigurationType) {
+    return XR_ERROR_VIEW_CONFIGURATION_TYPE_UNSUPPORTED;
+  }
+  return mock_runtime::Enumerate(1, capacity, count_output, [modes](uint32_t i) {
+    modes[i] = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
+  });
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetVulkanGraphicsRequirements2KHR(XrInstance instance,
+                                                                 XrSystemId system_id,
+                                                                 XrGraphicsRequirementsVulkanKHR *requirements) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (system_id != kSystemId) {
+    return XR_ERROR_SYSTEM_INVALID;
+  }
+  if (requirements == nullptr
+      || requirements->type != XR_TYPE_GRAPHICS_REQUIREMENTS_VULKAN2_KHR) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  requirements->minApiVersionSupported = XR_MAKE_VERSION(1, 0, 0);
+  requirements->maxApiVersionSupported = XR_MAKE_VERSION(1, 3, 0);
+  FromHandle<MockInstance>(instance)->graphics_requirements_queried = true;
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL CreateVulkanInstanceKHR(XrInstance instance,
+                                                       const XrVulkanInstanceCreateInfoKHR *create_info,
+                                                       VkInstance *vulkan_instance,
+                                                       VkResult *vulkan_result) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (create_info == nullptr || vulkan_instance == nullptr || vulkan_result == nullptr
+      || create_info->type != XR_TYPE_VULKAN_INSTANCE_CREATE_INFO_KHR
+      || create_info->pfnGetInstanceProcAddr == nullptr) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (create_info->systemId != kSystemId) {
+    return XR_ERROR_SYSTEM_INVALID;
+  }
+  auto create_vulkan_instance = reinterpret_cast<PFN_vkCreateInstance>(
+      create_info->pfnGetInstanceProcAddr(VK_NULL_HANDLE, "vkCreateInstance"));
+  if (create_vulkan_instance == nullptr) {
+    return XR_ERROR_RUNTIME_FAILURE;
+  }
+  *vulkan_result = create_vulkan_instance(create_info->vulkanCreateInfo,
+                                          create_info->vulkanAllocator,
+                                          vulkan_instance);
+  if (*vulkan_result == VK_SUCCESS) {
+    MockInstance *mock_instance = FromHandle<MockInstance>(instance);
+    mock_instance->vulkan_get_instance_proc_addr = create_info->pfnGetInstanceProcAddr;
+    mock_instance->vulkan_instance = *vulkan_instance;
+  }
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetVulkanGraphicsDevice2KHR(XrInstance instance,
+                                                           const XrVulkanGraphicsDeviceGetInfoKHR *get_info,
+                                                           VkPhysicalDevice *physical_device) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (get_info == nullptr || physical_device == nullptr
+      || get_info->type != XR_TYPE_VULKAN_GRAPHICS_DEVICE_GET_INFO_KHR) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (get_info->systemId != kSystemId) {
+    return XR_ERROR_SYSTEM_INVALID;
+  }
+  const MockInstance *mock_instance = FromHandle<MockInstance>(instance);
+  if (mock_instance->vulkan_get_instance_proc_addr == nullptr
+      || mock_instance->vulkan_instance != get_info->vulkanInstance) {
+    spdlog::error("mock runtime: the vulkan instance must come from xrCreateVulkanInstanceKHR");
+    return XR_ERROR_GRAPHICS_DEVICE_INVALID;
+  }
+  auto enumerate_physical_devices = reinterpret_cast<PFN_vkEnumeratePhysicalDevices>(
+      mock_instance->vulkan_get_instance_proc_addr(get_info->vulkanInstance,
+                                                   "vkEnumeratePhysicalDevices"));
+  uint32_t device_count = 1;
+  const VkResult kResult = enumerate_physical_devices(get_info->vulkanInstance,
+                                                      &device_count,
+                                                      physical_device);
+  // the first device is used, VK_INCOMPLETE only tells there are more
+  if ((kResult != VK_SUCCESS && kResult != VK_INCOMPLETE) || device_count == 0) {
+    return XR_ERROR_RUNTIME_FAILURE;
+  }
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL CreateVulkanDeviceKHR(XrInstance instance,
+                                                     const XrVulkanDeviceCreateInfoKHR *create_info,
+                                                     VkDevice *vulkan_device,
+                                                     VkResult *vulkan_result) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (create_info == nullptr || vulkan_device == nullptr || vulkan_result == nullptr
+      || create_info->type != XR_TYPE_VULKAN_DEVICE_CREATE_INFO_KHR
+      || create_info->pfnGetInstanceProcAddr == nullptr) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (create_info->systemId != kSystemId) {
+    return XR_ERROR_SYSTEM_INVALID;
+  }
+  const MockInstance *mock_instance = FromHandle<MockInstance>(instance);
+  if (mock_instance->vulkan_instance == VK_NULL_HANDLE) {
+    return XR_ERROR_GRAPHICS_DEVICE_INVALID;
+  }
+  auto create_device = reinterpret_cast<PFN_vkCreateDevice>(
+      create_info->pfnGetInstanceProcAddr(mock_instance->vulkan_instance, "vkCreateDevice"));
+  if (create_device == nullptr) {
+    return XR_ERROR_RUNTIME_FAILURE;
+  }
+  *vulkan_result = create_device(create_info->vulkanPhysicalDevice,
+                                 create_info->vulkanCreateInfo,
+                                 create_info->vulkanAllocator,
+                                 vulkan_device);
+  return XR_SUCCESS;
+}
+
+const std::array kGlobalFunctions{
+    MOCK_ENTRY_POINT(EnumerateInstanceExtensionProperties),
+    MOCK_ENTRY_POINT(CreateInstance),
+};
+
+const std::array kInstanceFunctions{
+    MOCK_ENTRY_POINT(DestroyInstance),
+    MOCK_ENTRY_POINT(GetInstanceProperties),
+    MOCK_ENTRY_POINT(PollEvent),
+    MOCK_ENTRY_POINT(StringToPath),
+    MOCK_ENTRY_POINT(PathToString),
+    MOCK_ENTRY_POINT(GetSystem),
+    MOCK_ENTRY_POINT(GetSystemProperties),
+    MOCK_ENTRY_POINT(EnumerateViewConfigurations),
+    MOCK_ENTRY_POINT(GetViewConfigurationProperties),
+    MOCK_ENTRY_POINT(EnumerateViewConfigurationViews),
+    MOCK_ENTRY_POINT(EnumerateEnvironmentBlendModes),
+};
+
+const std::array kVulkanEnable2Functions{
+    MOCK_ENTRY_POINT(GetVulkanGraphicsRequirements2KHR),
+    MOCK_ENTRY_POINT(CreateVulkanInstanceKHR),
+    MOCK_ENTRY_POINT(GetVulkanGraphicsDevice2KHR),
+    MOCK_ENTRY_POINT(CreateVulkanDeviceKHR),
+};
+
+XRAPI_ATTR XrResult XRAPI_CALL GetInstanceProcAddr(XrInstance instance,
+                                                   const char *name,
+                                                   PFN_xrVoidFunction *function) {
+  if (name == nullptr || function == nullptr) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  *function = mock_runtime::FindFunction(kGlobalFunctions, name);
+  if (*function != nullptr) {
+    return XR_SUCCESS;
+  }
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (std::strcmp(name, "xrGetInstanceProcAddr") == 0) {
+    *function = reinterpret_cast<PFN_xrVoidFunction>(&GetInstanceProcAddr);
+    return XR_SUCCESS;
+  }
+  const MockInstance &mock_instance = *FromHandle<MockInstance>(instance);
+  *function = mock_runtime::FindFunction(kInstanceFunctions, name);
+  if (*function == nullptr && mock_instance.vulkan_enable2_enabled) {
+    *function = mock_runtime::FindFunction(kVulkanEnable2Functions, name);
+  }
+  if (*function == nullptr) {
+    *function = mock_runtime::GetSessionFunction(mock_instance, name);
+  }
+  if (*function == nullptr) {
+    *function = mock_runtime::GetInputFunction(mock_instance, name);
+  }
+  return *function != nullptr ? XR_SUCCESS : XR_ERROR_FUNCTION_UNSUPPORTED;
+}
+}
+
+XrPath mock_runtime::InternPath(MockInstance *instance, const std::string &path) {
+  std::lock_guard<std::mutex> lock(instance->path_mutex);
+  auto it = instance->path_ids.find(path);
+  if (it != instance->path_ids.end()) {
+    return it->second;
+  }
+  instance->paths.push_back(path);
+  const auto kPath = static_cast<XrPath>(instance->paths.size());
+  instance->path_ids.emplace(path, kPath);
+  return kPath;
+}
+
+std::string mock_runtime::GetPathString(MockInstance *instance, XrPath path) {
+  std::lock_guard<std::mutex> lock(instance->path_mutex);
+  if (path == XR_NULL_PATH || path > instance->paths.size()) {
+    return {};
+  }
+  return instance->paths[path - 1];
+}
+
+PFN_xrVoidFunction mock_runtime::FindFunction(std::span<const NamedFunction> functions,
+                                              const char *name) {
+  const auto kIt = std::find_if(functions.begin(), functions.end(),
+                                [name](const NamedFunction &function) {
+                                  return std::strcmp(function.name, name) == 0;
+                                });
+  return kIt != functions.end() ? kIt->function : nullptr;
+}
+
+XrResult mock_runtime::EnumerateString(const std::string &value,
+                                       uint32_t capacity,
+                                       uint32_t *count_output,
+                                       char *buffer) {
+  return Enumerate(static_cast<uint32_t>(value.size() + 1), capacity, count_output,
+                   [&value, buffer](uint32_t i) {
+                     buffer[i] = i < value.size() ? value[i] : '\0';
+                   });
+}
+
+// Entry point the OpenXR loader looks up after loading the library named in the manifest.
+extern "C" __attribute__((visibility("default"))) XRAPI_ATTR XrResult XRAPI_CALL
+xrNegotiateLoaderRuntimeInterface(const XrNegotiateLoaderInfo *loader_info,
+                                  XrNegotiateRuntimeRequest *runtime_request) {
+  if (loader_info == nullptr || runtime_request == nullptr
+      || loader_info->structType != XR_LOADER_INTERFACE_STRUCT_LOADER_INFO
+      || loader_info->structVersion != XR_LOADER_INFO_STRUCT_VERSION
+      || loader_info->structSize != sizeof(XrNegotiateLoaderInfo)
+      || runtime_request->structType != XR_LOADER_INTERFACE_STRUCT_RUNTIME_REQUEST
+      || runtime_request->structVersion != XR_RUNTIME_INFO_STRUCT_VERSION
+      || runtime_request->structSize != sizeof(XrNegotiateRuntimeRequest)
+      || loader_info->minInterfaceVersion > XR_CURRENT_LOADER_RUNTIME_VERSION
+      || loader_info->maxInterfaceVersion < XR_CURRENT_LOADER_RUNTIME_VERSION
+      || XR_VERSION_MAJOR(loader_info->minApiVersion) > 1
+      || XR_VERSION_MAJOR(loader_info->maxApiVersion) < 1) {
+    return XR_ERROR_INITIALIZATION_FAILED;
+  }
+  runtime_request->runtimeInterfaceVersion = XR_CURRENT_LOADER_RUNTIME_VERSION;
+  runtime_request->runtimeApiVersion = XR_CURRENT_API_VERSION;
+  runtime_request->getInstanceProcAddr = &GetInstanceProcAddr;
+  return XR_SUCCESS;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "mock_frame_pacer.hpp"
+#include "mock_runtime_config.hpp"
+#include "mock_swapchain.hpp"
+#include "mock_trajectory.hpp"
+
+#include <vulkan/vulkan.h>
+#include <openxr/openxr.h>
+#include <openxr/openxr_platform.h>
+
+#include <array>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Objects behind the handles of the mock runtime. A handle is the address of its object,
+// handles are only checked against XR_NULL_HANDLE.
+namespace mock_runtime {
+struct MockActionSet;
+struct MockSession;
+
+struct MockInstance {
+  MockRuntimeConfig config{};
+  std::unique_ptr<MockTrajectory> trajectory;
+  bool vulkan_enable2_enabled = false;
+  bool locate_spaces_enabled = false;
+  bool visibility_mask_enabled = false;
+  bool graphics_requirements_queried = false;
+  PFN_vkGetInstanceProcAddr vulkan_get_instance_proc_addr = nullptr;
+  VkInstance vulkan_instance = VK_NULL_HANDLE;
+
+  std::mutex path_mutex;
+  // XrPath n names paths[n - 1]
+  std::vector<std::string> paths{};
+  std::unordered_map<std::string, XrPath> path_ids{};
+  XrPath left_hand_path = XR_NULL_PATH;
+  XrPath right_hand_path = XR_NULL_PATH;
+
+  std::mutex event_mutex;
+  std::deque<XrEventDataBuffer> events{};
+
+  // suggested bindings by interaction profile path
+  std::map<XrPath, std::vector<XrActionSuggestedBinding>> suggested_bindings{};
+  std::vector<std::unique_ptr<MockActionSet>> action_sets{};
+  std::unique_ptr<MockSession> session;
+};
+
+// Synced state of an action for the left hand, the right hand and without subaction path.
+struct MockActionState {
+  bool active = false;
+  float value = 0.0F;
+  bool changed = false;
+  XrTime last_change_time = 0;
+};
+
+constexpr size_t kLeftSubaction = 0;
+constexpr size_t kRightSubaction = 1;
+constexpr size_t kNoSubaction = 2;
+
+struct MockAction {
+  MockActionSet *action_set = nullptr;
+  XrActionType type = XR_ACTION_TYPE_BOOLEAN_INPUT;
+  std::string name{};
+  std::vector<XrPath> subaction_paths{};
+  // binding paths of the action in the interaction profile of the session it is attached to
+  std::vector<XrPath> bound_sources{};
+  std::array<MockActionState, 3> states{};
+};
+
+struct MockActionSet {
+  MockInstance *instance = nullptr;
+  std::string name{};
+  bool attached = false;
+  std::vector<std::unique_ptr<MockAction>> actions{};
+};
+
+struct MockSpace {
+  MockSession *session = nullptr;
+  // reference spaces have no action
+  MockAction *action = nullptr;
+  XrReferenceSpaceType reference_space_type = XR_REFERENCE_SPACE_TYPE_STAGE;
+  XrPath subaction_path = XR_NULL_PATH;
+  Pose pose_in_space{};
+};
+
+struct MockSession {
+  MockInstance *instance = nullptr;
+  MockVulkanDevice vulkan_device{};
+  // trajectories and the display start at the epoch
+  XrTime epoch = 0;
+  // pose of the local reference space in stage space
+  Pose local_origin{};
+  std::unique_ptr<MockFramePacer> frame_pacer;
+
+  std::mutex state_mutex;
+  XrSessionState state = XR_SESSION_STATE_UNKNOWN;
+  bool running = false;
+  bool exit_requested = false;
+
+  std::vector<MockActionSet *> attached_action_sets{};
+  XrPath interaction_profile = XR_NULL_PATH;
+  std::vector<std::unique_ptr<MockSpace>> spaces{};
+  std::vector<std::unique_ptr<MockSwapchain>> swapchains{};
+};
+
+template<typename T, typename Handle>
+T *FromHandle(Handle handle) {
+  return reinterpret_cast<T *>(handle);
+}
+
+template<typename Handle, typename T>
+Handle ToHandle(T *object) {
+  return reinterpret_cast<Handle>(object);
+}
+
+template<typename T>
+void PushEvent(MockInstance *instance, const T &event) {
+  static_assert(sizeof(T) <= sizeof(XrEventDataBuffer));
+  XrEventDataBuffer buffer{};
+  std::memcpy(&buffer, &event, sizeof(T));
+  std::lock_guard<std::mutex> lock(instance->event_mutex);
+  instance->events.push_back(buffer);
+}
+
+// Two call idiom of enumerating functions, write(i) fills element i of the output.
+template<typename Write>
+XrResult Enumerate(uint32_t count, uint32_t capacity, uint32_t *count_output, Write write) {
+  if (count_output == nullptr) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  *count_output = count;
+  if (capacity == 0) {
+    return XR_SUCCESS;
+  }
+  if (capacity < count) {
+    return XR_ERROR_SIZE_INSUFFICIENT;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    write(i);
+  }
+  return XR_SUCCESS;
+}
+
+XrPath InternPath(MockInstance *instance, const std::string &path);
+
+// Empty for paths that were never interned.
+std::string GetPathString(MockInstance *instance, XrPath path);
+
+// Same for strings, count includes the terminating null character.
+XrResult EnumerateString(const std::string &value,
+                         uint32_t capacity,
+                         uint32_t *count_output,
+                         char *buffer);
+
+struct NamedFunction {
+  const char *name;
+  PFN_xrVoidFunction function;
+};
+
+#define MOCK_ENTRY_POINT(name) NamedFunction{"xr" #name, reinterpret_cast<PFN_xrVoidFunction>(&name)}
+
+PFN_xrVoidFunction FindFunction(std::span<const NamedFunction> functions, const char *name);
+
+// Entry points of each part of the runtime by name, nullptr for unknown names and for
+// functions of extensions the instance did not enable.
+PFN_xrVoidFunction GetSessionFunction(const MockInstance &instance, const char *name);
+PFN_xrVoidFunction GetInputFunction(const MockInstance &instance, const char *name);
+
+// Subaction index of a path for MockAction::states.
+size_t GetSubactionIndex(const MockInstance &instance, XrPath subaction_path);
+
+// Pose of the space in stage space, false when it is not tracked at the time.
+bool LocateInStage(const MockSpace &space, XrTime time, Pose *pose);
+
+double GetSessionSeconds(const MockSession &session, XrTime time);
+}
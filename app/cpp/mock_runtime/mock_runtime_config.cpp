@@ -0,0 +1,69 @@
+#include "mock_runtime_config.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+const char *GetEnvironment(const char *name) {
+  const char *value = std::getenv(name);
+  return value != nullptr && value[0] != '\0' ? value : nullptr;
+}
+
+int64_t GetEnvironmentInt(const char *name, int64_t default_value) {
+  const char *value = GetEnvironment(name);
+  if (value == nullptr) {
+    return default_value;
+  }
+  try {
+    return std::stoll(value);
+  } catch (const std::exception &) {
+    spdlog::warn("mock runtime: ignoring {}={}, not a number", name, value);
+    return default_value;
+  }
+}
+
+std::string GetEnvironmentString(const char *name) {
+  const char *value = GetEnvironment(name);
+  return value != nullptr ? value : "";
+}
+}
+
+mock_runtime::MockRuntimeConfig mock_runtime::LoadMockRuntimeConfig() {
+  MockRuntimeConfig config{};
+  // microseconds in the environment, the defaults keep their nanosecond precision
+  if (GetEnvironment("QUEST_XR_MOCK_DISPLAY_PERIOD_US") != nullptr) {
+    config.display_period_ns = GetEnvironmentInt("QUEST_XR_MOCK_DISPLAY_PERIOD_US", 0) * 1000;
+  }
+  if (GetEnvironment("QUEST_XR_MOCK_JITTER_US") != nullptr) {
+    config.wake_jitter_ns = GetEnvironmentInt("QUEST_XR_MOCK_JITTER_US", 0) * 1000;
+  }
+  config.seed = static_cast<uint64_t>(GetEnvironmentInt("QUEST_XR_MOCK_SEED",
+                                                        static_cast<int64_t>(config.seed)));
+  config.view_width = static_cast<uint32_t>(GetEnvironmentInt("QUEST_XR_MOCK_VIEW_WIDTH",
+                                                              config.view_width));
+  config.view_height = static_cast<uint32_t>(GetEnvironmentInt("QUEST_XR_MOCK_VIEW_HEIGHT",
+                                                               config.view_height));
+  config.trajectory_path = GetEnvironmentString("QUEST_XR_MOCK_TRAJECTORY");
+  config.frame_log_path = GetEnvironmentString("QUEST_XR_MOCK_FRAME_LOG");
+  config.exit_after_frames = static_cast<uint64_t>(
+      GetEnvironmentInt("QUEST_XR_MOCK_EXIT_AFTER_FRAMES", 0));
+
+  if (config.display_period_ns <= 0) {
+    throw std::runtime_error("QUEST_XR_MOCK_DISPLAY_PERIOD_US must be positive");
+  }
+  if (config.wake_jitter_ns < 0 || config.wake_jitter_ns >= config.display_period_ns) {
+    throw std::runtime_error("QUEST_XR_MOCK_JITTER_US must be in [0, display period)");
+  }
+  if (config.view_width == 0 || config.view_height == 0) {
+    throw std::runtime_error("mock runtime view dimensions must not be 0");
+  }
+  spdlog::info("mock runtime: display period {}us, jitter {}us, seed {}, views {}x{}",
+               config.display_period_ns / 1000,
+               config.wake_jitter_ns / 1000,
+               config.seed,
+               config.view_width,
+               config.view_height);
+  return config;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace mock_runtime {
+// Settings of the mock runtime. The loader gives a runtime no way to receive arguments, so
+// they are read from QUEST_XR_MOCK_* environment variables when the instance is created.
+struct MockRuntimeConfig {
+  // QUEST_XR_MOCK_DISPLAY_PERIOD_US, 72 Hz by default
+  int64_t display_period_ns = 13'888'889;
+  // QUEST_XR_MOCK_JITTER_US, xrWaitFrame wakes up to this much after the vsync
+  int64_t wake_jitter_ns = 0;
+  // QUEST_XR_MOCK_SEED, seeds the jitter so runs are repeatable
+  uint64_t seed = 1;
+  // QUEST_XR_MOCK_VIEW_WIDTH and QUEST_XR_MOCK_VIEW_HEIGHT
+  uint32_t view_width = 1024;
+  uint32_t view_height = 1024;
+  // QUEST_XR_MOCK_TRAJECTORY, keyframe file, the built in trajectory is used when empty
+  std::string trajectory_path{};
+  // QUEST_XR_MOCK_FRAME_LOG, xrEndFrame timings are written there when the session is destroyed
+  std::string frame_log_path{};
+  // QUEST_XR_MOCK_EXIT_AFTER_FRAMES, the runtime requests to exit the session after this many
+  // ended frames, 0 never does
+  uint64_t exit_after_frames = 0;
+};
+
+MockRuntimeConfig LoadMockRuntimeConfig();
+}
@@ -0,0 +1,771 @@
+#include "mock_runtime.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <exception>
+
+namespace {
+using mock_runtime::FromHandle;
+using mock_runtime::MockInstance;
+using mock_runtime::MockSession;
+using mock_runtime::MockSpace;
+using mock_runtime::MockSwapchain;
+using mock_runtime::Pose;
+using mock_runtime::ToHandle;
+using mock_runtime::TrackedDevice;
+
+constexpr XrViewConfigurationType kViewConfigurationType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+constexpr uint32_t kViewCount = 2;
+constexpr float kInterpupillaryDistance = 0.064F;
+constexpr XrFovf kFov = {-0.785F, 0.785F, 0.785F, -0.785F};
+// the hidden area is a ring between the edge of the fov and an ellipse inside of it
+constexpr uint32_t kMaskSegments = 32;
+constexpr float kPi = 3.14159265F;
+constexpr XrSpaceLocationFlags kTrackedLocationFlags =
+    XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_VALID_BIT
+        | XR_SPACE_LOCATION_POSITION_TRACKED_BIT | XR_SPACE_LOCATION_ORIENTATION_TRACKED_BIT;
+
+constexpr int64_t kSwapchainFormats[] = {
+    VK_FORMAT_R8G8B8A8_SRGB,
+    VK_FORMAT_B8G8R8A8_SRGB,
+    VK_FORMAT_R8G8B8A8_UNORM,
+    VK_FORMAT_B8G8R8A8_UNORM,
+    VK_FORMAT_D32_SFLOAT,
+    VK_FORMAT_D24_UNORM_S8_UINT,
+    VK_FORMAT_D16_UNORM,
+};
+
+// Must be called with the state mutex of the session held.
+void SetSessionState(MockSession *session, XrSessionState state) {
+  session->state = state;
+  XrEventDataSessionStateChanged event{
+      .type = XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED,
+      .session = ToHandle<XrSession>(session),
+      .state = state,
+      .time = mock_runtime::GetCurrentTime(),
+  };
+  mock_runtime::PushEvent(session->instance, event);
+}
+
+// Must be called with the state mutex of the session held.
+void RequestExit(MockSession *session) {
+  session->exit_requested = true;
+  if (session->state == XR_SESSION_STATE_FOCUSED) {
+    SetSessionState(session, XR_SESSION_STATE_VISIBLE);
+  }
+  if (session->state == XR_SESSION_STATE_VISIBLE) {
+    SetSessionState(session, XR_SESSION_STATE_SYNCHRONIZED);
+  }
+  SetSessionState(session, XR_SESSION_STATE_STOPPING);
+}
+
+bool IsPoseValid(const XrPosef &pose) {
+  const XrQuaternionf &q = pose.orientation;
+  return std::abs(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w - 1.0F) < 0.01F;
+}
+
+template<typename T>
+void EraseObject(std::vector<std::unique_ptr<T>> &objects, const T *object) {
+  objects.erase(std::remove_if(objects.begin(), objects.end(),
+                               [object](const std::unique_ptr<T> &owned) {
+                                 return owned.get() == object;
+                               }),
+                objects.end());
+}
+
+// Vertex of the hidden area ring on the z = -1 plane, even vertices lie on the ellipse and odd
+// ones on the edge of the fov.
+XrVector2f GetMaskVertex(uint32_t index) {
+  const float kLeft = std::tan(kFov.angleLeft);
+  const float kRight = std::tan(kFov.angleRight);
+  const float kUp = std::tan(kFov.angleUp);
+  const float kDown = std::tan(kFov.angleDown);
+  const float kAngle = 2.0F * kPi * static_cast<float>(index / 2) / kMaskSegments;
+  const float kCos = std::cos(kAngle);
+  const float kSin = std::sin(kAngle);
+  const float kEdgeScale = 1.0F / std::max(std::abs(kCos), std::abs(kSin));
+  // the inner polygon encloses the ellipse, so nothing inside of it is hidden
+  const float kScale = index % 2 == 1
+      ? kEdgeScale
+      : std::min(kEdgeScale, 1.0F / std::cos(kPi / kMaskSegments));
+  return {
+      0.5F * (kLeft + kRight) + 0.5F * (kRight - kLeft) * kCos * kScale,
+      0.5F * (kDown + kUp) + 0.5F * (kUp - kDown) * kSin * kScale,
+  };
+}
+
+// Two triangles per ring segment, counter clockwise.
+uint32_t GetMaskIndex(uint32_t index) {
+  constexpr uint32_t kSegmentIndices[] = {0, 1, 3, 0, 3, 2};
+  const uint32_t kSegment = index / 6;
+  const uint32_t kCorner = kSegmentIndices[index % 6];
+  const uint32_t kRingIndex = kCorner < 2 ? kSegment : (kSegment + 1) % kMaskSegments;
+  return 2 * kRingIndex + kCorner % 2;
+}
+
+// Location of space in base_space, false when either of them is not tracked.
+bool Locate(const MockSpace &space, const MockSpace &base_space, XrTime time, Pose *pose) {
+  Pose space_in_stage{};
+  Pose base_in_stage{};
+  if (!mock_runtime::LocateInStage(space, time, &space_in_stage)
+      || !mock_runtime::LocateInStage(base_space, time, &base_in_stage)) {
+    return false;
+  }
+  *pose = mock_runtime::Compose(mock_runtime::Invert(base_in_stage), space_in_stage);
+  return true;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL CreateSession(XrInstance instance,
+                                             const XrSessionCreateInfo *create_info,
+                                             XrSession *session) {
+  if (instance == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (create_info == nullptr || session == nullptr
+      || create_info->type != XR_TYPE_SESSION_CREATE_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  MockInstance *mock_instance = FromHandle<MockInstance>(instance);
+  if (!mock_instance->graphics_requirements_queried) {
+    return XR_ERROR_GRAPHICS_REQUIREMENTS_CALL_MISSING;
+  }
+  if (mock_instance->session != nullptr) {
+    return XR_ERROR_LIMIT_REACHED;
+  }
+
+  const XrGraphicsBindingVulkan2KHR *binding = nullptr;
+  for (auto next = static_cast<const XrBaseInStructure *>(create_info->next);
+       next != nullptr;
+       next = next->next) {
+    if (next->type == XR_TYPE_GRAPHICS_BINDING_VULKAN2_KHR) {
+      binding = reinterpret_cast<const XrGraphicsBindingVulkan2KHR *>(next);
+    }
+  }
+  if (binding == nullptr) {
+    return XR_ERROR_GRAPHICS_DEVICE_INVALID;
+  }
+
+  try {
+    auto mock_session = std::make_unique<MockSession>();
+    mock_session->instance = mock_instance;
+    if (mock_instance->vulkan_get_instance_proc_addr == nullptr
+        || !mock_runtime::LoadMockVulkanDevice(mock_instance->vulkan_get_instance_proc_addr,
+                                               binding->instance,
+                                               binding->physicalDevice,
+                                               binding->device,
+                                               &mock_session->vulkan_device)) {
+      return XR_ERROR_GRAPHICS_DEVICE_INVALID;
+    }
+    mock_session->epoch = mock_runtime::GetCurrentTime();
+    // the local space starts under the head, facing the way the head does
+    const Pose kHead = mock_instance->trajectory->GetPose(TrackedDevice::HEAD, 0.0);
+    const glm::vec3 kForward = kHead.orientation * glm::vec3(0.0F, 0.0F, -1.0F);
+    mock_session->local_origin.orientation =
+        glm::angleAxis(std::atan2(-kForward.x, -kForward.z), glm::vec3(0.0F, 1.0F, 0.0F));
+    mock_session->local_origin.position = kHead.position;
+
+    const mock_runtime::MockRuntimeConfig &config = mock_instance->config;
+    mock_session->frame_pacer = std::make_unique<mock_runtime::MockFramePacer>(
+        mock_session->epoch,
+        config.display_period_ns,
+        config.wake_jitter_ns,
+        config.seed);
+
+    std::lock_guard<std::mutex> lock(mock_session->state_mutex);
+    SetSessionState(mock_session.get(), XR_SESSION_STATE_IDLE);
+    SetSessionState(mock_session.get(), XR_SESSION_STATE_READY);
+    *session = ToHandle<XrSession>(mock_session.get());
+    mock_instance->session = std::move(mock_session);
+    return XR_SUCCESS;
+  } catch (const std::exception &ex) {
+    spdlog::error("mock runtime: failed to create the session, {}", ex.what());
+    return XR_ERROR_RUNTIME_FAILURE;
+  }
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL DestroySession(XrSession session) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  mock_session->frame_pacer->LogSummary();
+  const std::string &frame_log_path = mock_session->instance->config.frame_log_path;
+  if (!frame_log_path.empty()) {
+    try {
+      mock_session->frame_pacer->WriteCsv(frame_log_path);
+    } catch (const std::exception &ex) {
+      spdlog::error("mock runtime: {}", ex.what());
+    }
+  }
+  mock_session->instance->session.reset();
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL BeginSession(XrSession session,
+                                            const XrSessionBeginInfo *begin_info) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (begin_info == nullptr || begin_info->type != XR_TYPE_SESSION_BEGIN_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (begin_info->primaryViewConfigurationType != kViewConfigurationType) {
+    return XR_ERROR_VIEW_CONFIGURATION_TYPE_UNSUPPORTED;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  std::lock_guard<std::mutex> lock(mock_session->state_mutex);
+  if (mock_session->running) {
+    return XR_ERROR_SESSION_RUNNING;
+  }
+  if (mock_session->state != XR_SESSION_STATE_READY) {
+    return XR_ERROR_SESSION_NOT_READY;
+  }
+  mock_session->running = true;
+  SetSessionState(mock_session, XR_SESSION_STATE_SYNCHRONIZED);
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL EndSession(XrSession session) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  std::lock_guard<std::mutex> lock(mock_session->state_mutex);
+  if (!mock_session->running) {
+    return XR_ERROR_SESSION_NOT_RUNNING;
+  }
+  if (mock_session->state != XR_SESSION_STATE_STOPPING) {
+    return XR_ERROR_SESSION_NOT_STOPPING;
+  }
+  mock_session->running = false;
+  SetSessionState(mock_session, XR_SESSION_STATE_IDLE);
+  SetSessionState(mock_session, mock_session->exit_requested ? XR_SESSION_STATE_EXITING
+                                                             : XR_SESSION_STATE_READY);
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL RequestExitSession(XrSession session) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  std::lock_guard<std::mutex> lock(mock_session->state_mutex);
+  if (!mock_session->running) {
+    return XR_ERROR_SESSION_NOT_RUNNING;
+  }
+  if (!mock_session->exit_requested) {
+    RequestExit(mock_session);
+  }
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL WaitFrame(XrSession session,
+                                         const XrFrameWaitInfo *wait_info,
+                                         XrFrameState *frame_state) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (frame_state == nullptr || frame_state->type != XR_TYPE_FRAME_STATE
+      || (wait_info != nullptr && wait_info->type != XR_TYPE_FRAME_WAIT_INFO)) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  {
+    std::lock_guard<std::mutex> lock(mock_session->state_mutex);
+    if (!mock_session->running) {
+      return XR_ERROR_SESSION_NOT_RUNNING;
+    }
+  }
+  mock_session->frame_pacer->WaitFrame(&frame_state->predictedDisplayTime,
+                                       &frame_state->predictedDisplayPeriod);
+  std::lock_guard<std::mutex> lock(mock_session->state_mutex);
+  frame_state->shouldRender = mock_session->state == XR_SESSION_STATE_VISIBLE
+      || mock_session->state == XR_SESSION_STATE_FOCUSED;
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL BeginFrame(XrSession session,
+                                          const XrFrameBeginInfo *begin_info) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (begin_info != nullptr && begin_info->type != XR_TYPE_FRAME_BEGIN_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  {
+    std::lock_guard<std::mutex> lock(mock_session->state_mutex);
+    if (!mock_session->running) {
+      return XR_ERROR_SESSION_NOT_RUNNING;
+    }
+  }
+  return mock_session->frame_pacer->BeginFrame();
+}
+
+XrResult ValidateLayer(const XrCompositionLayerBaseHeader *layer) {
+  if (layer == nullptr) {
+    return XR_ERROR_LAYER_INVALID;
+  }
+  if (layer->space == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (layer->type != XR_TYPE_COMPOSITION_LAYER_PROJECTION) {
+    return XR_SUCCESS;
+  }
+  const auto *projection = reinterpret_cast<const XrCompositionLayerProjection *>(layer);
+  if (projection->viewCount != kViewCount || projection->views == nullptr) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  for (uint32_t i = 0; i < projection->viewCount; i++) {
+    const XrSwapchainSubImage &sub_image = projection->views[i].subImage;
+    if (sub_image.swapchain == XR_NULL_HANDLE) {
+      return XR_ERROR_HANDLE_INVALID;
+    }
+    if (!FromHandle<MockSwapchain>(sub_image.swapchain)->HasReleasedImage()) {
+      return XR_ERROR_LAYER_INVALID;
+    }
+  }
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL EndFrame(XrSession session, const XrFrameEndInfo *end_info) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (end_info == nullptr || end_info->type != XR_TYPE_FRAME_END_INFO
+      || (end_info->layerCount > 0 && end_info->layers == nullptr)) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (end_info->environmentBlendMode != XR_ENVIRONMENT_BLEND_MODE_OPAQUE) {
+    return XR_ERROR_ENVIRONMENT_BLEND_MODE_UNSUPPORTED;
+  }
+  if (end_info->layerCount > XR_MIN_COMPOSITION_LAYERS_SUPPORTED) {
+    return XR_ERROR_LAYER_LIMIT_EXCEEDED;
+  }
+  for (uint32_t i = 0; i < end_info->layerCount; i++) {
+    const XrResult kResult = ValidateLayer(end_info->layers[i]);
+    if (XR_FAILED(kResult)) {
+      return kResult;
+    }
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  const XrResult kResult = mock_session->frame_pacer->EndFrame(end_info->displayTime,
+                                                               end_info->layerCount);
+  if (XR_FAILED(kResult)) {
+    return kResult;
+  }
+
+  std::lock_guard<std::mutex> lock(mock_session->state_mutex);
+  // the display shows the application once it submits frames
+  if (mock_session->state == XR_SESSION_STATE_SYNCHRONIZED && !mock_session->exit_requested) {
+    SetSessionState(mock_session, XR_SESSION_STATE_VISIBLE);
+    SetSessionState(mock_session, XR_SESSION_STATE_FOCUSED);
+  }
+  const uint64_t kExitAfterFrames = mock_session->instance->config.exit_after_frames;
+  if (kExitAfterFrames != 0 && !mock_session->exit_requested
+      && mock_session->frame_pacer->GetEndedFrameCount() >= kExitAfterFrames) {
+    RequestExit(mock_session);
+  }
+  return kResult;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL EnumerateReferenceSpaces(XrSession session,
+                                                        uint32_t capacity,
+                                                        uint32_t *count_output,
+                                                        XrReferenceSpaceType *spaces) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  constexpr XrReferenceSpaceType kSpaces[] = {
+      XR_REFERENCE_SPACE_TYPE_VIEW,
+      XR_REFERENCE_SPACE_TYPE_LOCAL,
+      XR_REFERENCE_SPACE_TYPE_STAGE,
+  };
+  return mock_runtime::Enumerate(std::size(kSpaces), capacity, count_output, [spaces](uint32_t i) {
+    spaces[i] = kSpaces[i];
+  });
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL CreateReferenceSpace(XrSession session,
+                                                    const XrReferenceSpaceCreateInfo *create_info,
+                                                    XrSpace *space) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (create_info == nullptr || space == nullptr
+      || create_info->type != XR_TYPE_REFERENCE_SPACE_CREATE_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (create_info->referenceSpaceType != XR_REFERENCE_SPACE_TYPE_VIEW
+      && create_info->referenceSpaceType != XR_REFERENCE_SPACE_TYPE_LOCAL
+      && create_info->referenceSpaceType != XR_REFERENCE_SPACE_TYPE_STAGE) {
+    return XR_ERROR_REFERENCE_SPACE_UNSUPPORTED;
+  }
+  if (!IsPoseValid(create_info->poseInReferenceSpace)) {
+    return XR_ERROR_POSE_INVALID;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  auto mock_space = std::make_unique<MockSpace>();
+  mock_space->session = mock_session;
+  mock_space->reference_space_type = create_info->referenceSpaceType;
+  mock_space->pose_in_space = mock_runtime::FromXrPose(create_info->poseInReferenceSpace);
+  *space = ToHandle<XrSpace>(mock_space.get());
+  mock_session->spaces.push_back(std::move(mock_space));
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL CreateActionSpace(XrSession session,
+                                                 const XrActionSpaceCreateInfo *create_info,
+                                                 XrSpace *space) {
+  if (session == XR_NULL_HANDLE || create_info == nullptr || create_info->action == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (space == nullptr || create_info->type != XR_TYPE_ACTION_SPACE_CREATE_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  auto *action = FromHandle<mock_runtime::MockAction>(create_info->action);
+  if (action->type != XR_ACTION_TYPE_POSE_INPUT) {
+    return XR_ERROR_ACTION_TYPE_MISMATCH;
+  }
+  if (create_info->subactionPath != XR_NULL_PATH
+      && std::find(action->subaction_paths.begin(),
+                   action->subaction_paths.end(),
+                   create_info->subactionPath) == action->subaction_paths.end()) {
+    return XR_ERROR_PATH_UNSUPPORTED;
+  }
+  if (!IsPoseValid(create_info->poseInActionSpace)) {
+    return XR_ERROR_POSE_INVALID;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  auto mock_space = std::make_unique<MockSpace>();
+  mock_space->session = mock_session;
+  mock_space->action = action;
+  mock_space->subaction_path = create_info->subactionPath;
+  mock_space->pose_in_space = mock_runtime::FromXrPose(create_info->poseInActionSpace);
+  *space = ToHandle<XrSpace>(mock_space.get());
+  mock_session->spaces.push_back(std::move(mock_space));
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL DestroySpace(XrSpace space) {
+  if (space == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  MockSpace *mock_space = FromHandle<MockSpace>(space);
+  EraseObject(mock_space->session->spaces, mock_space);
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL LocateSpace(XrSpace space,
+                                           XrSpace base_space,
+                                           XrTime time,
+                                           XrSpaceLocation *location) {
+  if (space == XR_NULL_HANDLE || base_space == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (location == nullptr || location->type != XR_TYPE_SPACE_LOCATION) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (time <= 0) {
+    return XR_ERROR_TIME_INVALID;
+  }
+  Pose pose{};
+  if (Locate(*FromHandle<MockSpace>(space), *FromHandle<MockSpace>(base_space), time, &pose)) {
+    location->locationFlags = kTrackedLocationFlags;
+    location->pose = mock_runtime::ToXrPose(pose);
+  } else {
+    location->locationFlags = 0;
+  }
+  return XR_SUCCESS;
+}
+
+#ifdef XR_KHR_locate_spaces
+XRAPI_ATTR XrResult XRAPI_CALL LocateSpacesKHR(XrSession session,
+                                               const XrSpacesLocateInfoKHR *locate_info,
+                                               XrSpaceLocationsKHR *locations) {
+  if (session == XR_NULL_HANDLE || locate_info == nullptr
+      || locate_info->baseSpace == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (locations == nullptr || locate_info->type != XR_TYPE_SPACES_LOCATE_INFO_KHR
+      || locations->type != XR_TYPE_SPACE_LOCATIONS_KHR
+      || locate_info->spaceCount != locations->locationCount) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (locate_info->time <= 0) {
+    return XR_ERROR_TIME_INVALID;
+  }
+  const MockSpace &base_space = *FromHandle<MockSpace>(locate_info->baseSpace);
+  for (uint32_t i = 0; i < locate_info->spaceCount; i++) {
+    if (locate_info->spaces[i] == XR_NULL_HANDLE) {
+      return XR_ERROR_HANDLE_INVALID;
+    }
+    Pose pose{};
+    XrSpaceLocationDataKHR &location = locations->locations[i];
+    if (Locate(*FromHandle<MockSpace>(locate_info->spaces[i]),
+               base_space,
+               locate_info->time,
+               &pose)) {
+      location.locationFlags = kTrackedLocationFlags;
+      location.pose = mock_runtime::ToXrPose(pose);
+    } else {
+      location.locationFlags = 0;
+    }
+  }
+  return XR_SUCCESS;
+}
+#endif
+
+XRAPI_ATTR XrResult XRAPI_CALL LocateViews(XrSession session,
+                                           const XrViewLocateInfo *locate_info,
+                                           XrViewState *view_state,
+                                           uint32_t capacity,
+                                           uint32_t *count_output,
+                                           XrView *views) {
+  if (session == XR_NULL_HANDLE || locate_info == nullptr || locate_info->space == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (view_state == nullptr || locate_info->type != XR_TYPE_VIEW_LOCATE_INFO
+      || view_state->type != XR_TYPE_VIEW_STATE) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (locate_info->viewConfigurationType != kViewConfigurationType) {
+    return XR_ERROR_VIEW_CONFIGURATION_TYPE_UNSUPPORTED;
+  }
+  if (locate_info->displayTime <= 0) {
+    return XR_ERROR_TIME_INVALID;
+  }
+  const MockSession &mock_session = *FromHandle<MockSession>(session);
+  const mock_runtime::MockTrajectory &trajectory = *mock_session.instance->trajectory;
+  Pose base_in_stage{};
+  const bool kTracked = trajectory.IsTracked(TrackedDevice::HEAD)
+      && mock_runtime::LocateInStage(*FromHandle<MockSpace>(locate_info->space),
+                                     locate_info->displayTime,
+                                     &base_in_stage);
+  view_state->viewStateFlags = kTracked ? kTrackedLocationFlags : 0;
+  const Pose kHeadInBase = mock_runtime::Compose(
+      mock_runtime::Invert(base_in_stage),
+      trajectory.GetPose(TrackedDevice::HEAD,
+                         mock_runtime::GetSessionSeconds(mock_session, locate_info->displayTime)));
+  return mock_runtime::Enumerate(kViewCount, capacity, count_output, [&](uint32_t i) {
+    Pose eye{};
+    eye.position.x = (i == 0 ? -0.5F : 0.5F) * kInterpupillaryDistance;
+    views[i].pose = kTracked ? mock_runtime::ToXrPose(mock_runtime::Compose(kHeadInBase, eye))
+                             : mock_runtime::ToXrPose(Pose{});
+    views[i].fov = kFov;
+  });
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL GetVisibilityMaskKHR(XrSession session,
+                                                    XrViewConfigurationType view_configuration_type,
+                                                    uint32_t view_index,
+                                                    XrVisibilityMaskTypeKHR visibility_mask_type,
+                                                    XrVisibilityMaskKHR *visibility_mask) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (visibility_mask == nullptr || visibility_mask->type != XR_TYPE_VISIBILITY_MASK_KHR
+      || view_index >= kViewCount) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (view_configuration_type != kViewConfigurationType) {
+    return XR_ERROR_VIEW_CONFIGURATION_TYPE_UNSUPPORTED;
+  }
+  // both eyes share the same fov, only the hidden triangle mesh is provided
+  const bool kHiddenMesh =
+      visibility_mask_type == XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR;
+  XrVisibilityMaskKHR &mask = *visibility_mask;
+  const XrResult kResult = mock_runtime::Enumerate(kHiddenMesh ? 2 * kMaskSegments : 0,
+                                                   mask.vertexCapacityInput,
+                                                   &mask.vertexCountOutput,
+                                                   [&mask](uint32_t i) {
+                                                     mask.vertices[i] = GetMaskVertex(i);
+                                                   });
+  if (XR_FAILED(kResult)) {
+    return kResult;
+  }
+  return mock_runtime::Enumerate(kHiddenMesh ? 6 * kMaskSegments : 0,
+                                 mask.indexCapacityInput,
+                                 &mask.indexCountOutput,
+                                 [&mask](uint32_t i) {
+                                   mask.indices[i] = GetMaskIndex(i);
+                                 });
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL EnumerateSwapchainFormats(XrSession session,
+                                                         uint32_t capacity,
+                                                         uint32_t *count_output,
+                                                         int64_t *formats) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  return mock_runtime::Enumerate(std::size(kSwapchainFormats), capacity, count_output,
+                                 [formats](uint32_t i) {
+                                   formats[i] = kSwapchainFormats[i];
+                                 });
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL CreateSwapchain(XrSession session,
+                                               const XrSwapchainCreateInfo *create_info,
+                                               XrSwapchain *swapchain) {
+  if (session == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (create_info == nullptr || swapchain == nullptr
+      || create_info->type != XR_TYPE_SWAPCHAIN_CREATE_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  if (std::find(std::begin(kSwapchainFormats), std::end(kSwapchainFormats), create_info->format)
+      == std::end(kSwapchainFormats)) {
+    return XR_ERROR_SWAPCHAIN_FORMAT_UNSUPPORTED;
+  }
+  if (create_info->width == 0 || create_info->height == 0 || create_info->arraySize == 0
+      || create_info->mipCount == 0 || create_info->sampleCount == 0
+      || (create_info->faceCount != 1 && create_info->faceCount != 6)) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  MockSession *mock_session = FromHandle<MockSession>(session);
+  try {
+    auto mock_swapchain = std::make_unique<MockSwapchain>(mock_session,
+                                                          mock_session->vulkan_device,
+                                                          *create_info);
+    *swapchain = ToHandle<XrSwapchain>(mock_swapchain.get());
+    mock_session->swapchains.push_back(std::move(mock_swapchain));
+    return XR_SUCCESS;
+  } catch (const std::exception &ex) {
+    spdlog::error("mock runtime: failed to create a swapchain, {}", ex.what());
+    return XR_ERROR_RUNTIME_FAILURE;
+  }
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL DestroySwapchain(XrSwapchain swapchain) {
+  if (swapchain == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  MockSwapchain *mock_swapchain = FromHandle<MockSwapchain>(swapchain);
+  EraseObject(mock_swapchain->GetSession()->swapchains, mock_swapchain);
+  return XR_SUCCESS;
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL EnumerateSwapchainImages(XrSwapchain swapchain,
+                                                        uint32_t capacity,
+                                                        uint32_t *count_output,
+                                                        XrSwapchainImageBaseHeader *images) {
+  if (swapchain == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  const auto &vulkan_images = FromHandle<MockSwapchain>(swapchain)->GetImages();
+  auto *vulkan_swapchain_images = reinterpret_cast<XrSwapchainImageVulkan2KHR *>(images);
+  if (capacity > 0 && (images == nullptr
+      || vulkan_swapchain_images[0].type != XR_TYPE_SWAPCHAIN_IMAGE_VULKAN2_KHR)) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  return mock_runtime::Enumerate(static_cast<uint32_t>(vulkan_images.size()),
+                                 capacity,
+                                 count_output,
+                                 [&](uint32_t i) {
+                                   vulkan_swapchain_images[i].image = vulkan_images[i];
+                                 });
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL AcquireSwapchainImage(XrSwapchain swapchain,
+                                                     const XrSwapchainImageAcquireInfo *,
+                                                     uint32_t *index) {
+  if (swapchain == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (index == nullptr) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  return FromHandle<MockSwapchain>(swapchain)->Acquire(index);
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL WaitSwapchainImage(XrSwapchain swapchain,
+                                                  const XrSwapchainImageWaitInfo *wait_info) {
+  if (swapchain == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  if (wait_info == nullptr || wait_info->type != XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO) {
+    return XR_ERROR_VALIDATION_FAILURE;
+  }
+  // images are never read, so they are available right away
+  return FromHandle<MockSwapchain>(swapchain)->Wait();
+}
+
+XRAPI_ATTR XrResult XRAPI_CALL ReleaseSwapchainImage(XrSwapchain swapchain,
+                                                     const XrSwapchainImageReleaseInfo *) {
+  if (swapchain == XR_NULL_HANDLE) {
+    return XR_ERROR_HANDLE_INVALID;
+  }
+  return FromHandle<MockSwapchain>(swapchain)->Release();
+}
+
+const std::array kSessionFunctions{
+    MOCK_ENTRY_POINT(CreateSession),
+    MOCK_ENTRY_POINT(DestroySession),
+    MOCK_ENTRY_POINT(BeginSession),
+    MOCK_ENTRY_POINT(EndSession),
+    MOCK_ENTRY_POINT(RequestExitSession),
+    MOCK_ENTRY_POINT(WaitFrame),
+    MOCK_ENTRY_POINT(BeginFrame),
+    MOCK_ENTRY_POINT(EndFrame),
+    MOCK_ENTRY_POINT(EnumerateReferenceSpaces),
+    MOCK_ENTRY_POINT(CreateReferenceSpace),
+    MOCK_ENTRY_POINT(CreateActionSpace),
+    MOCK_ENTRY_POINT(DestroySpace),
+    MOCK_ENTRY_POINT(LocateSpace),
+    MOCK_ENTRY_POINT(LocateViews),
+    MOCK_ENTRY_POINT(EnumerateSwapchainFormats),
+    MOCK_ENTRY_POINT(CreateSwapchain),
+    MOCK_ENTRY_POINT(DestroySwapchain),
+    MOCK_ENTRY_POINT(EnumerateSwapchainImages),
+    MOCK_ENTRY_POINT(AcquireSwapchainImage),
+    MOCK_ENTRY_POINT(WaitSwapchainImage),
+    MOCK_ENTRY_POINT(ReleaseSwapchainImage),
+};
+}
+
+PFN_xrVoidFunction mock_runtime::GetSessionFunction(const MockInstance &instance,
+                                                    const char *name) {
+  if (instance.visibility_mask_enabled && std::strcmp(name, "xrGetVisibilityMaskKHR") == 0) {
+    return reinterpret_cast<PFN_xrVoidFunction>(&GetVisibilityMaskKHR);
+  }
+#ifdef XR_KHR_locate_spaces
+  if (instance.locate_spaces_enabled && std::strcmp(name, "xrLocateSpacesKHR") == 0) {
+    return reinterpret_cast<PFN_xrVoidFunction>(&LocateSpacesKHR);
+  }
+#endif
+  return FindFunction(kSessionFunctions, name);
+}
+
+double mock_runtime::GetSessionSeconds(const MockSession &session, XrTime time) {
+  return static_cast<double>(time - session.epoch) / 1e9;
+}
+
+bool mock_runtime::LocateInStage(const MockSpace &space, XrTime time, Pose *pose) {
+  const MockSession &session = *space.session;
+  const MockTrajectory &trajectory = *session.instance->trajectory;
+  const double kSeconds = GetSessionSeconds(session, time);
+  Pose base{};
+  if (space.action != nullptr) {
+    const size_t kSubaction = GetSubactionIndex(*session.instance, space.subaction_path);
+    const TrackedDevice kHand = kSubaction == kRightSubaction ? TrackedDevice::RIGHT_HAND
+                                                              : TrackedDevice::LEFT_HAND;
+    if (!space.action->states[kSubaction].active || !trajectory.IsTracked(kHand)) {
+      return false;
+    }
+    base = trajectory.GetPose(kHand, kSeconds);
+  } else if (space.reference_space_type == XR_REFERENCE_SPACE_TYPE_VIEW) {
+    if (!trajectory.IsTracked(TrackedDevice::HEAD)) {
+      return false;
+    }
+    base = trajectory.GetPose(TrackedDevice::HEAD, kSeconds);
+  } else if (space.reference_space_type == XR_REFERENCE_SPACE_TYPE_LOCAL) {
+    base = session.local_origin;
+  }
+  *pose = Compose(base, space.pose_in_space);
+  return true;
+}
@@ -0,0 +1,207 @@
+#include "mock_swapchain.hpp"
+
+#include <spdlog/fmt/fmt.h>
+
+#include <stdexcept>
+
+namespace {
+VkImageUsageFlags ToVulkanUsage(XrSwapchainUsageFlags usage_flags) {
+  VkImageUsageFlags usage = 0;
+  if ((usage_flags & XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT) != 0) {
+    usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  }
+  if ((usage_flags & XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0) {
+    usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  }
+  if ((usage_flags & XR_SWAPCHAIN_USAGE_UNORDERED_ACCESS_BIT) != 0) {
+    usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+  }
+  if ((usage_flags & XR_SWAPCHAIN_USAGE_TRANSFER_SRC_BIT) != 0) {
+    usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
+  if ((usage_flags & XR_SWAPCHAIN_USAGE_TRANSFER_DST_BIT) != 0) {
+    usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  }
+  if ((usage_flags & XR_SWAPCHAIN_USAGE_SAMPLED_BIT) != 0) {
+    usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+  }
+  if ((usage_flags & XR_SWAPCHAIN_USAGE_INPUT_ATTACHMENT_BIT_KHR) != 0) {
+    usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+  }
+  return usage;
+}
+
+template<typename T>
+bool LoadFunction(PFN_vkVoidFunction function, T *target) {
+  *target = reinterpret_cast<T>(function);
+  return *target != nullptr;
+}
+}
+
+bool mock_runtime::LoadMockVulkanDevice(PFN_vkGetInstanceProcAddr get_instance_proc_addr,
+                                        VkInstance instance,
+                                        VkPhysicalDevice physical_device,
+                                        VkDevice device,
+                                        MockVulkanDevice *vulkan_device) {
+  vulkan_device->physical_device = physical_device;
+  vulkan_device->device = device;
+  PFN_vkGetDeviceProcAddr get_device_proc_addr = nullptr;
+  if (!LoadFunction(get_instance_proc_addr(instance, "vkGetDeviceProcAddr"),
+                    &get_device_proc_addr)) {
+    return false;
+  }
+  return LoadFunction(get_instance_proc_addr(instance, "vkGetPhysicalDeviceMemoryProperties"),
+                      &vulkan_device->get_physical_device_memory_properties)
+      && LoadFunction(get_device_proc_addr(device, "vkCreateImage"),
+                      &vulkan_device->create_image)
+      && LoadFunction(get_device_proc_addr(device, "vkDestroyImage"),
+                      &vulkan_device->destroy_image)
+      && LoadFunction(get_device_proc_addr(device, "vkGetImageMemoryRequirements"),
+                      &vulkan_device->get_image_memory_requirements)
+      && LoadFunction(get_device_proc_addr(device, "vkAllocateMemory"),
+                      &vulkan_device->allocate_memory)
+      && LoadFunction(get_device_proc_addr(device, "vkFreeMemory"),
+                      &vulkan_device->free_memory)
+      && LoadFunction(get_device_proc_addr(device, "vkBindImageMemory"),
+                      &vulkan_device->bind_image_memory);
+}
+
+mock_runtime::MockSwapchain::MockSwapchain(MockSession *session,
+                                           const MockVulkanDevice &vulkan_device,
+                                           const XrSwapchainCreateInfo &create_info)
+    : session_(session), vulkan_device_(vulkan_device) {
+  VkImageCreateInfo image_info{
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = static_cast<VkFormat>(create_info.format),
+      .extent = {create_info.width, create_info.height, 1},
+      .mipLevels = create_info.mipCount,
+      .arrayLayers = create_info.arraySize * create_info.faceCount,
+      .samples = static_cast<VkSampleCountFlagBits>(create_info.sampleCount),
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = ToVulkanUsage(create_info.usageFlags),
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  if ((create_info.usageFlags & XR_SWAPCHAIN_USAGE_MUTABLE_FORMAT_BIT) != 0) {
+    image_info.flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+  }
+  if (create_info.faceCount == 6) {
+    image_info.flags |= VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+  }
+
+  VkPhysicalDeviceMemoryProperties memory_properties{};
+  vulkan_device_.get_physical_device_memory_properties(vulkan_device_.physical_device,
+                                                       &memory_properties);
+  try {
+    for (uint32_t i = 0; i < kImageCount; i++) {
+      VkImage image = VK_NULL_HANDLE;
+      VkResult result = vulkan_device_.create_image(vulkan_device_.device,
+                                                    &image_info,
+                                                    nullptr,
+                                                    &image);
+      if (result != VK_SUCCESS) {
+        throw std::runtime_error(fmt::format("vkCreateImage failed with {}",
+                                             static_cast<int>(result)));
+      }
+      images_.push_back(image);
+
+      VkMemoryRequirements requirements{};
+      vulkan_device_.get_image_memory_requirements(vulkan_device_.device, image, &requirements);
+      uint32_t memory_type_index = UINT32_MAX;
+      for (uint32_t type = 0; type < memory_properties.memoryTypeCount; type++) {
+        if ((requirements.memoryTypeBits & (1u << type)) == 0) {
+          continue;
+        }
+        const bool kDeviceLocal = (memory_properties.memoryTypes[type].propertyFlags
+            & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
+        if (memory_type_index == UINT32_MAX || kDeviceLocal) {
+          memory_type_index = type;
+        }
+        if (kDeviceLocal) {
+          break;
+        }
+      }
+      if (memory_type_index == UINT32_MAX) {
+        throw std::runtime_error("no memory type for swapchain image");
+      }
+
+      VkMemoryAllocateInfo allocate_info{
+          .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+          .allocationSize = requirements.size,
+          .memoryTypeIndex = memory_type_index,
+      };
+      VkDeviceMemory memory = VK_NULL_HANDLE;
+      result = vulkan_device_.allocate_memory(vulkan_device_.device,
+                                              &allocate_info,
+                                              nullptr,
+                                              &memory);
+      if (result != VK_SUCCESS) {
+        throw std::runtime_error(fmt::format("vkAllocateMemory failed with {}",
+                                             static_cast<int>(result)));
+      }
+      memory_.push_back(memory);
+      result = vulkan_device_.bind_image_memory(vulkan_device_.device, image, memory, 0);
+      if (result != VK_SUCCESS) {
+        throw std::runtime_error(fmt::format("vkBindImageMemory failed with {}",
+                                             static_cast<int>(result)));
+      }
+    }
+  } catch (...) {
+    Destroy();
+    throw;
+  }
+}
+
+mock_runtime::MockSwapchain::~MockSwapchain() {
+  Destroy();
+}
+
+void mock_runtime::MockSwapchain::Destroy() {
+  for (VkImage image: images_) {
+    vulkan_device_.destroy_image(vulkan_device_.device, image, nullptr);
+  }
+  images_.clear();
+  for (VkDeviceMemory memory: memory_) {
+    vulkan_device_.free_memory(vulkan_device_.device, memory, nullptr);
+  }
+  memory_.clear();
+}
+
+mock_runtime::MockSession *mock_runtime::MockSwapchain::GetSession() const {
+  return session_;
+}
+
+const std::vector<VkImage> &mock_runtime::MockSwapchain::GetImages() const {
+  return images_;
+}
+
+XrResult mock_runtime::MockSwapchain::Acquire(uint32_t *index) {
+  if (acquired_count_ - released_count_ == kImageCount) {
+    return XR_ERROR_CALL_ORDER_INVALID;
+  }
+  *index = static_cast<uint32_t>(acquired_count_ % kImageCount);
+  acquired_count_++;
+  return XR_SUCCESS;
+}
+
+XrResult mock_runtime::MockSwapchain::Wait() {
+  // only the oldest acquired image may be waited on and only once
+  if (waited_count_ == acquired_count_ || waited_count_ != released_count_) {
+    return XR_ERROR_CALL_ORDER_INVALID;
+  }
+  waited_count_++;
+  return XR_SUCCESS;
+}
+
+XrResult mock_runtime::MockSwapchain::Release() {
+  if (released_count_ == waited_count_) {
+    return XR_ERROR_CALL_ORDER_INVALID;
+  }
+  released_count_++;
+  return XR_SUCCESS;
+}
+
+bool mock_runtime::MockSwapchain::HasReleasedImage() const {
+  return released_count_ > 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <openxr/openxr.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace mock_runtime {
+struct MockSession;
+
+// Vulkan entry points of the device the application bound to its session, loaded through the
+// vkGetInstanceProcAddr it passed to xrCreateVulkanInstanceKHR.
+struct MockVulkanDevice {
+  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  PFN_vkGetPhysicalDeviceMemoryProperties get_physical_device_memory_properties = nullptr;
+  PFN_vkCreateImage create_image = nullptr;
+  PFN_vkDestroyImage destroy_image = nullptr;
+  PFN_vkGetImageMemoryRequirements get_image_memory_requirements = nullptr;
+  PFN_vkAllocateMemory allocate_memory = nullptr;
+  PFN_vkFreeMemory free_memory = nullptr;
+  PFN_vkBindImageMemory bind_image_memory = nullptr;
+};
+
+// Returns false when an entry point is missing.
+bool LoadMockVulkanDevice(PFN_vkGetInstanceProcAddr get_instance_proc_addr,
+                          VkInstance instance,
+                          VkPhysicalDevice physical_device,
+                          VkDevice device,
+                          MockVulkanDevice *vulkan_device);
+
+// Images of a swapchain, each with its own device local memory. Nothing consumes them, images
+// are handed out round robin and may be acquired again as soon as they were released.
+class MockSwapchain {
+ private:
+  static constexpr uint32_t kImageCount = 3;
+
+  MockSession *session_;
+  const MockVulkanDevice &vulkan_device_;
+  std::vector<VkImage> images_{};
+  std::vector<VkDeviceMemory> memory_{};
+  uint64_t acquired_count_ = 0;
+  uint64_t waited_count_ = 0;
+  uint64_t released_count_ = 0;
+
+  void Destroy();
+ public:
+  // Throws when the images can not be created.
+  MockSwapchain(MockSession *session,
+                const MockVulkanDevice &vulkan_device,
+                const XrSwapchainCreateInfo &create_info);
+  MockSwapchain(const MockSwapchain &) = delete;
+  ~MockSwapchain();
+
+  [[nodiscard]] MockSession *GetSession() const;
+
+  [[nodiscard]] const std::vector<VkImage> &GetImages() const;
+
+  XrResult Acquire(uint32_t *index);
+  XrResult Wait();
+  XrResult Release();
+
+  [[nodiscard]] bool HasReleasedImage() const;
+};
+}
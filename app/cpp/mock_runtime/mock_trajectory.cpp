@@ -0,0 +1,156 @@
+#include "mock_trajectory.hpp"
+
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+mock_runtime::Pose mock_runtime::Compose(const Pose &parent, const Pose &child) {
+  return {parent.orientation * child.orientation,
+          parent.position + parent.orientation * child.position};
+}
+
+mock_runtime::Pose mock_runtime::Invert(const Pose &pose) {
+  const glm::quat kInverse = glm::conjugate(pose.orientation);
+  return {kInverse, -(kInverse * pose.position)};
+}
+
+mock_runtime::Pose mock_runtime::FromXrPose(const XrPosef &pose) {
+  return {glm::quat(pose.orientation.w, pose.orientation.x, pose.orientation.y, pose.orientation.z),
+          glm::vec3(pose.position.x, pose.position.y, pose.position.z)};
+}
+
+XrPosef mock_runtime::ToXrPose(const Pose &pose) {
+  return {{pose.orientation.x, pose.orientation.y, pose.orientation.z, pose.orientation.w},
+          {pose.position.x, pose.position.y, pose.position.z}};
+}
+
+mock_runtime::MockTrajectory::MockTrajectory() {
+  constexpr double kDuration = 8.0;
+  constexpr int kKeyframesPerSecond = 60;
+  constexpr double kTwoPi = 6.283185307179586;
+  const auto kKeyframeCount = static_cast<int>(kDuration * kKeyframesPerSecond);
+  for (int i = 0; i <= kKeyframeCount; i++) {
+    const double kTime = static_cast<double>(i) / kKeyframesPerSecond;
+    // every motion repeats a whole number of times over the duration, so the loop is seamless
+    const auto kSlow = static_cast<float>(kTwoPi * kTime / kDuration);
+    const auto kFast = kSlow * 2.0F;
+
+    Pose head{};
+    head.orientation = glm::angleAxis(0.35F * std::sin(kSlow), glm::vec3(0.0F, 1.0F, 0.0F))
+        * glm::angleAxis(0.1F * std::sin(kFast), glm::vec3(1.0F, 0.0F, 0.0F));
+    head.position = {0.05F * std::sin(kSlow), 1.6F + 0.02F * std::sin(4.0F * kSlow), 0.0F};
+    keyframes_[static_cast<size_t>(TrackedDevice::HEAD)].push_back({kTime, head, 0.0F});
+
+    Pose left{};
+    left.position = {-0.2F + 0.1F * std::cos(kFast), 1.3F + 0.1F * std::sin(kFast), -0.4F};
+    keyframes_[static_cast<size_t>(TrackedDevice::LEFT_HAND)]
+        .push_back({kTime, left, 0.5F - 0.5F * std::cos(kFast)});
+
+    Pose right{};
+    right.position = {0.2F - 0.1F * std::cos(kFast), 1.3F + 0.1F * std::sin(kFast), -0.4F};
+    keyframes_[static_cast<size_t>(TrackedDevice::RIGHT_HAND)]
+        .push_back({kTime, right, 0.5F - 0.5F * std::cos(4.0F * kSlow)});
+  }
+  duration_s_ = kDuration;
+}
+
+mock_runtime::MockTrajectory::MockTrajectory(const std::string &path) {
+  std::ifstream file(path);
+  if (!file) {
+    throw std::runtime_error(fmt::format("unable to open trajectory {}", path));
+  }
+  std::string line;
+  for (int line_number = 1; std::getline(file, line); line_number++) {
+    const size_t kContentStart = line.find_first_not_of(" \t\r");
+    if (kContentStart == std::string::npos || line[kContentStart] == '#') {
+      continue;
+    }
+    std::istringstream stream(line);
+    Keyframe keyframe{};
+    std::string device_name;
+    glm::quat &orientation = keyframe.pose.orientation;
+    glm::vec3 &position = keyframe.pose.position;
+    stream >> keyframe.time_s >> device_name >> position.x >> position.y >> position.z
+           >> orientation.x >> orientation.y >> orientation.z >> orientation.w;
+    if (!stream) {
+      throw std::runtime_error(fmt::format("{}:{}: malformed keyframe", path, line_number));
+    }
+    if (!(stream >> keyframe.grab)) {
+      keyframe.grab = 0.0F;
+    }
+    orientation = glm::normalize(orientation);
+
+    TrackedDevice device;
+    if (device_name == "head") {
+      device = TrackedDevice::HEAD;
+    } else if (device_name == "left") {
+      device = TrackedDevice::LEFT_HAND;
+    } else if (device_name == "right") {
+      device = TrackedDevice::RIGHT_HAND;
+    } else {
+      throw std::runtime_error(fmt::format("{}:{}: unknown device {}",
+                                           path,
+                                           line_number,
+                                           device_name));
+    }
+    auto &keyframes = keyframes_[static_cast<size_t>(device)];
+    if (!keyframes.empty() && keyframes.back().time_s >= keyframe.time_s) {
+      throw std::runtime_error(fmt::format("{}:{}: keyframes must be in increasing time order",
+                                           path,
+                                           line_number));
+    }
+    keyframes.push_back(keyframe);
+    duration_s_ = std::max(duration_s_, keyframe.time_s);
+  }
+  if (keyframes_[static_cast<size_t>(TrackedDevice::HEAD)].empty()) {
+    throw std::runtime_error(fmt::format("{}: the head has no keyframes", path));
+  }
+}
+
+bool mock_runtime::MockTrajectory::IsTracked(TrackedDevice device) const {
+  return !keyframes_[static_cast<size_t>(device)].empty();
+}
+
+mock_runtime::MockTrajectory::Keyframe
+mock_runtime::MockTrajectory::Sample(TrackedDevice device, double time_s) const {
+  const auto &keyframes = keyframes_[static_cast<size_t>(device)];
+  if (keyframes.empty()) {
+    return {time_s, {}, 0.0F};
+  }
+  if (duration_s_ > 0.0) {
+    time_s = std::fmod(time_s, duration_s_);
+    if (time_s < 0.0) {
+      time_s += duration_s_;
+    }
+  }
+  const auto kNext = std::upper_bound(keyframes.begin(), keyframes.end(), time_s,
+                                      [](double time, const Keyframe &keyframe) {
+                                        return time < keyframe.time_s;
+                                      });
+  if (kNext == keyframes.begin()) {
+    return keyframes.front();
+  }
+  if (kNext == keyframes.end()) {
+    return keyframes.back();
+  }
+  const Keyframe &previous = *(kNext - 1);
+  const auto kT = static_cast<float>((time_s - previous.time_s)
+                                         / (kNext->time_s - previous.time_s));
+  return {time_s,
+          {glm::slerp(previous.pose.orientation, kNext->pose.orientation, kT),
+           glm::mix(previous.pose.position, kNext->pose.position, kT)},
+          previous.grab + (kNext->grab - previous.grab) * kT};
+}
+
+mock_runtime::Pose mock_runtime::MockTrajectory::GetPose(TrackedDevice device,
+                                                         double time_s) const {
+  return Sample(device, time_s).pose;
+}
+
+float mock_runtime::MockTrajectory::GetGrab(TrackedDevice device, double time_s) const {
+  return Sample(device, time_s).grab;
+}
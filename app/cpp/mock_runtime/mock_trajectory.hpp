@@ -0,0 +1,65 @@
+#pragma once
+
+#include <openxr/openxr.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace mock_runtime {
+struct Pose {
+  glm::quat orientation{1.0F, 0.0F, 0.0F, 0.0F};
+  glm::vec3 position{0.0F};
+};
+
+// Pose of child given in parent, expressed in the space parent is given in.
+Pose Compose(const Pose &parent, const Pose &child);
+Pose Invert(const Pose &pose);
+Pose FromXrPose(const XrPosef &pose);
+XrPosef ToXrPose(const Pose &pose);
+
+enum class TrackedDevice {
+  HEAD,
+  LEFT_HAND,
+  RIGHT_HAND,
+  COUNT,
+};
+
+// Scripted poses of the head and the hands in stage space together with the grab value of
+// each hand, looping over the duration of the script. A script is a text file with one
+// keyframe per line, keyframes of a device in increasing time order:
+//   # time_s device px py pz qx qy qz qw [grab]
+//   0.0 head 0 1.6 0 0 0 0 1
+//   0.5 left -0.2 1.3 -0.4 0 0 0 1 0.8
+// Devices are head, left and right, a device without keyframes is not tracked. Poses are
+// interpolated linearly, orientations with slerp.
+class MockTrajectory {
+ private:
+  static constexpr size_t kDeviceCount = static_cast<size_t>(TrackedDevice::COUNT);
+
+  struct Keyframe {
+    double time_s;
+    Pose pose;
+    float grab;
+  };
+
+  std::array<std::vector<Keyframe>, kDeviceCount> keyframes_{};
+  double duration_s_ = 0.0;
+
+  [[nodiscard]] Keyframe Sample(TrackedDevice device, double time_s) const;
+ public:
+  // The built in script sways the head and moves both hands in circles in front of it while
+  // they open and close.
+  MockTrajectory();
+  explicit MockTrajectory(const std::string &path);
+
+  [[nodiscard]] bool IsTracked(TrackedDevice device) const;
+
+  [[nodiscard]] Pose GetPose(TrackedDevice device, double time_s) const;
+
+  [[nodiscard]] float GetGrab(TrackedDevice device, double time_s) const;
+};
+}
@@ -0,0 +1,63 @@
+#include "msaa_policy.hpp"
+
+#include <stdexcept>
+
+namespace {
+constexpr uint32_t kMaxSamples = 64;
+
+// highest supported power of two that is not above samples, 1 is always supported
+uint32_t ClampSamples(uint32_t samples, uint32_t supported_samples) {
+  uint32_t clamped = kMaxSamples;
+  while (clamped > 1 && (clamped > samples || (supported_samples & clamped) == 0)) {
+    clamped >>= 1;
+  }
+  return clamped;
+}
+
+uint32_t ParseSamples(const std::string &text) {
+  size_t parsed = 0;
+  const unsigned long kSamples = std::stoul(text, &parsed);
+  if (parsed != text.size() || kSamples == 0 || kSamples > kMaxSamples) {
+    throw std::invalid_argument("msaa sample count must be in [1, 64]: " + text);
+  }
+  return static_cast<uint32_t>(kSamples);
+}
+}
+
+uint32_t SelectMsaaSamples(const MsaaPolicy &policy,
+                           uint32_t supported_samples,
+                           uint32_t recommended_samples,
+                           uint64_t frame_pixels) {
+  switch (policy.mode) {
+    case MsaaMode::OFF:
+      return 1;
+    case MsaaMode::RECOMMENDED:
+      return ClampSamples(recommended_samples, supported_samples);
+    case MsaaMode::FIXED:
+      return ClampSamples(policy.samples, supported_samples);
+    case MsaaMode::COST_LIMITED: {
+      uint32_t samples = ClampSamples(policy.samples, supported_samples);
+      while (samples > 1 && frame_pixels * samples > policy.max_frame_samples) {
+        samples = ClampSamples(samples / 2, supported_samples);
+      }
+      return samples;
+    }
+  }
+  throw std::invalid_argument("unknown msaa mode");
+}
+
+MsaaPolicy ParseMsaaPolicy(const std::string &text) {
+  MsaaPolicy policy{};
+  if (text == "off") {
+    policy.mode = MsaaMode::OFF;
+  } else if (text == "recommended") {
+    policy.mode = MsaaMode::RECOMMENDED;
+  } else if (text.rfind("max:", 0) == 0) {
+    policy.mode = MsaaMode::COST_LIMITED;
+    policy.samples = ParseSamples(text.substr(4));
+  } else {
+    policy.mode = MsaaMode::FIXED;
+    policy.samples = ParseSamples(text);
+  }
+  return policy;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+enum class MsaaMode {
+  // the swapchain images are drawn into directly
+  OFF,
+  // the sample count the runtime recommends for the views
+  RECOMMENDED,
+  // samples, lowered to the next count the device supports
+  FIXED,
+  // the highest count up to samples whose estimated cost fits max_frame_samples
+  COST_LIMITED,
+};
+
+struct MsaaPolicy {
+  MsaaMode mode = MsaaMode::COST_LIMITED;
+  // sample count of FIXED and the highest count COST_LIMITED picks, 4x is the sweet spot of
+  // Quest gpus
+  uint32_t samples = 4;
+  // COST_LIMITED keeps rendered pixels of all views times samples below this, about 4x at the
+  // recommended Quest 2 resolution
+  uint64_t max_frame_samples = 32ull * 1024 * 1024;
+};
+
+// Returns the sample count to render with. supported_samples has bit n set when n samples are
+// supported, like VkSampleCountFlags, frame_pixels is the pixel count of all views of a frame.
+// The result is always a supported power of two, 1 means no msaa.
+[[nodiscard]] uint32_t SelectMsaaSamples(const MsaaPolicy &policy,
+                                         uint32_t supported_samples,
+                                         uint32_t recommended_samples,
+                                         uint64_t frame_pixels);
+
+// Parses "off", "recommended", "<samples>" for a fixed count or "max:<samples>" for a cost
+// limited one. Throws std::invalid_argument for anything else.
+[[nodiscard]] MsaaPolicy ParseMsaaPolicy(const std::string &text);
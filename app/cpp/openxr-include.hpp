@@ -1,5 +1,7 @@
 #pragma once
 
+#ifdef XR_USE_PLATFORM_ANDROID
 #include <jni.h>
+#endif
 #include <vulkan/vulkan.h>
 #include <openxr/openxr_platform.h>
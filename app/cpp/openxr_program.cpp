@@ -3,13 +3,19 @@
 #include "platform.hpp"
 #include "graphics_plugin.hpp"
 #include "openxr_utils.hpp"
+#include "allocation_counter.hpp"
+#include "trace.hpp"
 #include "magic_enum.hpp"
 
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <cmath>
+#include <optional>
+#include <utility>
 #include <vector>
 
 static inline XrVector3f XrVector3f_Zero() {
@@ -99,7 +105,8 @@ inline XrReferenceSpaceCreateInfo GetXrReferenceSpaceCreateInfo(const std::strin
 }
 
 OpenXrProgram::OpenXrProgram(std::shared_ptr<Platform> platform)
-    : platform_(platform), graphics_plugin_(CreateGraphicsPlugin()) {}
+    : platform_(platform),
+      graphics_plugin_(CreateGraphicsPlugin(platform_->GetApplicationDataPath())) {}
 
 void OpenXrProgram::CreateInstance() {
   LogLayersAndExtensions();
@@ -122,6 +129,17 @@ void OpenXrProgram::CreateInstance() {
                  std::back_inserter(extensions),
                  [](const std::string &ext) { return ext.c_str(); });
 
+  visibility_mask_enabled_ = IsInstanceExtensionSupported(XR_KHR_VISIBILITY_MASK_EXTENSION_NAME);
+  if (visibility_mask_enabled_) {
+    extensions.push_back(XR_KHR_VISIBILITY_MASK_EXTENSION_NAME);
+  }
+#ifdef XR_KHR_locate_spaces
+  locate_spaces_enabled_ = IsInstanceExtensionSupported(XR_KHR_LOCATE_SPACES_EXTENSION_NAME);
+  if (locate_spaces_enabled_) {
+    extensions.push_back(XR_KHR_LOCATE_SPACES_EXTENSION_NAME);
+  }
+#endif
+
   XrInstanceCreateInfo create_info{};
   create_info.type = XR_TYPE_INSTANCE_CREATE_INFO;
   create_info.next = platform_->GetInstanceCreateExtension();
@@ -133,6 +151,12 @@ void OpenXrProgram::CreateInstance() {
   create_info.applicationInfo.apiVersion = XR_CURRENT_API_VERSION;
 
   CHECK_XRCMD(xrCreateInstance(&create_info, &instance_));
+  if (visibility_mask_enabled_) {
+    CHECK_XRCMD(xrGetInstanceProcAddr(
+        instance_,
+        "xrGetVisibilityMaskKHR",
+        reinterpret_cast<PFN_xrVoidFunction *>(&get_visibility_mask_)));
+  }
 
   LogInstanceInfo(instance_);
 }
@@ -184,6 +208,17 @@ void OpenXrProgram::InitializeSession() {
         reference_space_create_info = GetXrReferenceSpaceCreateInfo("Local");
     CHECK_XRCMD(xrCreateReferenceSpace(session_, &reference_space_create_info, &app_space_));
   }
+
+  space_table_ = std::make_unique<SpaceTable>(instance_, session_, locate_spaces_enabled_);
+  for (XrSpace visualized_space: visualized_spaces_) {
+    space_table_->Add(visualized_space);
+  }
+  for (auto hand: {side::LEFT, side::RIGHT}) {
+    hand_space_indices_[hand] = space_table_->Add(input_.hand_space[hand]);
+  }
+  spdlog::info("Locating {} spaces {}",
+               space_table_->GetSize(),
+               space_table_->IsBatched() ? "with xrLocateSpacesKHR" : "one by one");
 }
 
 void OpenXrProgram::InitializeActions() {
@@ -367,6 +402,13 @@ void OpenXrProgram::CreateVisualizedSpaces() {
   }
 }
 
+void OpenXrProgram::ConfigureDynamicResolution(const DynamicResolutionConfig &config) {
+  if (!swapchains_.empty()) {
+    throw std::runtime_error("dynamic resolution must be configured before creating swapchains");
+  }
+  dynamic_resolution_ = DynamicResolution(config);
+}
+
 void OpenXrProgram::CreateSwapchains() {
   if (session_ == XR_NULL_HANDLE) {
     throw std::runtime_error("session is null");
@@ -380,15 +422,6 @@ void OpenXrProgram::CreateSwapchains() {
 
   LogSystemProperties(instance_, system_id_);
 
-  uint32_t swapchain_format_count = 0;
-  CHECK_XRCMD(xrEnumerateSwapchainFormats(session_, 0, &swapchain_format_count, nullptr));
-  std::vector<int64_t> swapchain_formats(swapchain_format_count);
-  CHECK_XRCMD(xrEnumerateSwapchainFormats(session_,
-                                          static_cast<uint32_t>(swapchain_formats.size()),
-                                          &swapchain_format_count,
-                                          swapchain_formats.data()));
-  uint32_t swapchain_color_format = graphics_plugin_->SelectSwapchainFormat(swapchain_formats);
-
   if (view_config_type_ != XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO) {
     throw std::runtime_error("only stereo is supported");
   }
@@ -408,22 +441,62 @@ void OpenXrProgram::CreateSwapchains() {
                                                 &view_count,
                                                 config_views_.data()));
 
+  // a single array swapchain can be used only when all views share the same dimensions
+  multiview_ = graphics_plugin_->IsMultiviewSupported()
+      && std::all_of(config_views_.begin(), config_views_.end(),
+                     [&](const XrViewConfigurationView &view_config_view) {
+                       return view_config_view.recommendedImageRectWidth
+                           == config_views_[0].recommendedImageRectWidth
+                           && view_config_view.recommendedImageRectHeight
+                               == config_views_[0].recommendedImageRectHeight
+                           && view_config_view.recommendedSwapchainSampleCount
+                               == config_views_[0].recommendedSwapchainSampleCount;
+                     });
+  if (multiview_) {
+    graphics_plugin_->EnableMultiview(view_count);
+  }
+  spdlog::info("Rendering {} views {}", view_count, multiview_ ? "in a single multiview pass"
+                                                               : "one pass per view");
+
+  uint32_t swapchain_format_count = 0;
+  CHECK_XRCMD(xrEnumerateSwapchainFormats(session_, 0, &swapchain_format_count, nullptr));
+  std::vector<int64_t> swapchain_formats(swapchain_format_count);
+  CHECK_XRCMD(xrEnumerateSwapchainFormats(session_,
+                                          static_cast<uint32_t>(swapchain_formats.size()),
+                                          &swapchain_format_count,
+                                          swapchain_formats.data()));
+  uint32_t swapchain_color_format = graphics_plugin_->SelectSwapchainFormat(swapchain_formats);
+  graphics_plugin_->SetMsaaSamples(PickMsaaSamples(msaa_policy_));
+  graphics_plugin_->SetFoveationLevel(foveation_level_);
+
   views_.resize(view_count, {XR_TYPE_VIEW});
-  for (const auto &view_config_view: config_views_) {
-    spdlog::info("Creating swapchain with dimensions Width={} Height={} SampleCount={}",
-                 view_config_view.recommendedImageRectWidth,
-                 view_config_view.recommendedImageRectHeight,
-                 view_config_view.recommendedSwapchainSampleCount);
+  input_frame_.views.resize(view_count);
+  input_frame_.spaces.resize(space_table_->GetSize());
+  const uint32_t kSwapchainCount = multiview_ ? 1 : view_count;
+  for (uint32_t i = 0; i < kSwapchainCount; i++) {
+    const auto &view_config_view = config_views_[i];
+    // dynamic resolution renders into a part of swapchains sized for its max scale
+    const float kMaxScale = dynamic_resolution_.GetConfig().max_scale;
+    const auto kWidth = std::clamp(static_cast<uint32_t>(std::lround(
+        static_cast<float>(view_config_view.recommendedImageRectWidth) * kMaxScale)),
+                                   1u,
+                                   view_config_view.maxImageRectWidth);
+    const auto kHeight = std::clamp(static_cast<uint32_t>(std::lround(
+        static_cast<float>(view_config_view.recommendedImageRectHeight) * kMaxScale)),
+                                    1u,
+                                    view_config_view.maxImageRectHeight);
+    spdlog::info("Creating swapchain with dimensions Width={} Height={}", kWidth, kHeight);
 
     XrSwapchainCreateInfo swapchain_create_info{};
     swapchain_create_info.type = XR_TYPE_SWAPCHAIN_CREATE_INFO;
-    swapchain_create_info.arraySize = 1;
+    swapchain_create_info.arraySize = multiview_ ? view_count : 1;
     swapchain_create_info.format = swapchain_color_format;
-    swapchain_create_info.width = view_config_view.recommendedImageRectWidth;
-    swapchain_create_info.height = view_config_view.recommendedImageRectHeight;
+    swapchain_create_info.width = kWidth;
+    swapchain_create_info.height = kHeight;
     swapchain_create_info.mipCount = 1;
     swapchain_create_info.faceCount = 1;
-    swapchain_create_info.sampleCount = view_config_view.recommendedSwapchainSampleCount;
+    // multisampled rendering is resolved into the swapchain images
+    swapchain_create_info.sampleCount = 1;
     swapchain_create_info.usageFlags =
         XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT;
     Swapchain swapchain{};
@@ -445,9 +518,56 @@ void OpenXrProgram::CreateSwapchains() {
     graphics_plugin_->SwapchainImageStructsReady(swapchain_images);
     swapchain_images_.insert(std::make_pair(swapchain.handle, swapchain_images));
   }
+
+  if (visibility_mask_enabled_) {
+    visibility_masks_.resize(view_count);
+    for (uint32_t i = 0; i < view_count; i++) {
+      FetchVisibilityMask(i);
+    }
+  }
+}
+
+void OpenXrProgram::FetchVisibilityMask(uint32_t view_index) {
+  XrVisibilityMaskKHR mask{XR_TYPE_VISIBILITY_MASK_KHR};
+  CHECK_XRCMD(get_visibility_mask_(session_,
+                                   view_config_type_,
+                                   view_index,
+                                   XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR,
+                                   &mask));
+  std::vector<XrVector2f> vertices(mask.vertexCountOutput);
+  std::vector<uint32_t> indices(mask.indexCountOutput);
+  mask.vertexCapacityInput = static_cast<uint32_t>(vertices.size());
+  mask.vertices = vertices.data();
+  mask.indexCapacityInput = static_cast<uint32_t>(indices.size());
+  mask.indices = indices.data();
+  // a mesh without triangles needs no second call
+  if (!indices.empty()) {
+    CHECK_XRCMD(get_visibility_mask_(session_,
+                                     view_config_type_,
+                                     view_index,
+                                     XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR,
+                                     &mask));
+  }
+  spdlog::info("Visibility mask of view {} has {} triangles", view_index, indices.size() / 3);
+
+  std::lock_guard<std::mutex> lock(visibility_mask_mutex_);
+  visibility_masks_.at(view_index) = {true, std::move(vertices), std::move(indices)};
+  visibility_masks_changed_ = true;
+}
+
+void OpenXrProgram::ApplyVisibilityMasks() {
+  std::lock_guard<std::mutex> lock(visibility_mask_mutex_);
+  for (uint32_t i = 0; i < visibility_masks_.size(); i++) {
+    VisibilityMask &mask = visibility_masks_[i];
+    if (mask.changed) {
+      graphics_plugin_->SetVisibilityMask(i, mask.vertices, mask.indices);
+      mask.changed = false;
+    }
+  }
 }
 
 void OpenXrProgram::PollEvents() {
+  TRACE_SCOPE("PollEvents");
   while (const XrEventDataBaseHeader *event = TryReadNextEvent()) {
     switch (event->type) {
       case XR_TYPE_EVENT_DATA_INSTANCE_LOSS_PENDING: {
@@ -469,6 +589,16 @@ void OpenXrProgram::PollEvents() {
         LogActionSourceName(session_, input_.vibrate_action, "Vibrate");
       }
         break;
+      case XR_TYPE_EVENT_DATA_VISIBILITY_MASK_CHANGED_KHR: {
+        const auto &mask_changed =
+            *reinterpret_cast<const XrEventDataVisibilityMaskChangedKHR *>(event);
+        if (visibility_mask_enabled_ && mask_changed.session == session_
+            && mask_changed.viewConfigurationType == view_config_type_
+            && mask_changed.viewIndex < visibility_masks_.size()) {
+          FetchVisibilityMask(mask_changed.viewIndex);
+        }
+        break;
+      }
       case XR_TYPE_EVENT_DATA_REFERENCE_SPACE_CHANGE_PENDING:
       default: {
         spdlog::debug("Ignoring event type {}", magic_enum::enum_name(event->type));
@@ -519,6 +649,8 @@ void OpenXrProgram::HandleSessionStateChangedEvent(const XrEventDataSessionState
     }
     case XR_SESSION_STATE_STOPPING: {
       session_running_ = false;
+      StopFramePipeline();
+      DumpFrameTimings();
       CHECK_XRCMD(xrEndSession(session_));
       break;
     }
@@ -530,7 +662,176 @@ bool OpenXrProgram::IsSessionRunning() const {
   return session_running_;
 }
 
+bool OpenXrProgram::IsSessionExiting() const {
+  return session_state_ == XR_SESSION_STATE_EXITING
+      || session_state_ == XR_SESSION_STATE_LOSS_PENDING;
+}
+
+void OpenXrProgram::RecordInputs(const std::string &path) {
+  if (views_.empty()) {
+    throw std::runtime_error("inputs can only be recorded once the swapchains exist");
+  }
+  input_replay_.reset();
+  input_recorder_ = std::make_unique<InputRecorder>(path,
+                                                    static_cast<uint32_t>(views_.size()),
+                                                    space_table_->GetSize());
+}
+
+void OpenXrProgram::ReplayInputs(const std::string &path) {
+  if (views_.empty()) {
+    throw std::runtime_error("inputs can only be replayed once the swapchains exist");
+  }
+  input_recorder_.reset();
+  input_replay_ = std::make_unique<InputReplay>(path,
+                                                static_cast<uint32_t>(views_.size()),
+                                                space_table_->GetSize());
+  input_replay_finished_ = false;
+}
+
+void OpenXrProgram::SetMaxFramesInFlight(uint32_t count) {
+  if (count == 0) {
+    throw std::invalid_argument("at least one frame must be in flight");
+  }
+  requested_frames_in_flight_ = count;
+}
+
+void OpenXrProgram::SetMsaaPolicy(const MsaaPolicy &policy) {
+  if (swapchains_.empty()) {
+    msaa_policy_ = policy;
+    return;
+  }
+  requested_msaa_samples_ = PickMsaaSamples(policy);
+}
+
+void OpenXrProgram::SetFoveationLevel(FoveationLevel level) {
+  if (swapchains_.empty()) {
+    foveation_level_ = level;
+    return;
+  }
+  requested_foveation_level_ = level;
+  foveation_level_changed_ = true;
+}
+
+uint32_t OpenXrProgram::PickMsaaSamples(const MsaaPolicy &policy) const {
+  // views are rendered at up to the max scale of dynamic resolution
+  const float kMaxScale = dynamic_resolution_.GetConfig().max_scale;
+  uint64_t frame_pixels = 0;
+  for (const XrViewConfigurationView &view_config_view: config_views_) {
+    frame_pixels += static_cast<uint64_t>(
+        static_cast<float>(view_config_view.recommendedImageRectWidth) * kMaxScale
+            * static_cast<float>(view_config_view.recommendedImageRectHeight) * kMaxScale);
+  }
+  const uint32_t kSamples = SelectMsaaSamples(policy,
+                                              graphics_plugin_->GetSupportedMsaaSamples(),
+                                              config_views_[0].recommendedSwapchainSampleCount,
+                                              frame_pixels);
+  spdlog::info("Msaa policy {} picks {}x for {} pixels per frame",
+               magic_enum::enum_name(policy.mode),
+               kSamples,
+               frame_pixels);
+  return kSamples;
+}
+
+const FrameTimings &OpenXrProgram::GetFrameTimings() const {
+  return frame_timings_;
+}
+
+void OpenXrProgram::DumpFrameTimings() const {
+  frame_timings_.LogPercentiles();
+  frame_timings_.DumpCsv(platform_->GetApplicationDataPath() + "/frame_timings.csv");
+#ifdef QUEST_XR_TRACING
+  trace::WriteChromeTrace(platform_->GetApplicationDataPath() + "/trace.json");
+#endif
+}
+
+void OpenXrProgram::StartFramePipeline() {
+  {
+    std::lock_guard<std::mutex> lock(frame_pipeline_error_mutex_);
+    if (frame_pipeline_error_ != nullptr) {
+      std::rethrow_exception(frame_pipeline_error_);
+    }
+  }
+  if (frame_pipeline_running_) {
+    return;
+  }
+  StopFramePipeline();
+  frame_queue_.Reopen();
+  frame_pipeline_running_ = true;
+  render_thread_ = std::thread(&OpenXrProgram::RenderLoop, this);
+  simulation_thread_ = std::thread(&OpenXrProgram::SimulationLoop, this);
+  spdlog::info("Frame pipeline started");
+}
+
+void OpenXrProgram::StopFramePipeline() {
+  frame_pipeline_running_ = false;
+  // the render thread must keep beginning frames until the simulation thread is done, its
+  // last xrWaitFrame can block on the xrBeginFrame of the queued frame
+  if (simulation_thread_.joinable()) {
+    simulation_thread_.join();
+  }
+  frame_queue_.Close();
+  if (render_thread_.joinable()) {
+    render_thread_.join();
+    spdlog::info("Frame pipeline stopped");
+  }
+}
+
+bool OpenXrProgram::IsFramePipelineRunning() const {
+  return frame_pipeline_running_;
+}
+
+uint64_t OpenXrProgram::GetSubmittedFrameCount() const {
+  return submitted_frame_count_;
+}
+
+void OpenXrProgram::SimulationLoop() {
+  TRACE_THREAD_NAME("simulation");
+  try {
+    // the counter is per thread, the render thread checks what this one reports
+    uint64_t last_allocation_count = GetThreadAllocationCount();
+    while (frame_pipeline_running_ && session_running_) {
+      PollActions();
+      FrameSnapshot snapshot = WaitFrame();
+      const uint64_t kAllocationCount = GetThreadAllocationCount();
+      snapshot.simulation_allocations = kAllocationCount - last_allocation_count;
+      last_allocation_count = kAllocationCount;
+      if (!frame_queue_.Push(std::move(snapshot))) {
+        break;
+      }
+    }
+  } catch (...) {
+    SetFramePipelineError(std::current_exception());
+  }
+  frame_pipeline_running_ = false;
+}
+
+void OpenXrProgram::RenderLoop() {
+  TRACE_THREAD_NAME("render");
+  try {
+    while (auto snapshot = frame_queue_.Pop()) {
+      SubmitFrame(*snapshot);
+    }
+  } catch (...) {
+    SetFramePipelineError(std::current_exception());
+    // unblock the simulation thread, it may wait for room in the queue
+    frame_queue_.Close();
+  }
+  frame_pipeline_running_ = false;
+}
+
+void OpenXrProgram::SetFramePipelineError(std::exception_ptr error) {
+  std::lock_guard<std::mutex> lock(frame_pipeline_error_mutex_);
+  if (frame_pipeline_error_ == nullptr) {
+    frame_pipeline_error_ = error;
+  }
+}
+
 void OpenXrProgram::PollActions() {
+  TRACE_SCOPE("PollActions");
+  if (input_replay_ != nullptr) {
+    PollRecordedActions();
+    return;
+  }
   input_.hand_active = {XR_FALSE, XR_FALSE};
 
   const XrActiveActionSet kActiveActionSet{input_.action_set, XR_NULL_PATH};
@@ -549,6 +850,8 @@ void OpenXrProgram::PollActions() {
     XrActionStateFloat grab_value{};
     grab_value.type = XR_TYPE_ACTION_STATE_FLOAT;
     CHECK_XRCMD(xrGetActionStateFloat(session_, &get_info, &grab_value));
+    input_frame_.hands[hand].grab_active = grab_value.isActive;
+    input_frame_.hands[hand].grab_value = grab_value.currentState;
     if (grab_value.isActive == XR_TRUE) {
       input_.hand_scale[hand] = 1.0f - 0.5f * grab_value.currentState;
       if (grab_value.currentState > 0.9f) {
@@ -572,6 +875,7 @@ void OpenXrProgram::PollActions() {
     pose_state.type = XR_TYPE_ACTION_STATE_POSE;
     CHECK_XRCMD(xrGetActionStatePose(session_, &get_info, &pose_state));
     input_.hand_active[hand] = pose_state.isActive;
+    input_frame_.hands[hand].pose_active = pose_state.isActive;
   }
 
   XrActionStateGetInfo get_info{};
@@ -582,13 +886,45 @@ void OpenXrProgram::PollActions() {
   XrActionStateBoolean quit_value{};
   quit_value.type = XR_TYPE_ACTION_STATE_BOOLEAN;
   CHECK_XRCMD(xrGetActionStateBoolean(session_, &get_info, &quit_value));
-  if ((quit_value.isActive == XR_TRUE) && (quit_value.changedSinceLastSync == XR_TRUE)
-      && (quit_value.currentState == XR_TRUE)) {
+  input_frame_.quit_requested = (quit_value.isActive == XR_TRUE)
+      && (quit_value.changedSinceLastSync == XR_TRUE)
+      && (quit_value.currentState == XR_TRUE) ? XR_TRUE : XR_FALSE;
+  if (input_frame_.quit_requested == XR_TRUE) {
+    CHECK_XRCMD(xrRequestExitSession(session_));
+  }
+}
+
+void OpenXrProgram::PollRecordedActions() {
+  if (input_replay_finished_) {
+    return;
+  }
+  if (!input_replay_->Read(&input_frame_)) {
+    // later frames keep showing the last recorded one until the session stops
+    input_replay_finished_ = true;
+    spdlog::info("Input replay finished after {} frames", input_replay_->GetFrameCount());
+    CHECK_XRCMD(xrRequestExitSession(session_));
+    return;
+  }
+  // haptics are outputs and are not replayed
+  for (auto hand: {side::LEFT, side::RIGHT}) {
+    const RecordedHand &kHand = input_frame_.hands[hand];
+    if (kHand.grab_active == XR_TRUE) {
+      input_.hand_scale[hand] = 1.0f - 0.5f * kHand.grab_value;
+    }
+    input_.hand_active[hand] = kHand.pose_active;
+  }
+  if (input_frame_.quit_requested == XR_TRUE) {
     CHECK_XRCMD(xrRequestExitSession(session_));
   }
 }
 
 void OpenXrProgram::RenderFrame() {
+  const FrameSnapshot kSnapshot = WaitFrame();
+  SubmitFrame(kSnapshot);
+}
+
+FrameSnapshot OpenXrProgram::WaitFrame() {
+  TRACE_SCOPE("WaitFrame");
   if (session_ == XR_NULL_HANDLE) {
     throw std::runtime_error("session can not be null");
   }
@@ -596,143 +932,329 @@ void OpenXrProgram::RenderFrame() {
   XrFrameWaitInfo frame_wait_info{
       .type = XR_TYPE_FRAME_WAIT_INFO,
   };
-  XrFrameState frame_state{
+  const uint64_t kFrameId = frame_timings_.BeginFrame();
+  // the frame that used this arena before is already submitted
+  FrameArena &arena = frame_arenas_[kFrameId % kFrameArenaCount];
+  arena.Reset();
+  FrameSnapshot snapshot(arena.GetResource());
+  snapshot.frame_id = kFrameId;
+  snapshot.frame_state = {
       .type = XR_TYPE_FRAME_STATE,
   };
-  CHECK_XRCMD(xrWaitFrame(session_, &frame_wait_info, &frame_state));
+  {
+    ScopedPhaseTimer timer(frame_timings_, snapshot.frame_id, FramePhase::WAIT_FRAME);
+    TRACE_SCOPE("xrWaitFrame");
+    CHECK_XRCMD(xrWaitFrame(session_, &frame_wait_info, &snapshot.frame_state));
+  }
+  if (snapshot.frame_state.shouldRender != XR_TRUE) {
+    UpdateInputFrame(snapshot.frame_state);
+    return snapshot;
+  }
+  ScopedPhaseTimer locate_timer(frame_timings_, snapshot.frame_id, FramePhase::LOCATE);
+  UpdateInputFrame(snapshot.frame_state);
+  // the runtime decides whether a frame is rendered, a replayed frame only what it shows
+  if (input_frame_.views_valid != XR_TRUE) {
+    return snapshot;  // There is no valid tracking poses for the views.
+  }
+  snapshot.views.assign(views_.begin(), views_.end());
+  for (size_t i = 0; i < snapshot.views.size(); i++) {
+    snapshot.views[i].pose = input_frame_.views[i].pose;
+    snapshot.views[i].fov = input_frame_.views[i].fov;
+  }
+  snapshot.views_valid = true;
+  auto &cubes = snapshot.cubes;
+  const auto &spaces = input_frame_.spaces;
 
+  // For each locatable space that we want to visualize, render a 25cm cube.
+  for (uint32_t i = 0; i < visualized_spaces_.size(); i++) {
+    if (spaces[i].valid != 0) {
+      cubes.push_back(math::Transform{spaces[i].orientation,
+                                      spaces[i].position,
+                                      {0.25f, 0.25f, 0.25f}});
+    } else if (XR_FAILED(spaces[i].result)) {
+      spdlog::debug("Unable to locate a visualized reference space in app space: {}",
+                    magic_enum::enum_name(spaces[i].result));
+    }
+  }
+
+  // Render a 10cm cube scaled by grab_action for each hand. Note renderHand will only be true when the application has focus.
+  for (auto hand: {side::LEFT, side::RIGHT}) {
+    const uint32_t kIndex = hand_space_indices_[hand];
+    if (spaces[kIndex].valid != 0) {
+      float scale = 0.1f * input_.hand_scale[hand];
+      cubes.push_back(math::Transform{spaces[kIndex].orientation,
+                                      spaces[kIndex].position,
+                                      {scale, scale, scale}});
+    } else if (XR_FAILED(spaces[kIndex].result)) {
+      // Tracking loss is expected when the hand is not active so only log a message if the hand is active.
+      if (input_.hand_active[hand] == XR_TRUE) {
+        const char *hand_name[] = {"left", "right"};
+        spdlog::debug("Unable to locate {} hand action space in app space: {}",
+                      hand_name[hand],
+                      magic_enum::enum_name(spaces[kIndex].result));
+      }
+    }
+  }
+  return snapshot;
+}
+
+void OpenXrProgram::UpdateInputFrame(const XrFrameState &frame_state) {
+  TRACE_SCOPE("UpdateInputFrame");
+  if (input_replay_ == nullptr) {
+    input_frame_.predicted_display_time = frame_state.predictedDisplayTime;
+    input_frame_.should_render = frame_state.shouldRender;
+    input_frame_.views_valid = XR_FALSE;
+    if (frame_state.shouldRender == XR_TRUE) {
+      XrViewState view_state{
+          .type = XR_TYPE_VIEW_STATE,
+      };
+      XrViewLocateInfo view_locate_info{
+          .type = XR_TYPE_VIEW_LOCATE_INFO,
+          .viewConfigurationType = view_config_type_,
+          .displayTime = frame_state.predictedDisplayTime,
+          .space = app_space_,
+      };
+      uint32_t view_count_output = 0;
+      CHECK_XRCMD(xrLocateViews(session_,
+                                &view_locate_info,
+                                &view_state,
+                                static_cast<uint32_t>(views_.size()),
+                                &view_count_output,
+                                views_.data()));
+      const bool kViewsValid = view_count_output == views_.size()
+          && (view_state.viewStateFlags & XR_VIEW_STATE_POSITION_VALID_BIT) != 0
+          && (view_state.viewStateFlags & XR_VIEW_STATE_ORIENTATION_VALID_BIT) != 0;
+      input_frame_.views_valid = kViewsValid ? XR_TRUE : XR_FALSE;
+      for (size_t i = 0; i < views_.size(); i++) {
+        input_frame_.views[i] = {views_[i].pose, views_[i].fov};
+      }
+    }
+    if (input_frame_.views_valid == XR_TRUE) {
+      space_table_->Locate(app_space_, frame_state.predictedDisplayTime);
+    }
+    for (uint32_t i = 0; i < space_table_->GetSize(); i++) {
+      RecordedSpace &space = input_frame_.spaces[i];
+      space = {0, XR_SUCCESS, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.0f)};
+      if (input_frame_.views_valid == XR_TRUE) {
+        space.result = space_table_->GetResult(i);
+        if (space_table_->IsValid(i)) {
+          space.valid = 1;
+          space.orientation = space_table_->GetOrientation(i);
+          space.position = space_table_->GetPosition(i);
+        }
+      }
+    }
+  }
+  if (input_recorder_ != nullptr) {
+    input_recorder_->Write(input_frame_);
+  }
+}
+
+void OpenXrProgram::SubmitFrame(const FrameSnapshot &snapshot) {
+  TRACE_SCOPE("SubmitFrame");
+  if (const uint32_t kFramesInFlight = requested_frames_in_flight_.exchange(0);
+      kFramesInFlight != 0) {
+    graphics_plugin_->SetMaxFramesInFlight(kFramesInFlight);
+  }
+  if (const uint32_t kMsaaSamples = requested_msaa_samples_.exchange(0); kMsaaSamples != 0) {
+    graphics_plugin_->SetMsaaSamples(kMsaaSamples);
+    // rebuilding render targets and pipelines allocates, the frame is not a steady state one
+    skip_allocation_check_ = true;
+  }
+  if (foveation_level_changed_.exchange(false)) {
+    graphics_plugin_->SetFoveationLevel(requested_foveation_level_);
+    skip_allocation_check_ = true;
+  }
+  if (visibility_masks_changed_.exchange(false)) {
+    ApplyVisibilityMasks();
+    skip_allocation_check_ = true;
+  }
   XrFrameBeginInfo frame_begin_info{
       .type = XR_TYPE_FRAME_BEGIN_INFO,
   };
-  CHECK_XRCMD(xrBeginFrame(session_, &frame_begin_info));
+  {
+    ScopedPhaseTimer timer(frame_timings_, snapshot.frame_id, FramePhase::BEGIN_FRAME);
+    TRACE_SCOPE("xrBeginFrame");
+    CHECK_XRCMD(xrBeginFrame(session_, &frame_begin_info));
+  }
 
-  std::vector<XrCompositionLayerBaseHeader *> layers{};
+  std::pmr::vector<XrCompositionLayerBaseHeader *> layers(snapshot.memory);
   XrCompositionLayerProjection layer{
       .type = XR_TYPE_COMPOSITION_LAYER_PROJECTION,
   };
-  std::vector<XrCompositionLayerProjectionView> projection_layer_views{};
-  if (frame_state.shouldRender == XR_TRUE) {
-    if (RenderLayer(frame_state.predictedDisplayTime, projection_layer_views, layer)) {
+  std::pmr::vector<XrCompositionLayerProjectionView> projection_layer_views(snapshot.memory);
+  if (snapshot.frame_state.shouldRender == XR_TRUE) {
+    if (RenderLayer(snapshot, projection_layer_views, layer)) {
       layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader *>(&layer));
     }
   }
 
   XrFrameEndInfo frame_end_info{};
   frame_end_info.type = XR_TYPE_FRAME_END_INFO;
-  frame_end_info.displayTime = frame_state.predictedDisplayTime;
+  frame_end_info.displayTime = snapshot.frame_state.predictedDisplayTime;
   frame_end_info.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
   frame_end_info.layerCount = static_cast<uint32_t>(layers.size());
   frame_end_info.layers = layers.data();
-  CHECK_XRCMD(xrEndFrame(session_, &frame_end_info));
+  {
+    ScopedPhaseTimer timer(frame_timings_, snapshot.frame_id, FramePhase::END_FRAME);
+    TRACE_SCOPE("xrEndFrame");
+    CHECK_XRCMD(xrEndFrame(session_, &frame_end_info));
+  }
+  submitted_frame_count_++;
+  CheckFrameAllocations(snapshot);
 }
 
-bool OpenXrProgram::RenderLayer(XrTime predicted_display_time,
-                                std::vector<XrCompositionLayerProjectionView> &projection_layer_views,
-                                XrCompositionLayerProjection &layer) {
-  XrViewState view_state{};
-  view_state.type = XR_TYPE_VIEW_STATE;
-
-  XrViewLocateInfo view_locate_info{};
-  view_locate_info.type = XR_TYPE_VIEW_LOCATE_INFO;
-  view_locate_info.viewConfigurationType = view_config_type_;
-  view_locate_info.displayTime = predicted_display_time;
-  view_locate_info.space = app_space_;
-
-  uint32_t view_count_output = 0;
-  CHECK_XRCMD(xrLocateViews(session_,
-                            &view_locate_info,
-                            &view_state,
-                            views_.size(),
-                            &view_count_output,
-                            views_.data()));
-  if ((view_state.viewStateFlags & XR_VIEW_STATE_POSITION_VALID_BIT) == 0 ||
-      (view_state.viewStateFlags & XR_VIEW_STATE_ORIENTATION_VALID_BIT) == 0) {
-    return false;  // There is no valid tracking poses for the views.
+void OpenXrProgram::CheckFrameAllocations(const FrameSnapshot &snapshot) {
+  // buffers and containers reach their steady state size during the first frames
+  constexpr uint64_t kWarmUpFrames = 120;
+  // the count is the render thread's own, sampled once per frame, the simulation thread
+  // samples its own around waiting the frame
+  const uint64_t kAllocationCount = GetThreadAllocationCount();
+  const uint64_t kRenderAllocations = kAllocationCount - last_allocation_count_;
+  last_allocation_count_ = kAllocationCount;
+  const bool kSkipCheck = std::exchange(skip_allocation_check_, false);
+  if (snapshot.frame_id < kWarmUpFrames || kSkipCheck
+      || kRenderAllocations + snapshot.simulation_allocations == 0) {
+    return;
   }
+  allocating_frame_count_++;
+  spdlog::error("{} heap allocations since the previous frame ({} on the simulation thread), "
+                "frame {}, {} allocating frames",
+                kRenderAllocations + snapshot.simulation_allocations,
+                snapshot.simulation_allocations,
+                snapshot.frame_id,
+                allocating_frame_count_);
+  // allocations of the report itself are not charged to the next frame
+  last_allocation_count_ = GetThreadAllocationCount();
+}
 
-  projection_layer_views.resize(view_count_output);
-
-  // For each locatable space that we want to visualize, render a 25cm cube.
-  std::vector<math::Transform> cubes{};
+void OpenXrProgram::TraceGpuFrame([[maybe_unused]] const GpuFrameTiming &gpu_frame) const {
+#ifdef QUEST_XR_TRACING
+  // gpu timestamps are not calibrated against the cpu clock, the frame is drawn from the
+  // moment it was submitted, which is when its gpu work starts at the earliest
+  const TracedSubmit &kSubmit = traced_submits_[gpu_frame.frame_id % traced_submits_.size()];
+  if (kSubmit.frame_id != gpu_frame.frame_id) {
+    return;
+  }
+  const auto kNs = [](std::chrono::nanoseconds duration) {
+    return static_cast<uint64_t>(duration.count());
+  };
+  trace::RecordEvent("gpu_frame",
+                     kSubmit.time_ns,
+                     kNs(gpu_frame.duration),
+                     trace::Track::GPU,
+                     static_cast<uint32_t>(gpu_frame.frame_id));
+  for (const GpuScopeTiming &kScope: gpu_frame.scopes) {
+    trace::RecordEvent(kScope.name,
+                       kSubmit.time_ns + kNs(kScope.start),
+                       kNs(kScope.duration),
+                       trace::Track::GPU,
+                       kScope.index);
+  }
+#endif
+}
 
-  for (XrSpace visualized_space: visualized_spaces_) {
-    XrSpaceLocation space_location{};
-    space_location.type = XR_TYPE_SPACE_LOCATION;
-    auto res = xrLocateSpace(visualized_space, app_space_, predicted_display_time, &space_location);
-    if (XR_UNQUALIFIED_SUCCESS(res)) {
-      if ((space_location.locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT) != 0 &&
-          (space_location.locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT) != 0) {
-        cubes.push_back(math::Transform{
-            math::XrQuaternionFToGlm(space_location.pose.orientation),
-            math::XrVector3FToGlm(space_location.pose.position),
-            {0.25f, 0.25f, 0.25f}});
-      }
-    } else {
-      spdlog::debug("Unable to locate a visualized reference space in app space: {}",
-                    magic_enum::enum_name(res));
+bool OpenXrProgram::RenderLayer(const FrameSnapshot &snapshot,
+                                std::pmr::vector<XrCompositionLayerProjectionView> &projection_layer_views,
+                                XrCompositionLayerProjection &layer) {
+  if (!snapshot.views_valid) {
+    return false;
+  }
+  TRACE_SCOPE("RenderLayer");
+  const auto &views = snapshot.views;
+  const auto kViewCount = static_cast<uint32_t>(views.size());
+  projection_layer_views.resize(kViewCount);
+
+  // gpu times arrive a few frames late and are accounted to the frame they belong to
+  const std::optional<GpuFrameTiming> kGpuFrame = graphics_plugin_->GetLastGpuFrame();
+  if (kGpuFrame.has_value() && kGpuFrame->frame_id != last_gpu_frame_id_) {
+    last_gpu_frame_id_ = kGpuFrame->frame_id;
+    TraceGpuFrame(*kGpuFrame);
+    frame_timings_.Record(kGpuFrame->frame_id, FramePhase::GPU_FRAME, kGpuFrame->duration);
+    if (dynamic_resolution_.Update(kGpuFrame->duration,
+                                   std::chrono::nanoseconds(
+                                       snapshot.frame_state.predictedDisplayPeriod))) {
+      spdlog::info("Resolution scale changed to {:.2f}, gpu frame time {:.2f}ms",
+                   dynamic_resolution_.GetScale(),
+                   std::chrono::duration<float, std::milli>(kGpuFrame->duration).count());
     }
   }
+  // the compositor only samples the rendered part of the swapchain images
+  const auto kScaled = [this](int32_t size) {
+    return std::max(1, static_cast<int32_t>(std::lround(
+        static_cast<float>(size) * dynamic_resolution_.GetScale())));
+  };
 
-  // Render a 10cm cube scaled by grab_action for each hand. Note renderHand will only be true when the application has focus.
-  for (auto hand: {side::LEFT, side::RIGHT}) {
-    XrSpaceLocation space_location{};
-    space_location.type = XR_TYPE_SPACE_LOCATION;
-    auto res =
-        xrLocateSpace(input_.hand_space[hand], app_space_, predicted_display_time, &space_location);
-    if (XR_UNQUALIFIED_SUCCESS(res)) {
-      if ((space_location.locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT) != 0 &&
-          (space_location.locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT) != 0) {
-        float scale = 0.1f * input_.hand_scale[hand];
-        cubes.push_back(math::Transform{
-            math::XrQuaternionFToGlm(space_location.pose.orientation),
-            math::XrVector3FToGlm(space_location.pose.position),
-            {scale, scale, scale}});
-      }
-    } else {
-      // Tracking loss is expected when the hand is not active so only log a message if the hand is active.
-      if (input_.hand_active[hand] == XR_TRUE) {
-        const char *hand_name[] = {"left", "right"};
-        spdlog::debug("Unable to locate {} hand action space in app space: {}",
-                      hand_name[hand],
-                      magic_enum::enum_name(res));
-      }
+  // Views are submitted together, so every image of the frame is acquired up front and
+  // released only after the submission.
+  std::pmr::vector<uint32_t> swapchain_image_indices(snapshot.memory);
+  {
+    ScopedPhaseTimer timer(frame_timings_, snapshot.frame_id, FramePhase::ACQUIRE_SWAPCHAIN);
+    for (const Swapchain &swapchain: swapchains_) {
+      swapchain_image_indices.push_back(AcquireSwapchainImage(swapchain.handle));
     }
   }
 
-  // Render view to the appropriate part of the swapchain image.
-  for (uint32_t i = 0; i < view_count_output; i++) {
-    Swapchain view_swapchain = swapchains_[i];
-
-    XrSwapchainImageAcquireInfo acquire_info{};
-    acquire_info.type = XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO;
-
-    uint32_t swapchain_image_index = 0;
-    CHECK_XRCMD(xrAcquireSwapchainImage(view_swapchain.handle,
-                                        &acquire_info,
-                                        &swapchain_image_index));
-
-    XrSwapchainImageWaitInfo wait_info{};
-    wait_info.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO;
-    wait_info.timeout = XR_INFINITE_DURATION;
-    CHECK_XRCMD(xrWaitSwapchainImage(view_swapchain.handle, &wait_info));
-
-    projection_layer_views[i].type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW;
-    projection_layer_views[i].pose = views_[i].pose;
-    projection_layer_views[i].fov = views_[i].fov;
-    projection_layer_views[i].subImage.swapchain = view_swapchain.handle;
-    projection_layer_views[i].subImage.imageRect.offset = {0, 0};
-    projection_layer_views[i].subImage.imageRect.extent =
-        {view_swapchain.width, view_swapchain.height};
+  const auto kRecordStart = std::chrono::steady_clock::now();
+  graphics_plugin_->BeginFrame(snapshot.frame_id, snapshot.cubes);
+  frame_timings_.Record(snapshot.frame_id,
+                        FramePhase::GPU_WAIT,
+                        graphics_plugin_->GetLastFrameGpuWaitTime());
+  if (multiview_) {
+    // Render all views into the array layers of a single swapchain image.
+    Swapchain view_swapchain = swapchains_[0];
+    for (uint32_t i = 0; i < kViewCount; i++) {
+      projection_layer_views[i].type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW;
+      projection_layer_views[i].pose = views[i].pose;
+      projection_layer_views[i].fov = views[i].fov;
+      projection_layer_views[i].subImage.swapchain = view_swapchain.handle;
+      projection_layer_views[i].subImage.imageRect.offset = {0, 0};
+      projection_layer_views[i].subImage.imageRect.extent =
+          {kScaled(view_swapchain.width), kScaled(view_swapchain.height)};
+      projection_layer_views[i].subImage.imageArrayIndex = i;
+    }
+    graphics_plugin_->RenderMultiView(projection_layer_views,
+                                      swapchain_images_[view_swapchain.handle],
+                                      swapchain_image_indices[0]);
+  } else {
+    // Render view to the appropriate part of the swapchain image.
+    for (uint32_t i = 0; i < kViewCount; i++) {
+      Swapchain view_swapchain = swapchains_[i];
+
+      projection_layer_views[i].type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW;
+      projection_layer_views[i].pose = views[i].pose;
+      projection_layer_views[i].fov = views[i].fov;
+      projection_layer_views[i].subImage.swapchain = view_swapchain.handle;
+      projection_layer_views[i].subImage.imageRect.offset = {0, 0};
+      projection_layer_views[i].subImage.imageRect.extent =
+          {kScaled(view_swapchain.width), kScaled(view_swapchain.height)};
+
+      auto swapchain_image = swapchain_images_[view_swapchain.handle];
+      graphics_plugin_->RenderView(projection_layer_views[i],
+                                   swapchain_image,
+                                   swapchain_image_indices[i]);
+    }
+  }
+  frame_timings_.Record(snapshot.frame_id,
+                        FramePhase::RECORD,
+                        std::chrono::steady_clock::now() - kRecordStart);
+  {
+    ScopedPhaseTimer timer(frame_timings_, snapshot.frame_id, FramePhase::SUBMIT);
+#ifdef QUEST_XR_TRACING
+    traced_submits_[snapshot.frame_id % traced_submits_.size()] =
+        {snapshot.frame_id, trace::Now()};
+#endif
+    graphics_plugin_->EndFrame();
+  }
 
-    auto swapchain_image = swapchain_images_[view_swapchain.handle];
-    graphics_plugin_->RenderView(projection_layer_views[i],
-                                 swapchain_image,
-                                 swapchain_image_index,
-                                 cubes);
+  for (const Swapchain &swapchain: swapchains_) {
+    ReleaseSwapchainImage(swapchain.handle);
+  }
 
-    XrSwapchainImageReleaseInfo release_info{};
-    release_info.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO;
-    CHECK_XRCMD(xrReleaseSwapchainImage(view_swapchain.handle, &release_info));
+  const uint32_t kSubmitCount = graphics_plugin_->GetLastFrameSubmitCount();
+  if (kSubmitCount != last_frame_submit_count_) {
+    spdlog::info("Queue submits per frame changed {}->{}", last_frame_submit_count_, kSubmitCount);
+    last_frame_submit_count_ = kSubmitCount;
   }
 
   layer.space = app_space_;
@@ -741,7 +1263,33 @@ bool OpenXrProgram::RenderLayer(XrTime predicted_display_time,
   return true;
 }
 
+uint32_t OpenXrProgram::AcquireSwapchainImage(XrSwapchain swapchain) {
+  XrSwapchainImageAcquireInfo acquire_info{};
+  acquire_info.type = XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO;
+
+  uint32_t swapchain_image_index = 0;
+  {
+    TRACE_SCOPE("xrAcquireSwapchainImage");
+    CHECK_XRCMD(xrAcquireSwapchainImage(swapchain, &acquire_info, &swapchain_image_index));
+  }
+
+  XrSwapchainImageWaitInfo wait_info{};
+  wait_info.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO;
+  wait_info.timeout = XR_INFINITE_DURATION;
+  TRACE_SCOPE("xrWaitSwapchainImage");
+  CHECK_XRCMD(xrWaitSwapchainImage(swapchain, &wait_info));
+  return swapchain_image_index;
+}
+
+void OpenXrProgram::ReleaseSwapchainImage(XrSwapchain swapchain) {
+  XrSwapchainImageReleaseInfo release_info{};
+  release_info.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO;
+  TRACE_SCOPE("xrReleaseSwapchainImage");
+  CHECK_XRCMD(xrReleaseSwapchainImage(swapchain, &release_info));
+}
+
 OpenXrProgram::~OpenXrProgram() {
+  StopFramePipeline();
   if (input_.action_set != XR_NULL_HANDLE) {
     for (auto hand: {side::LEFT, side::RIGHT}) {
       xrDestroySpace(input_.hand_space[hand]);
@@ -3,9 +3,22 @@
 #include "platform.hpp"
 
 #include "graphics_plugin.hpp"
+#include "bounded_queue.hpp"
+#include "dynamic_resolution.hpp"
+#include "foveation.hpp"
+#include "frame_arena.hpp"
+#include "frame_timings.hpp"
+#include "input_log.hpp"
+#include "msaa_policy.hpp"
+#include "space_table.hpp"
 
 #include <array>
+#include <atomic>
+#include <exception>
 #include <map>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
 
 namespace side {
 const int LEFT = 0;
@@ -31,6 +44,24 @@ struct InputState {
   std::array<XrBool32, side::COUNT> hand_active{};
 };
 
+// Everything the render stage needs from a waited frame, built right after xrWaitFrame.
+// Containers allocate from the arena of the frame.
+struct FrameSnapshot {
+  uint64_t frame_id = 0;
+  std::pmr::memory_resource *memory = std::pmr::get_default_resource();
+  XrFrameState frame_state{XR_TYPE_FRAME_STATE};
+  bool views_valid = false;
+  std::pmr::vector<XrView> views{};
+  std::pmr::vector<math::Transform> cubes{};
+  // heap allocations of the simulation thread since its previous frame, 0 when the frame was
+  // waited on the thread that submits it
+  uint64_t simulation_allocations = 0;
+
+  FrameSnapshot() = default;
+  explicit FrameSnapshot(std::pmr::memory_resource *memory)
+      : memory(memory), views(memory), cubes(memory) {}
+};
+
 class OpenXrProgram {
  public:
   OpenXrProgram(std::shared_ptr<Platform> platform);
@@ -38,24 +69,83 @@ class OpenXrProgram {
   void CreateInstance();
   void InitializeSystem();
   void InitializeSession();
+
+  // Must be called before CreateSwapchains, swapchains are sized for the max scale.
+  void ConfigureDynamicResolution(const DynamicResolutionConfig &config);
+
   void CreateSwapchains();
 
+  // Writes the inputs of every following frame to an input log. Call after CreateSwapchains.
+  void RecordInputs(const std::string &path);
+
+  // Takes action states, views and space locations from an input log instead of the runtime,
+  // so runs render the same frames. The session is asked to exit at the end of the log. Call
+  // after CreateSwapchains.
+  void ReplayInputs(const std::string &path);
+
   void PollEvents();
   void PollActions();
   void RenderFrame();
 
+  // Moves frame waiting and simulation to one thread and recording and submission of the
+  // previous frame to another, so both overlap. The calling thread keeps polling events.
+  // Starting an already running pipeline only rethrows errors raised on the frame threads.
+  void StartFramePipeline();
+  void StopFramePipeline();
+  [[nodiscard]] bool IsFramePipelineRunning() const;
+
+  // Frames ended with xrEndFrame so far by either frame loop. May be called from any thread.
+  [[nodiscard]] uint64_t GetSubmittedFrameCount() const;
+
   bool IsSessionRunning() const;
 
+  // The runtime ended the session, e.g. after xrRequestExitSession.
+  [[nodiscard]] bool IsSessionExiting() const;
+
+  // Number of frames the gpu may lag behind the submitting thread. May be called from any
+  // thread, the render thread applies it before its next frame.
+  void SetMaxFramesInFlight(uint32_t count);
+
+  // Picks the msaa sample count. Before CreateSwapchains the policy is kept for it, afterwards
+  // the count is picked right away and the render thread rebuilds its render targets before
+  // its next frame. May be called from any thread once the swapchains exist.
+  void SetMsaaPolicy(const MsaaPolicy &policy);
+
+  // Foveates rendering with a fragment density map, off by default and on devices without
+  // support. Like SetMsaaPolicy the level is kept until CreateSwapchains and applied by the
+  // render thread before its next frame afterwards.
+  void SetFoveationLevel(FoveationLevel level);
+
+  [[nodiscard]] const FrameTimings &GetFrameTimings() const;
+
+  // Logs phase percentiles and writes the recorded frames to frame_timings.csv in the
+  // application data directory. Builds with QUEST_XR_TRACING also write trace.json there.
+  void DumpFrameTimings() const;
+
   ~OpenXrProgram();
  private:
   void InitializeActions();
   void CreateVisualizedSpaces();
+  void PollRecordedActions();
+  void UpdateInputFrame(const XrFrameState &frame_state);
 
   const XrEventDataBaseHeader *TryReadNextEvent();
   void HandleSessionStateChangedEvent(const XrEventDataSessionStateChanged &state_changed_event);
-  bool RenderLayer(XrTime predicted_display_time,
-                   std::vector<XrCompositionLayerProjectionView> &projection_layer_views,
+  FrameSnapshot WaitFrame();
+  void SubmitFrame(const FrameSnapshot &snapshot);
+  void SimulationLoop();
+  void RenderLoop();
+  void SetFramePipelineError(std::exception_ptr error);
+  void CheckFrameAllocations(const FrameSnapshot &snapshot);
+  void TraceGpuFrame(const GpuFrameTiming &gpu_frame) const;
+  [[nodiscard]] uint32_t PickMsaaSamples(const MsaaPolicy &policy) const;
+  void FetchVisibilityMask(uint32_t view_index);
+  void ApplyVisibilityMasks();
+  bool RenderLayer(const FrameSnapshot &snapshot,
+                   std::pmr::vector<XrCompositionLayerProjectionView> &projection_layer_views,
                    XrCompositionLayerProjection &layer);
+  uint32_t AcquireSwapchainImage(XrSwapchain swapchain);
+  void ReleaseSwapchainImage(XrSwapchain swapchain);
  private:
   std::shared_ptr<Platform> platform_;
   std::shared_ptr<GraphicsPlugin> graphics_plugin_;
@@ -69,17 +159,82 @@ class OpenXrProgram {
   std::vector<XrSpace> visualized_spaces_{};
   XrSpace app_space_ = XR_NULL_HANDLE;
 
+  bool locate_spaces_enabled_ = false;
+  bool visibility_mask_enabled_ = false;
+  PFN_xrGetVisibilityMaskKHR get_visibility_mask_ = nullptr;
+  // visualized spaces come first, followed by the hand spaces
+  std::unique_ptr<SpaceTable> space_table_;
+  std::array<uint32_t, side::COUNT> hand_space_indices_{};
+
   XrViewConfigurationType view_config_type_ = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
   std::vector<XrViewConfigurationView> config_views_;
   std::vector<XrView> views_;
 
+  // inputs of the frame being simulated, filled by the runtime or by the replay
+  InputFrame input_frame_{};
+  std::unique_ptr<InputRecorder> input_recorder_;
+  std::unique_ptr<InputReplay> input_replay_;
+  bool input_replay_finished_ = false;
+
+  // when set, a single swapchain with one array layer per view is used
+  bool multiview_ = false;
   std::vector<Swapchain> swapchains_;
   std::map<XrSwapchain, XrSwapchainImageBaseHeader *> swapchain_images_;
+  uint32_t last_frame_submit_count_ = 0;
+  // only used by the thread submitting frames
+  DynamicResolution dynamic_resolution_{DynamicResolutionConfig{}};
+  uint64_t last_gpu_frame_id_ = UINT64_MAX;
+  // 0 when no change is pending
+  std::atomic<uint32_t> requested_frames_in_flight_ = 0;
+  MsaaPolicy msaa_policy_{};
+  // 0 when no change is pending
+  std::atomic<uint32_t> requested_msaa_samples_ = 0;
+  FoveationLevel foveation_level_ = FoveationLevel::OFF;
+  std::atomic<FoveationLevel> requested_foveation_level_ = FoveationLevel::OFF;
+  std::atomic<bool> foveation_level_changed_ = false;
+  // hidden area meshes fetched by the event thread, handed to the graphics plugin by the render
+  // thread before its next frame
+  struct VisibilityMask {
+    bool changed = false;
+    std::vector<XrVector2f> vertices{};
+    std::vector<uint32_t> indices{};
+  };
+  std::mutex visibility_mask_mutex_;
+  std::vector<VisibilityMask> visibility_masks_{};
+  std::atomic<bool> visibility_masks_changed_ = false;
+  FrameTimings frame_timings_{};
+#ifdef QUEST_XR_TRACING
+  struct TracedSubmit {
+    uint64_t frame_id = UINT64_MAX;
+    uint64_t time_ns = 0;
+  };
+  // gpu results arrive a few frames after the submission they are placed at
+  std::array<TracedSubmit, 8> traced_submits_{};
+#endif
+
+  // a frame is waited while the previous one is queued and the one before it is submitted
+  static constexpr size_t kFrameArenaCount = 3;
+  std::array<FrameArena, kFrameArenaCount> frame_arenas_;
+  uint64_t last_allocation_count_ = 0;
+  // steady state frames that allocated on the render or the simulation thread
+  uint64_t allocating_frame_count_ = 0;
+  // set by the render thread for a frame that reconfigured rendering
+  bool skip_allocation_check_ = false;
 
   XrEventDataBuffer event_data_buffer_{};
 
   XrSessionState session_state_ = XR_SESSION_STATE_UNKNOWN;
-  bool session_running_ = false;
+  std::atomic<bool> session_running_ = false;
+
+  // at most one waited frame is queued, xrWaitFrame of the next frame blocks in the runtime
+  // until xrBeginFrame of the queued one was called
+  BoundedQueue<FrameSnapshot> frame_queue_{1};
+  std::atomic<bool> frame_pipeline_running_ = false;
+  std::atomic<uint64_t> submitted_frame_count_ = 0;
+  std::thread simulation_thread_;
+  std::thread render_thread_;
+  std::mutex frame_pipeline_error_mutex_;
+  std::exception_ptr frame_pipeline_error_ = nullptr;
 };
 
 std::shared_ptr<OpenXrProgram> CreateOpenXrProgram(std::shared_ptr<Platform> platform);
@@ -4,6 +4,7 @@
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <vector>
 
 void CheckResult(XrResult result, const std::string &file, uint32_t line) {
@@ -312,4 +313,24 @@ void LogActionSourceName(XrSession session, XrAction action, const std::string &
   spdlog::info("{} action is bound to {}",
                action_name.c_str(),
                !source_name.empty() ? source_name.c_str() : "nothing");
-}
\ No newline at end of file
+}
+bool IsInstanceExtensionSupported(const std::string &extension_name) {
+  uint32_t instance_extension_count;
+  CHECK_XRCMD(xrEnumerateInstanceExtensionProperties(nullptr,
+                                                     0,
+                                                     &instance_extension_count,
+                                                     nullptr));
+  std::vector<XrExtensionProperties> extensions(instance_extension_count);
+  for (XrExtensionProperties &extension: extensions) {
+    extension.type = XR_TYPE_EXTENSION_PROPERTIES;
+  }
+  CHECK_XRCMD(xrEnumerateInstanceExtensionProperties(nullptr,
+                                                     extensions.size(),
+                                                     &instance_extension_count,
+                                                     extensions.data()));
+  return std::any_of(extensions.begin(),
+                     extensions.end(),
+                     [&extension_name](const XrExtensionProperties &extension) {
+                       return extension_name == extension.extensionName;
+                     });
+}
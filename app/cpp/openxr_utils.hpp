@@ -14,4 +14,5 @@ void LogInstanceInfo(XrInstance instance);
 void LogViewConfigurations(XrInstance instance, XrSystemId system_id);
 void LogReferenceSpaces(XrSession session);
 void LogSystemProperties(XrInstance instance, XrSystemId system_id);
-void LogActionSourceName(XrSession session, XrAction action, const std::string &action_name);
\ No newline at end of file
+void LogActionSourceName(XrSession session, XrAction action, const std::string &action_name);
+bool IsInstanceExtensionSupported(const std::string &extension_name);
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "openxr-include.hpp"
 
 #include <memory>
+#include <string>
 #include <vector>
 
 class Platform {
@@ -11,6 +12,9 @@ class Platform {
 
   virtual std::vector<std::string> GetInstanceExtensions() const = 0;
 
+  // Writable directory private to the application.
+  virtual std::string GetApplicationDataPath() const = 0;
+
   virtual ~Platform() = default;
 };
 
@@ -5,7 +5,8 @@
 
 class AndroidPlatform : public Platform {
  public:
-  explicit AndroidPlatform(const std::shared_ptr<PlatformData> &data) {
+  explicit AndroidPlatform(const std::shared_ptr<PlatformData> &data)
+      : application_data_path_(data->application_data_path) {
     PFN_xrInitializeLoaderKHR initialize_loader = nullptr;
 
     if (XR_SUCCEEDED(xrGetInstanceProcAddr(XR_NULL_HANDLE, "xrInitializeLoaderKHR",
@@ -30,8 +31,13 @@ class AndroidPlatform : public Platform {
   [[nodiscard]] XrBaseInStructure *
   GetInstanceCreateExtension() const override { return (XrBaseInStructure *) (&instance_create_info_android_); }
 
+  [[nodiscard]] std::string GetApplicationDataPath() const override {
+    return application_data_path_;
+  }
+
  private:
   XrInstanceCreateInfoAndroidKHR instance_create_info_android_{};
+  std::string application_data_path_;
 };
 
 std::shared_ptr<Platform>
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <string>
+
 struct PlatformData {
   void *application_vm;
   void *application_activity;
+  std::string application_data_path;
 };
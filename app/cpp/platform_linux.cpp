@@ -0,0 +1,30 @@
+#include "platform.hpp"
+#include "platform_data.hpp"
+
+#include <string>
+
+class LinuxPlatform : public Platform {
+ public:
+  explicit LinuxPlatform(const std::shared_ptr<PlatformData> &data)
+      : application_data_path_(data->application_data_path) {}
+
+  [[nodiscard]] std::vector<std::string> GetInstanceExtensions() const override {
+    return {};
+  }
+
+  [[nodiscard]] XrBaseInStructure *GetInstanceCreateExtension() const override {
+    return nullptr;
+  }
+
+  [[nodiscard]] std::string GetApplicationDataPath() const override {
+    return application_data_path_;
+  }
+
+ private:
+  std::string application_data_path_;
+};
+
+std::shared_ptr<Platform>
+CreatePlatform(const std::shared_ptr<PlatformData> &data) {
+  return std::make_shared<LinuxPlatform>(data);
+}
@@ -0,0 +1,7 @@
+#version 460
+#pragma shader_stage(fragment)
+#extension GL_ARB_separate_shader_objects : enable
+
+// only depth is written
+void main(){
+}
@@ -0,0 +1,16 @@
+#version 460
+#pragma shader_stage(vertex)
+#extension GL_ARB_separate_shader_objects : enable
+
+// xy on the z = -1 plane of the view, z is the view index
+layout(location = 0) in vec3 position;
+
+layout(push_constant, std140) uniform UniformBufferObject {
+    mat4 projection;
+};
+
+void main() {
+    vec4 clip = projection * vec4(position.xy, -1.0, 1.0);
+    // on the near plane, every later fragment fails the depth test
+    gl_Position = vec4(clip.xy, 0.0, clip.w);
+}
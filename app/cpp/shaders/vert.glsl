@@ -4,14 +4,15 @@
 
 layout(location = 0) in vec4 position;
 layout(location = 1) in vec4 color;
+layout(location = 2) in mat4 model;
 
 layout(push_constant, std140) uniform UniformBufferObject {
-    mat4 mvp;
+    mat4 view_projection;
 };
 
 layout(location = 0) out vec4 v_color;
 
 void main() {
     v_color = color;
-    gl_Position = mvp * position;
-}
+    gl_Position = view_projection * model * position;
+}
\ No newline at end of file
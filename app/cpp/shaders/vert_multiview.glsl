@@ -0,0 +1,19 @@
+#version 460
+#pragma shader_stage(vertex)
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_multiview : enable
+
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in mat4 model;
+
+layout(push_constant, std140) uniform UniformBufferObject {
+    mat4 view_projection[2];
+};
+
+layout(location = 0) out vec4 v_color;
+
+void main() {
+    v_color = color;
+    gl_Position = view_projection[gl_ViewIndex] * model * position;
+}
\ No newline at end of file
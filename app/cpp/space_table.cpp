@@ -0,0 +1,117 @@
+#include "space_table.hpp"
+
+#include "openxr_utils.hpp"
+
+#include <stdexcept>
+
+namespace {
+constexpr XrSpaceLocationFlags kPoseValidFlags =
+    XR_SPACE_LOCATION_POSITION_VALID_BIT | XR_SPACE_LOCATION_ORIENTATION_VALID_BIT;
+}
+
+SpaceTable::SpaceTable(XrInstance instance, XrSession session, bool locate_spaces_enabled)
+    : session_(session) {
+#ifdef XR_KHR_locate_spaces
+  if (locate_spaces_enabled) {
+    CHECK_XRCMD(xrGetInstanceProcAddr(instance,
+                                      "xrLocateSpacesKHR",
+                                      reinterpret_cast<PFN_xrVoidFunction *>(&locate_spaces_)));
+  }
+#else
+  (void) instance;
+  (void) locate_spaces_enabled;
+#endif
+}
+
+uint32_t SpaceTable::Add(XrSpace space) {
+  spaces_.push_back(space);
+  positions_.emplace_back(0.0f);
+  orientations_.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+  valid_.push_back(0);
+  results_.push_back(XR_SUCCESS);
+#ifdef XR_KHR_locate_spaces
+  location_data_.push_back({});
+#endif
+  return static_cast<uint32_t>(spaces_.size() - 1);
+}
+
+void SpaceTable::Locate(XrSpace base_space, XrTime time) {
+  if (!LocateBatched(base_space, time)) {
+    LocateSeparately(base_space, time);
+  }
+}
+
+bool SpaceTable::LocateBatched(XrSpace base_space, XrTime time) {
+#ifdef XR_KHR_locate_spaces
+  if (locate_spaces_ == nullptr) {
+    return false;
+  }
+  XrSpacesLocateInfoKHR locate_info{XR_TYPE_SPACES_LOCATE_INFO_KHR};
+  locate_info.baseSpace = base_space;
+  locate_info.time = time;
+  locate_info.spaceCount = static_cast<uint32_t>(spaces_.size());
+  locate_info.spaces = spaces_.data();
+
+  XrSpaceLocationsKHR locations{XR_TYPE_SPACE_LOCATIONS_KHR};
+  locations.locationCount = static_cast<uint32_t>(location_data_.size());
+  locations.locations = location_data_.data();
+
+  const XrResult kResult = locate_spaces_(session_, &locate_info, &locations);
+  for (size_t i = 0; i < spaces_.size(); i++) {
+    results_[i] = kResult;
+    const auto &location = location_data_[i];
+    valid_[i] = XR_UNQUALIFIED_SUCCESS(kResult)
+        && (location.locationFlags & kPoseValidFlags) == kPoseValidFlags;
+    if (valid_[i]) {
+      positions_[i] = math::XrVector3FToGlm(location.pose.position);
+      orientations_[i] = math::XrQuaternionFToGlm(location.pose.orientation);
+    }
+  }
+  return true;
+#else
+  (void) base_space;
+  (void) time;
+  return false;
+#endif
+}
+
+void SpaceTable::LocateSeparately(XrSpace base_space, XrTime time) {
+  for (size_t i = 0; i < spaces_.size(); i++) {
+    XrSpaceLocation location{XR_TYPE_SPACE_LOCATION};
+    results_[i] = xrLocateSpace(spaces_[i], base_space, time, &location);
+    valid_[i] = XR_UNQUALIFIED_SUCCESS(results_[i])
+        && (location.locationFlags & kPoseValidFlags) == kPoseValidFlags;
+    if (valid_[i]) {
+      positions_[i] = math::XrVector3FToGlm(location.pose.position);
+      orientations_[i] = math::XrQuaternionFToGlm(location.pose.orientation);
+    }
+  }
+}
+
+bool SpaceTable::IsBatched() const {
+#ifdef XR_KHR_locate_spaces
+  return locate_spaces_ != nullptr;
+#else
+  return false;
+#endif
+}
+
+uint32_t SpaceTable::GetSize() const {
+  return static_cast<uint32_t>(spaces_.size());
+}
+
+bool SpaceTable::IsValid(uint32_t index) const {
+  return valid_.at(index) != 0;
+}
+
+const glm::vec3 &SpaceTable::GetPosition(uint32_t index) const {
+  return positions_.at(index);
+}
+
+const glm::quat &SpaceTable::GetOrientation(uint32_t index) const {
+  return orientations_.at(index);
+}
+
+XrResult SpaceTable::GetResult(uint32_t index) const {
+  return results_.at(index);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "openxr-include.hpp"
+#include "math_utils.h"
+
+#include <cstdint>
+#include <vector>
+
+// All spaces the application tracks, located together relative to one base space. With
+// XR_KHR_locate_spaces a frame costs one runtime call, otherwise every space is located on
+// its own. Results are kept as parallel arrays indexed by the value Add returned. The
+// extension path is only compiled when the OpenXR headers declare it.
+class SpaceTable {
+ private:
+  XrSession session_;
+#ifdef XR_KHR_locate_spaces
+  PFN_xrLocateSpacesKHR locate_spaces_ = nullptr;
+  std::vector<XrSpaceLocationDataKHR> location_data_{};
+#endif
+
+  std::vector<XrSpace> spaces_{};
+  std::vector<glm::vec3> positions_{};
+  std::vector<glm::quat> orientations_{};
+  std::vector<uint8_t> valid_{};
+  std::vector<XrResult> results_{};
+
+  void LocateSeparately(XrSpace base_space, XrTime time);
+  bool LocateBatched(XrSpace base_space, XrTime time);
+ public:
+  // locate_spaces_enabled tells whether XR_KHR_locate_spaces is enabled on the instance.
+  SpaceTable(XrInstance instance, XrSession session, bool locate_spaces_enabled);
+  SpaceTable(const SpaceTable &) = delete;
+
+  // The table does not own the space.
+  uint32_t Add(XrSpace space);
+
+  void Locate(XrSpace base_space, XrTime time);
+
+  [[nodiscard]] bool IsBatched() const;
+
+  [[nodiscard]] uint32_t GetSize() const;
+
+  // Both position and orientation of the space were valid at the last Locate.
+  [[nodiscard]] bool IsValid(uint32_t index) const;
+
+  [[nodiscard]] const glm::vec3 &GetPosition(uint32_t index) const;
+
+  [[nodiscard]] const glm::quat &GetOrientation(uint32_t index) const;
+
+  // Result of locating the space, only known per space without the extension.
+  [[nodiscard]] XrResult GetResult(uint32_t index) const;
+};
@@ -0,0 +1,129 @@
+#include "trace.hpp"
+
+#ifdef QUEST_XR_TRACING
+
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// 32k events of 32 bytes per thread, a few seconds of a fully traced frame loop
+constexpr uint64_t kThreadCapacity = 1 << 15;
+// threads are numbered from 1 in the order of their first event, the gpu track comes first
+constexpr uint32_t kGpuTid = 0;
+
+struct Event {
+  const char *name;
+  uint64_t start_ns;
+  uint64_t duration_ns;
+  trace::Track track;
+  uint32_t index;
+};
+
+struct ThreadBuffer {
+  uint32_t tid = 0;
+  std::atomic<const char *> name = nullptr;
+  // written by the owning thread only, count is published after the event is stored
+  std::atomic<uint64_t> count = 0;
+  std::array<Event, kThreadCapacity> events{};
+};
+
+struct Registry {
+  std::mutex mutex;
+  // buffers outlive their threads, so events of finished threads are still written
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry &GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+thread_local ThreadBuffer *thread_buffer = nullptr;
+
+ThreadBuffer &GetThreadBuffer() {
+  if (thread_buffer == nullptr) {
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->tid = static_cast<uint32_t>(registry.buffers.size()) + 1;
+    thread_buffer = buffer.get();
+    registry.buffers.push_back(std::move(buffer));
+  }
+  return *thread_buffer;
+}
+
+void WriteEvent(std::ofstream &file, uint32_t tid, const Event &event) {
+  file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+       << ",\"ts\":" << static_cast<double>(event.start_ns) / 1000.0
+       << ",\"dur\":" << static_cast<double>(event.duration_ns) / 1000.0;
+  if (event.index != trace::kNoIndex) {
+    file << ",\"args\":{\"index\":" << event.index << "}";
+  }
+  file << "}";
+}
+
+void WriteThreadName(std::ofstream &file, uint32_t tid, const std::string &name) {
+  file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+       << ",\"args\":{\"name\":\"" << name << "\"}}";
+}
+}
+
+uint64_t trace::Now() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void trace::SetThreadName(const char *name) {
+  GetThreadBuffer().name.store(name, std::memory_order_relaxed);
+}
+
+void trace::RecordEvent(const char *name,
+                        uint64_t start_ns,
+                        uint64_t duration_ns,
+                        Track track,
+                        uint32_t index) {
+  ThreadBuffer &buffer = GetThreadBuffer();
+  const uint64_t kCount = buffer.count.load(std::memory_order_relaxed);
+  buffer.events[kCount % kThreadCapacity] = {name, start_ns, duration_ns, track, index};
+  buffer.count.store(kCount + 1, std::memory_order_release);
+}
+
+void trace::WriteChromeTrace(const std::string &path) {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("failed to open " + path);
+  }
+  file.precision(3);
+  file << std::fixed << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+       << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"quest-xr\"}}";
+  WriteThreadName(file, kGpuTid, "gpu");
+
+  Registry &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  uint64_t event_count = 0;
+  for (const auto &buffer: registry.buffers) {
+    const char *kName = buffer->name.load(std::memory_order_relaxed);
+    WriteThreadName(file,
+                    buffer->tid,
+                    kName != nullptr ? kName : "thread " + std::to_string(buffer->tid));
+    const uint64_t kLast = buffer->count.load(std::memory_order_acquire);
+    const uint64_t kFirst = kLast > kThreadCapacity ? kLast - kThreadCapacity : 0;
+    for (uint64_t i = kFirst; i < kLast; i++) {
+      const Event &kEvent = buffer->events[i % kThreadCapacity];
+      WriteEvent(file, kEvent.track == Track::GPU ? kGpuTid : buffer->tid, kEvent);
+    }
+    event_count += kLast - kFirst;
+  }
+  file << "\n]}\n";
+  spdlog::info("Trace of {} events written to {}", event_count, path);
+}
+
+#endif
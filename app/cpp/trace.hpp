@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Scoped trace zones of the frame loop, written as Chrome trace event JSON that
+// ui.perfetto.dev and chrome://tracing open. Tracing is only compiled in with QUEST_XR_TRACING,
+// otherwise the macros expand to nothing and no trace symbols exist.
+#ifdef QUEST_XR_TRACING
+
+namespace trace {
+// Timeline an event is shown on, gpu work gets a track of its own next to the threads.
+enum class Track : uint32_t {
+  THREAD,
+  GPU,
+};
+
+constexpr uint32_t kNoIndex = UINT32_MAX;
+
+// Nanoseconds on the steady clock, the time base of all events.
+[[nodiscard]] uint64_t Now();
+
+// Names the track of the calling thread, name must be a static string.
+void SetThreadName(const char *name);
+
+// Appends a finished event to the buffer of the calling thread. Buffers are per thread rings,
+// appending never locks or allocates once the thread recorded its first event, and the oldest
+// events are overwritten when a ring is full. name must be a static string, index is shown as
+// an argument of the event unless it is kNoIndex.
+void RecordEvent(const char *name,
+                 uint64_t start_ns,
+                 uint64_t duration_ns,
+                 Track track = Track::THREAD,
+                 uint32_t index = kNoIndex);
+
+// Writes the buffered events of all threads. Threads may keep recording meanwhile, their
+// oldest events can then be overwritten while they are written. Throws when the file can not
+// be created.
+void WriteChromeTrace(const std::string &path);
+
+// Records the time between construction and destruction on the calling thread.
+class Scope {
+ private:
+  const char *name_;
+  uint64_t start_ns_;
+ public:
+  explicit Scope(const char *name) : name_(name), start_ns_(Now()) {}
+  Scope(const Scope &) = delete;
+  ~Scope() {
+    RecordEvent(name_, start_ns_, Now() - start_ns_);
+  }
+};
+}
+
+#define QUEST_XR_TRACE_CONCAT_IMPL(a, b) a##b
+#define QUEST_XR_TRACE_CONCAT(a, b) QUEST_XR_TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) const ::trace::Scope QUEST_XR_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) ::trace::SetThreadName(name)
+
+#else
+
+#define TRACE_SCOPE(name) static_cast<void>(0)
+#define TRACE_THREAD_NAME(name) static_cast<void>(0)
+
+#endif
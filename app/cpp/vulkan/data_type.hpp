@@ -24,6 +24,11 @@ enum class MemoryType {
   HOST_VISIBLE,
 };
 
+enum class VertexInputRate {
+  VERTEX,
+  INSTANCE,
+};
+
 enum class ShaderType {
   VERTEX,
   FRAGMENT,
@@ -39,5 +39,7 @@ struct RenderingPipelineConfig {
   FrontFace front_face = FrontFace::CW;
   bool enable_depth_test = false;
   CompareOp depth_function = CompareOp::LESS;
+  // depth only pipelines leave the color attachment untouched
+  bool enable_color_write = true;
 };
 }
@@ -1,5 +1,8 @@
 #include "vertex_buffer_layout.hpp"
 
+vulkan::VertexBufferLayout::VertexBufferLayout(VertexInputRate input_rate)
+    : input_rate_(input_rate) {}
+
 const std::vector<vulkan::VertexAttribute> &vulkan::VertexBufferLayout::GetElements() const {
   return elements_;
 }
@@ -15,3 +18,7 @@ size_t vulkan::VertexBufferLayout::GetElementSize() const {
   }
   return size;
 }
+
+vulkan::VertexInputRate vulkan::VertexBufferLayout::GetInputRate() const {
+  return input_rate_;
+}
@@ -15,13 +15,18 @@ struct VertexAttribute {
 class VertexBufferLayout {
  private:
   std::vector<VertexAttribute> elements_{};
+  VertexInputRate input_rate_ = VertexInputRate::VERTEX;
  public:
   VertexBufferLayout() = default;
 
+  explicit VertexBufferLayout(VertexInputRate input_rate);
+
   void Push(VertexAttribute attribute);
 
   [[nodiscard]] size_t GetElementSize() const;
 
   [[nodiscard]] const std::vector<VertexAttribute> &GetElements() const;
+
+  [[nodiscard]] VertexInputRate GetInputRate() const;
 };
 }
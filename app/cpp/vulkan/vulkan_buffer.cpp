@@ -5,6 +5,7 @@
 #include "vulkan_buffer.hpp"
 
 #include <cstring>
+#include <stdexcept>
 
 #include "vulkan_utils.hpp"
 
@@ -27,25 +28,18 @@ vulkan::VulkanBuffer::VulkanBuffer(const std::shared_ptr<VulkanRenderingContext>
 }
 
 void vulkan::VulkanBuffer::Update(const void *data) {
+  Update(data, size_in_bytes_, 0);
+}
+
+void vulkan::VulkanBuffer::Update(const void *data, size_t size, size_t offset) {
+  if (offset + size > size_in_bytes_) {
+    throw std::out_of_range("buffer update out of range");
+  }
   if (host_visible_) {
-    void *mapped_data = nullptr;
-    CHECK_VKCMD(vkMapMemory(device_,
-                            memory_,
-                            0,
-                            size_in_bytes_,
-                            0,
-                            &mapped_data));
-    memcpy(mapped_data, data, size_in_bytes_);
-    vkUnmapMemory(device_, memory_);
+    // host visible memory is persistently mapped by the allocator
+    memcpy(static_cast<char *>(memory_.mapped_data) + offset, data, size);
   } else {
-    VulkanBuffer tmp_buffer(this->context_,
-                            this->size_in_bytes_,
-                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                            GetVkMemoryType(MemoryType::HOST_VISIBLE));
-    tmp_buffer.Update(data);
-    context_->CopyBuffer(tmp_buffer.GetBuffer(),
-                         buffer_,
-                         size_in_bytes_);
+    context_->UploadBuffer(buffer_, data, size, offset);
   }
 }
 
@@ -65,8 +59,8 @@ VkBuffer vulkan::VulkanBuffer::GetBuffer() const {
 }
 
 vulkan::VulkanBuffer::~VulkanBuffer() {
-  vkDestroyBuffer(device_, buffer_, nullptr);
-  vkFreeMemory(device_, memory_, nullptr);
+  context_->DiscardPendingUploads(buffer_);
+  context_->DeferDestroy(VK_OBJECT_TYPE_BUFFER, buffer_, memory_);
 }
 
 size_t vulkan::VulkanBuffer::GetSizeInBytes() const {
@@ -16,6 +16,7 @@ class VulkanBuffer {
                VkBufferUsageFlags usage,
                VkMemoryPropertyFlags properties);
   void Update(const void *data);
+  void Update(const void *data, size_t size, size_t offset);
   void CopyFrom(std::shared_ptr<VulkanBuffer> src_buffer,
                 size_t size,
                 size_t src_offset,
@@ -28,7 +29,7 @@ class VulkanBuffer {
   VkDevice device_;
   size_t size_in_bytes_;
   VkBuffer buffer_ = nullptr;
-  VkDeviceMemory memory_ = nullptr;
+  MemoryAllocation memory_{};
  private:
   bool host_visible_;
 };
@@ -0,0 +1,116 @@
+#include "vulkan_command_batch.hpp"
+
+#include "vulkan_utils.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+vulkan::VulkanCommandBatch::VulkanCommandBatch(std::shared_ptr<VulkanRenderingContext> context)
+    : context_(std::move(context)) {}
+
+vulkan::VulkanCommandBatch::~VulkanCommandBatch() {
+  if (command_buffer_ != VK_NULL_HANDLE) {
+    context_->DiscardBatch(command_buffer_);
+  }
+}
+
+VkCommandBuffer vulkan::VulkanCommandBatch::GetCommandBuffer() {
+  if (command_buffer_ != VK_NULL_HANDLE) {
+    return command_buffer_;
+  }
+  command_buffer_ = context_->BeginBatch();
+  return command_buffer_;
+}
+
+void vulkan::VulkanCommandBatch::TransitionImageLayout(VkImage image,
+                                                       VkImageLayout old_layout,
+                                                       VkImageLayout new_layout) {
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = old_layout;
+  barrier.newLayout = new_layout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+  VkPipelineStageFlags source_stage;
+  VkPipelineStageFlags destination_stage;
+  if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED
+      && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  } else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
+      new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  } else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout ==
+      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+        | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    destination_stage =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  } else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout ==
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    destination_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  } else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout ==
+      VK_IMAGE_LAYOUT_FRAGMENT_DENSITY_MAP_OPTIMAL_EXT) {
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_FRAGMENT_DENSITY_MAP_READ_BIT_EXT;
+    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    destination_stage = VK_PIPELINE_STAGE_FRAGMENT_DENSITY_PROCESS_BIT_EXT;
+  } else {
+    throw std::invalid_argument("unsupported layout transition!");
+  }
+  vkCmdPipelineBarrier(
+      GetCommandBuffer(),
+      source_stage, destination_stage,
+      0,
+      0, nullptr,
+      0, nullptr,
+      1, &barrier
+  );
+}
+
+void vulkan::VulkanCommandBatch::CopyBuffer(VkBuffer src_buffer,
+                                            VkBuffer dst_buffer,
+                                            VkDeviceSize size,
+                                            VkDeviceSize src_offset,
+                                            VkDeviceSize dst_offset) {
+  VkBufferCopy copy_region = {};
+  copy_region.size = size;
+  copy_region.srcOffset = src_offset;
+  copy_region.dstOffset = dst_offset;
+  vkCmdCopyBuffer(GetCommandBuffer(), src_buffer, dst_buffer, 1, &copy_region);
+}
+
+bool vulkan::VulkanCommandBatch::IsEmpty() const {
+  return command_buffer_ == VK_NULL_HANDLE;
+}
+
+uint64_t vulkan::VulkanCommandBatch::Submit() {
+  if (IsEmpty()) {
+    return 0;
+  }
+  CHECK_VKCMD(vkEndCommandBuffer(command_buffer_));
+  // the context owns the command buffer from here on and frees it once it executed
+  const VkCommandBuffer kCommandBuffer = std::exchange(command_buffer_, VK_NULL_HANDLE);
+  return context_->SubmitBatch(kCommandBuffer);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "vulkan_rendering_context.hpp"
+
+#include <cstdint>
+#include <memory>
+
+namespace vulkan {
+// One-time commands like the layout transitions and copies of resource setup, recorded into a
+// single command buffer and submitted once. Submitting does not wait, frames submitted later
+// wait for the batch on the gpu and the cpu only blocks in VulkanRenderingContext::WaitForBatch.
+class VulkanCommandBatch {
+ private:
+  std::shared_ptr<VulkanRenderingContext> context_;
+  VkCommandBuffer command_buffer_ = VK_NULL_HANDLE;
+ public:
+  explicit VulkanCommandBatch(std::shared_ptr<VulkanRenderingContext> context);
+  VulkanCommandBatch(const VulkanCommandBatch &) = delete;
+  // Commands that were not submitted are dropped.
+  ~VulkanCommandBatch();
+
+  // Starts recording on first use, other commands of the batch may be recorded into it.
+  [[nodiscard]] VkCommandBuffer GetCommandBuffer();
+
+  void TransitionImageLayout(VkImage image, VkImageLayout old_layout, VkImageLayout new_layout);
+
+  void CopyBuffer(VkBuffer src_buffer,
+                  VkBuffer dst_buffer,
+                  VkDeviceSize size,
+                  VkDeviceSize src_offset = 0,
+                  VkDeviceSize dst_offset = 0);
+
+  [[nodiscard]] bool IsEmpty() const;
+
+  // Submits the recorded commands and leaves the batch empty for further recording. Returns
+  // the token to wait for, 0 when nothing was recorded.
+  uint64_t Submit();
+};
+}
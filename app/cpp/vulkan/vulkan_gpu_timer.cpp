@@ -0,0 +1,166 @@
+#include "vulkan_gpu_timer.hpp"
+
+#include "vulkan_utils.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <stdexcept>
+
+namespace {
+// the frame starts with this query, its end is written after the last scope
+constexpr uint32_t kFrameBeginQuery = 0;
+}
+
+vulkan::VulkanGpuTimer::VulkanGpuTimer(VkPhysicalDevice physical_device,
+                                       VkDevice device,
+                                       uint32_t slot_count)
+    : device_(device), slots_(slot_count), timestamps_(kMaxQueries) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+  if (properties.limits.timestampComputeAndGraphics != VK_TRUE) {
+    slots_.clear();
+    spdlog::warn("Gpu times are not available, the device does not support timestamps");
+    return;
+  }
+  timestamp_period_ns_ = properties.limits.timestampPeriod;
+  VkQueryPoolCreateInfo query_pool_info{
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = kMaxQueries,
+  };
+  for (Slot &slot: slots_) {
+    CHECK_VKCMD(vkCreateQueryPool(device_, &query_pool_info, nullptr, &slot.pool));
+  }
+}
+
+vulkan::VulkanGpuTimer::~VulkanGpuTimer() {
+  for (const Slot &slot: slots_) {
+    vkDestroyQueryPool(device_, slot.pool, nullptr);
+  }
+}
+
+bool vulkan::VulkanGpuTimer::IsSupported() const {
+  return !slots_.empty();
+}
+
+void vulkan::VulkanGpuTimer::BeginFrame(VkCommandBuffer command_buffer,
+                                        uint32_t slot,
+                                        uint64_t frame_id) {
+  if (!IsSupported()) {
+    return;
+  }
+  if (recording_ != nullptr) {
+    throw std::runtime_error("gpu timer frame is already being recorded");
+  }
+  Slot &frame_slot = slots_.at(slot);
+  ReadResults(frame_slot);
+
+  recording_ = &frame_slot;
+  frame_slot.frame_id = frame_id;
+  frame_slot.recorded = false;
+  frame_slot.query_count = 0;
+  frame_slot.scope_count = 0;
+  vkCmdResetQueryPool(command_buffer, frame_slot.pool, 0, kMaxQueries);
+  WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 1);
+}
+
+void vulkan::VulkanGpuTimer::EndFrame(VkCommandBuffer command_buffer) {
+  if (recording_ == nullptr) {
+    return;
+  }
+  // the frame end is always the last query of the slot
+  if (WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 1) != kNoScope) {
+    recording_->recorded = true;
+  }
+  recording_ = nullptr;
+}
+
+uint32_t vulkan::VulkanGpuTimer::BeginScope(VkCommandBuffer command_buffer,
+                                            const char *name,
+                                            uint32_t index,
+                                            uint32_t view_count) {
+  // two timestamps for the scope and one left for the end of the frame
+  if (recording_ == nullptr || recording_->scope_count == kMaxScopes
+      || recording_->query_count + 2 * view_count + 1 > kMaxQueries) {
+    return kNoScope;
+  }
+  const uint32_t kScope = recording_->scope_count++;
+  recording_->scopes[kScope] = {
+      .name = name,
+      .index = index,
+      .begin_query = WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, view_count),
+      .end_query = kNoScope,
+  };
+  return kScope;
+}
+
+void vulkan::VulkanGpuTimer::EndScope(VkCommandBuffer command_buffer,
+                                      uint32_t scope,
+                                      uint32_t view_count) {
+  if (recording_ == nullptr || scope == kNoScope) {
+    return;
+  }
+  recording_->scopes[scope].end_query =
+      WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, view_count);
+}
+
+std::optional<vulkan::GpuFrameTime> vulkan::VulkanGpuTimer::GetLastFrame() const {
+  return last_frame_;
+}
+
+uint32_t vulkan::VulkanGpuTimer::WriteTimestamp(VkCommandBuffer command_buffer,
+                                                VkPipelineStageFlagBits stage,
+                                                uint32_t query_count) {
+  if (recording_->query_count + query_count > kMaxQueries) {
+    return kNoScope;
+  }
+  const uint32_t kQuery = recording_->query_count;
+  vkCmdWriteTimestamp(command_buffer, stage, recording_->pool, kQuery);
+  recording_->query_count += query_count;
+  return kQuery;
+}
+
+void vulkan::VulkanGpuTimer::ReadResults(Slot &slot) {
+  if (!slot.recorded) {
+    return;
+  }
+  slot.recorded = false;
+  const VkResult kResult = vkGetQueryPoolResults(device_,
+                                                 slot.pool,
+                                                 0,
+                                                 slot.query_count,
+                                                 sizeof(uint64_t) * slot.query_count,
+                                                 timestamps_.data(),
+                                                 sizeof(uint64_t),
+                                                 VK_QUERY_RESULT_64_BIT);
+  if (kResult == VK_NOT_READY) {
+    return;
+  }
+  CHECK_VKCMD(kResult);
+
+  const uint64_t kFrameBegin = timestamps_[kFrameBeginQuery];
+  const auto kToDuration = [this, kFrameBegin](uint64_t timestamp) {
+    const uint64_t kTicks = timestamp > kFrameBegin ? timestamp - kFrameBegin : 0;
+    return std::chrono::nanoseconds(
+        static_cast<int64_t>(static_cast<double>(kTicks) * timestamp_period_ns_));
+  };
+  uint32_t scope_count = 0;
+  for (uint32_t i = 0; i < slot.scope_count; i++) {
+    const Scope &kScope = slot.scopes[i];
+    if (kScope.end_query == kNoScope) {
+      continue;
+    }
+    const auto kStart = kToDuration(timestamps_[kScope.begin_query]);
+    last_scopes_[scope_count++] = {
+        .name = kScope.name,
+        .index = kScope.index,
+        .start = kStart,
+        .duration = kToDuration(timestamps_[kScope.end_query]) - kStart,
+    };
+  }
+  last_frame_ = GpuFrameTime{
+      .frame_id = slot.frame_id,
+      .duration = kToDuration(timestamps_[slot.query_count - 1]),
+      .scopes = std::span<const GpuScopeTime>(last_scopes_.data(), scope_count),
+  };
+}
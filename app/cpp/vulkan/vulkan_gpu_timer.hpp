@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace vulkan {
+struct GpuScopeTime {
+  // static string naming the scope
+  const char *name;
+  // view or layer the scope covers
+  uint32_t index;
+  // start relative to the start of the frame
+  std::chrono::nanoseconds start;
+  std::chrono::nanoseconds duration;
+};
+
+struct GpuFrameTime {
+  uint64_t frame_id;
+  std::chrono::nanoseconds duration;
+  std::span<const GpuScopeTime> scopes;
+};
+
+// Times gpu work of frames with timestamp queries. Every frame slot owns a query pool that is
+// reset at the start of its frame, results are read without waiting once the slot is reused,
+// i.e. max frames in flight frames later. All storage is allocated up front.
+class VulkanGpuTimer {
+ public:
+  static constexpr uint32_t kMaxScopes = 32;
+  static constexpr uint32_t kNoScope = UINT32_MAX;
+ private:
+  // a timestamp written inside a multiview render pass takes one query per view
+  static constexpr uint32_t kMaxQueries = 256;
+
+  struct Scope {
+    const char *name;
+    uint32_t index;
+    uint32_t begin_query;
+    uint32_t end_query;
+  };
+
+  struct Slot {
+    VkQueryPool pool = VK_NULL_HANDLE;
+    uint64_t frame_id = 0;
+    bool recorded = false;
+    uint32_t query_count = 0;
+    uint32_t scope_count = 0;
+    std::array<Scope, kMaxScopes> scopes{};
+  };
+
+  VkDevice device_;
+  double timestamp_period_ns_ = 0.0;
+  std::vector<Slot> slots_{};
+  Slot *recording_ = nullptr;
+
+  std::vector<uint64_t> timestamps_{};
+  std::array<GpuScopeTime, kMaxScopes> last_scopes_{};
+  std::optional<GpuFrameTime> last_frame_{};
+
+  void ReadResults(Slot &slot);
+  uint32_t WriteTimestamp(VkCommandBuffer command_buffer,
+                          VkPipelineStageFlagBits stage,
+                          uint32_t query_count);
+ public:
+  VulkanGpuTimer(VkPhysicalDevice physical_device, VkDevice device, uint32_t slot_count);
+  VulkanGpuTimer(const VulkanGpuTimer &) = delete;
+  ~VulkanGpuTimer();
+
+  // False when the device can not time graphics work, every call is a no-op then.
+  [[nodiscard]] bool IsSupported() const;
+
+  // The previous frame of the slot must have completed on the gpu. Its results are read
+  // before the slot is reused for the frame with the given id.
+  void BeginFrame(VkCommandBuffer command_buffer, uint32_t slot, uint64_t frame_id);
+
+  void EndFrame(VkCommandBuffer command_buffer);
+
+  // view_count is the number of views of the render pass the scope is recorded in, 1 outside
+  // of render passes. Returns kNoScope when timing is not possible, ending it is a no-op then.
+  uint32_t BeginScope(VkCommandBuffer command_buffer,
+                      const char *name,
+                      uint32_t index,
+                      uint32_t view_count);
+
+  void EndScope(VkCommandBuffer command_buffer, uint32_t scope, uint32_t view_count);
+
+  // Most recent frame with available results, scopes stay valid until the next BeginFrame.
+  [[nodiscard]] std::optional<GpuFrameTime> GetLastFrame() const;
+};
+
+// Times the commands recorded during its lifetime.
+class GpuTimerScope {
+ private:
+  VulkanGpuTimer &timer_;
+  VkCommandBuffer command_buffer_;
+  uint32_t view_count_;
+  uint32_t scope_;
+ public:
+  GpuTimerScope(VulkanGpuTimer &timer,
+                VkCommandBuffer command_buffer,
+                const char *name,
+                uint32_t index,
+                uint32_t view_count = 1)
+      : timer_(timer),
+        command_buffer_(command_buffer),
+        view_count_(view_count),
+        scope_(timer.BeginScope(command_buffer, name, index, view_count)) {}
+  GpuTimerScope(const GpuTimerScope &) = delete;
+  ~GpuTimerScope() {
+    timer_.EndScope(command_buffer_, scope_, view_count_);
+  }
+};
+}
@@ -0,0 +1,280 @@
+#include "vulkan_memory_allocator.hpp"
+
+#include "vulkan_utils.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+constexpr VkDeviceSize kMaxBlockSize = 64ull * 1024 * 1024;
+constexpr VkDeviceSize kMinBlockSize = 1ull * 1024 * 1024;
+
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+}
+
+vulkan::VulkanMemoryAllocator::VulkanMemoryAllocator(VkPhysicalDevice physical_device,
+                                                     VkDevice device)
+    : device_(device) {
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties_);
+
+  VkPhysicalDeviceProperties physical_device_properties;
+  vkGetPhysicalDeviceProperties(physical_device, &physical_device_properties);
+  buffer_image_granularity_ = physical_device_properties.limits.bufferImageGranularity;
+
+  for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; i++) {
+    const VkDeviceSize kHeapSize =
+        memory_properties_.memoryHeaps[memory_properties_.memoryTypes[i].heapIndex].size;
+    // small heaps (e.g. device local host visible windows) get proportionally smaller blocks
+    block_sizes_[i] = std::max(kMinBlockSize, std::min(kMaxBlockSize, kHeapSize / 8));
+  }
+}
+
+uint32_t vulkan::VulkanMemoryAllocator::FindMemoryType(uint32_t type_filter,
+                                                       VkMemoryPropertyFlags properties) const {
+  for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; i++) {
+    if (type_filter & (1u << i)
+        && (memory_properties_.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+  throw std::runtime_error("failed to find suitable memory type!");
+}
+
+bool vulkan::VulkanMemoryAllocator::HasMemoryType(uint32_t type_filter,
+                                                  VkMemoryPropertyFlags properties) const {
+  for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; i++) {
+    if (type_filter & (1u << i)
+        && (memory_properties_.memoryTypes[i].propertyFlags & properties) == properties) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t vulkan::VulkanMemoryAllocator::GetPoolKind(bool linear) const {
+  if (buffer_image_granularity_ <= 1) {
+    return 0;
+  }
+  return linear ? 0 : 1;
+}
+
+std::unique_ptr<vulkan::VulkanMemoryAllocator::Block>
+vulkan::VulkanMemoryAllocator::CreateBlock(uint32_t memory_type_index,
+                                           VkDeviceSize size,
+                                           const void *next) {
+  auto block = std::make_unique<Block>();
+  VkMemoryAllocateInfo alloc_info = {};
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.pNext = next;
+  alloc_info.allocationSize = size;
+  alloc_info.memoryTypeIndex = memory_type_index;
+  if (vkAllocateMemory(device_, &alloc_info, nullptr, &block->memory) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate device memory block!");
+  }
+  block->size = size;
+  block->free_ranges[0] = size;
+  if (memory_properties_.memoryTypes[memory_type_index].propertyFlags
+      & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    // host visible blocks stay mapped for their whole lifetime, a VkDeviceMemory can not be
+    // mapped twice by the sub-allocations sharing it
+    CHECK_VKCMD(vkMapMemory(device_, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped_data));
+  }
+  return block;
+}
+
+void vulkan::VulkanMemoryAllocator::DestroyBlock(const Block &block) {
+  if (block.mapped_data != nullptr) {
+    vkUnmapMemory(device_, block.memory);
+  }
+  vkFreeMemory(device_, block.memory, nullptr);
+}
+
+bool vulkan::VulkanMemoryAllocator::TryAllocateFromBlock(Block &block,
+                                                         VkDeviceSize size,
+                                                         VkDeviceSize alignment,
+                                                         VkDeviceSize *offset) {
+  for (auto it = block.free_ranges.begin(); it != block.free_ranges.end(); ++it) {
+    const VkDeviceSize kRangeOffset = it->first;
+    const VkDeviceSize kRangeSize = it->second;
+    const VkDeviceSize kAlignedOffset = AlignUp(kRangeOffset, alignment);
+    const VkDeviceSize kPadding = kAlignedOffset - kRangeOffset;
+    if (kRangeSize < kPadding + size) {
+      continue;
+    }
+    block.free_ranges.erase(it);
+    if (kPadding > 0) {
+      block.free_ranges[kRangeOffset] = kPadding;
+    }
+    const VkDeviceSize kTail = kRangeSize - kPadding - size;
+    if (kTail > 0) {
+      block.free_ranges[kAlignedOffset + size] = kTail;
+    }
+    block.used += size;
+    *offset = kAlignedOffset;
+    return true;
+  }
+  return false;
+}
+
+void vulkan::VulkanMemoryAllocator::ReturnToBlock(Block &block,
+                                                  VkDeviceSize offset,
+                                                  VkDeviceSize size) {
+  block.used -= size;
+  VkDeviceSize range_offset = offset;
+  VkDeviceSize range_size = size;
+  auto next = block.free_ranges.lower_bound(offset);
+  if (next != block.free_ranges.end() && offset + size == next->first) {
+    range_size += next->second;
+    next = block.free_ranges.erase(next);
+  }
+  if (next != block.free_ranges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == range_offset) {
+      prev->second += range_size;
+      return;
+    }
+  }
+  block.free_ranges[range_offset] = range_size;
+}
+
+vulkan::MemoryAllocation vulkan::VulkanMemoryAllocator::Allocate(
+    const VkMemoryRequirements &requirements,
+    VkMemoryPropertyFlags properties,
+    bool linear,
+    const VkMemoryDedicatedAllocateInfo *dedicated_info) {
+  MemoryAllocation allocation{};
+  allocation.memory_type_index = FindMemoryType(requirements.memoryTypeBits, properties);
+  allocation.size = requirements.size;
+  allocation.linear = linear;
+  allocation.lazily_allocated =
+      (memory_properties_.memoryTypes[allocation.memory_type_index].propertyFlags
+          & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  const VkDeviceSize kBlockSize = block_sizes_[allocation.memory_type_index];
+  if (dedicated_info != nullptr || requirements.size > kBlockSize / 2) {
+    auto block = CreateBlock(allocation.memory_type_index, requirements.size, dedicated_info);
+    allocation.memory = block->memory;
+    allocation.mapped_data = block->mapped_data;
+    allocation.dedicated = true;
+    auto &stats = dedicated_stats_[allocation.memory_type_index];
+    stats.count++;
+    stats.bytes += requirements.size;
+    return allocation;
+  }
+
+  auto &pool = pools_[allocation.memory_type_index][GetPoolKind(linear)];
+  Block *target = nullptr;
+  for (auto &block: pool.blocks) {
+    if (TryAllocateFromBlock(*block, requirements.size, requirements.alignment,
+                             &allocation.offset)) {
+      target = block.get();
+      break;
+    }
+  }
+  if (target == nullptr) {
+    pool.blocks.emplace_back(CreateBlock(allocation.memory_type_index, kBlockSize));
+    target = pool.blocks.back().get();
+    if (!TryAllocateFromBlock(*target, requirements.size, requirements.alignment,
+                              &allocation.offset)) {
+      throw std::runtime_error("failed to sub-allocate from a new block");
+    }
+  }
+  allocation.memory = target->memory;
+  if (target->mapped_data != nullptr) {
+    allocation.mapped_data = static_cast<char *>(target->mapped_data) + allocation.offset;
+  }
+  return allocation;
+}
+
+void vulkan::VulkanMemoryAllocator::Free(const MemoryAllocation &allocation) {
+  if (allocation.memory == VK_NULL_HANDLE) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (allocation.dedicated) {
+    Block block{};
+    block.memory = allocation.memory;
+    block.mapped_data = allocation.mapped_data;
+    DestroyBlock(block);
+    auto &stats = dedicated_stats_[allocation.memory_type_index];
+    stats.count--;
+    stats.bytes -= allocation.size;
+    return;
+  }
+
+  auto &pool = pools_[allocation.memory_type_index][GetPoolKind(allocation.linear)];
+  auto it = std::find_if(pool.blocks.begin(), pool.blocks.end(),
+                         [&](const std::unique_ptr<Block> &block) {
+                           return block->memory == allocation.memory;
+                         });
+  if (it == pool.blocks.end()) {
+    throw std::runtime_error("freeing memory that does not belong to the allocator");
+  }
+  ReturnToBlock(**it, allocation.offset, allocation.size);
+  // keep one empty block around so a free/allocate pattern does not hit the driver each time
+  if ((*it)->used == 0 && pool.blocks.size() > 1) {
+    DestroyBlock(**it);
+    pool.blocks.erase(it);
+  }
+}
+
+std::vector<vulkan::MemoryTypeStats> vulkan::VulkanMemoryAllocator::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<MemoryTypeStats> result{};
+  for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; i++) {
+    MemoryTypeStats stats{};
+    stats.memory_type_index = i;
+    stats.dedicated_allocation_count = dedicated_stats_[i].count;
+    stats.reserved_bytes = dedicated_stats_[i].bytes;
+    stats.live_bytes = dedicated_stats_[i].bytes;
+    VkDeviceSize total_free = 0;
+    VkDeviceSize largest_free = 0;
+    for (const auto &pool: pools_[i]) {
+      for (const auto &block: pool.blocks) {
+        stats.block_count++;
+        stats.reserved_bytes += block->size;
+        stats.live_bytes += block->used;
+        for (const auto &[offset, size]: block->free_ranges) {
+          total_free += size;
+          largest_free = std::max(largest_free, size);
+        }
+      }
+    }
+    if (total_free > 0) {
+      stats.fragmentation =
+          1.0F - static_cast<float>(largest_free) / static_cast<float>(total_free);
+    }
+    if (stats.reserved_bytes > 0) {
+      result.emplace_back(stats);
+    }
+  }
+  return result;
+}
+
+void vulkan::VulkanMemoryAllocator::LogStats() const {
+  for (const auto &stats: GetStats()) {
+    spdlog::info("Memory type {}: blocks={} dedicated={} reserved={}KiB live={}KiB "
+                 "fragmentation={:.2f}",
+                 stats.memory_type_index,
+                 stats.block_count,
+                 stats.dedicated_allocation_count,
+                 stats.reserved_bytes / 1024,
+                 stats.live_bytes / 1024,
+                 stats.fragmentation);
+  }
+}
+
+vulkan::VulkanMemoryAllocator::~VulkanMemoryAllocator() {
+  for (const auto &type_pools: pools_) {
+    for (const auto &pool: type_pools) {
+      for (const auto &block: pool.blocks) {
+        DestroyBlock(*block);
+      }
+    }
+  }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vulkan {
+struct MemoryAllocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  uint32_t memory_type_index = 0;
+  // points at offset inside the persistently mapped block, nullptr for non host visible memory
+  void *mapped_data = nullptr;
+  // the memory is not shared with other resources
+  bool dedicated = false;
+  bool linear = true;
+  bool lazily_allocated = false;
+};
+
+struct MemoryTypeStats {
+  uint32_t memory_type_index = 0;
+  uint32_t block_count = 0;
+  uint32_t dedicated_allocation_count = 0;
+  // bytes allocated from the driver, including dedicated allocations
+  VkDeviceSize reserved_bytes = 0;
+  // bytes handed out to resources
+  VkDeviceSize live_bytes = 0;
+  // 1 - largest free range / total free bytes of the blocks, 0 means no fragmentation
+  float fragmentation = 0.0F;
+};
+
+// Sub-allocates resources from large VkDeviceMemory blocks, one set of blocks per memory type.
+// When bufferImageGranularity is bigger than 1 linear (buffers) and non linear (optimal
+// tiling images) resources are placed in separate blocks, so they never share a granularity
+// page.
+class VulkanMemoryAllocator {
+ private:
+  struct Block {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    VkDeviceSize used = 0;
+    void *mapped_data = nullptr;
+    // offset -> size, adjacent ranges are always merged
+    std::map<VkDeviceSize, VkDeviceSize> free_ranges{};
+  };
+  struct Pool {
+    std::vector<std::unique_ptr<Block>> blocks{};
+  };
+  struct DedicatedStats {
+    uint32_t count = 0;
+    VkDeviceSize bytes = 0;
+  };
+
+  VkDevice device_;
+  VkPhysicalDeviceMemoryProperties memory_properties_{};
+  VkDeviceSize buffer_image_granularity_ = 1;
+  std::array<VkDeviceSize, VK_MAX_MEMORY_TYPES> block_sizes_{};
+
+  mutable std::mutex mutex_;
+  std::array<std::array<Pool, 2>, VK_MAX_MEMORY_TYPES> pools_{};
+  std::array<DedicatedStats, VK_MAX_MEMORY_TYPES> dedicated_stats_{};
+
+  [[nodiscard]] size_t GetPoolKind(bool linear) const;
+  std::unique_ptr<Block> CreateBlock(uint32_t memory_type_index,
+                                     VkDeviceSize size,
+                                     const void *next = nullptr);
+  void DestroyBlock(const Block &block);
+  static bool TryAllocateFromBlock(Block &block,
+                                   VkDeviceSize size,
+                                   VkDeviceSize alignment,
+                                   VkDeviceSize *offset);
+  static void ReturnToBlock(Block &block, VkDeviceSize offset, VkDeviceSize size);
+ public:
+  VulkanMemoryAllocator(VkPhysicalDevice physical_device, VkDevice device);
+  VulkanMemoryAllocator(const VulkanMemoryAllocator &) = delete;
+
+  [[nodiscard]] uint32_t FindMemoryType(uint32_t type_filter,
+                                        VkMemoryPropertyFlags properties) const;
+
+  [[nodiscard]] bool HasMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+
+  // With dedicated_info the memory is allocated for the image or buffer it names, which the
+  // driver may require or prefer for the resource. Requests too large to share a block get
+  // memory of their own too, without naming their resource.
+  MemoryAllocation Allocate(const VkMemoryRequirements &requirements,
+                            VkMemoryPropertyFlags properties,
+                            bool linear,
+                            const VkMemoryDedicatedAllocateInfo *dedicated_info = nullptr);
+
+  void Free(const MemoryAllocation &allocation);
+
+  [[nodiscard]] std::vector<MemoryTypeStats> GetStats() const;
+
+  void LogStats() const;
+
+  virtual ~VulkanMemoryAllocator();
+};
+}
@@ -1,21 +1,78 @@
 #include "vulkan_rendering_context.hpp"
 
+#include "vulkan_command_batch.hpp"
+#include "vulkan_utils.hpp"
+
+#include <magic_enum.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
 #include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
+namespace {
+// Written in front of the driver's cache data. The Vulkan cache header does not carry the
+// driver version, but caches of another driver version are rejected or even misused by some
+// drivers, so it is checked here too.
+struct PipelineCachePrefix {
+  uint32_t magic;
+  uint32_t vendor_id;
+  uint32_t device_id;
+  uint32_t driver_version;
+  uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+  uint64_t data_size;
+};
+constexpr uint32_t kPipelineCacheMagic = 0x51585043;  // QXPC
+
+// images of at least this size get a dedicated allocation instead of filling most of a block
+constexpr VkDeviceSize kDedicatedImageSize = 8ull * 1024 * 1024;
+constexpr VkDeviceSize kStagingRingSize = 8ull * 1024 * 1024;
+constexpr VkDeviceSize kStagingAlignment = 16;
+// until SetMsaaSamples picks a count
+constexpr uint32_t kDefaultMsaaSamples = 4;
+
+bool IsDepthFormat(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+      return true;
+    default:
+      return false;
+  }
+}
+}
+
 vulkan::VulkanRenderingContext::VulkanRenderingContext(
     VkPhysicalDevice physical_device,
     VkDevice device,
     VkQueue graphics_queue,
     VkCommandPool graphics_pool,
-    VkFormat color_attachment_format) :
+    VkFormat color_attachment_format,
+    uint32_t view_count,
+    bool fragment_density_map_supported,
+    std::string pipeline_cache_path) :
     color_attachment_format_(color_attachment_format),
     physical_device_(physical_device),
     device_(device),
     graphics_queue_(graphics_queue),
     graphics_pool_(graphics_pool),
-    recommended_msaa_samples_(GetMaxUsableSampleCount()) {
+    msaa_samples_(ClampMsaaSamples(kDefaultMsaaSamples)),
+    view_count_(view_count),
+    fragment_density_map_supported_(fragment_density_map_supported),
+    allocator_(std::make_unique<VulkanMemoryAllocator>(physical_device, device)),
+    pipeline_cache_path_(std::move(pipeline_cache_path)) {
+  if (view_count_ == 0 || view_count_ > 32) {
+    throw std::invalid_argument("unsupported view count");
+  }
 
   depth_attachment_format_ = FindSupportedFormat(
       {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
@@ -23,15 +80,36 @@ vulkan::VulkanRenderingContext::VulkanRenderingContext(
       VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
   );
 
-  ///render pass
+  if (fragment_density_map_supported_) {
+    VkPhysicalDeviceFragmentDensityMapPropertiesEXT density_map_properties{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_DENSITY_MAP_PROPERTIES_EXT,
+    };
+    VkPhysicalDeviceProperties2 properties2{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &density_map_properties,
+    };
+    vkGetPhysicalDeviceProperties2(physical_device_, &properties2);
+    // the coarsest texels the device accepts keep density maps smallest
+    density_map_texel_size_ = density_map_properties.maxFragmentDensityTexelSize;
+  }
+
+  CreateRenderPass();
+
+  CreateFrameResources();
+  CreatePipelineCache();
+}
+
+void vulkan::VulkanRenderingContext::CreateRenderPass() {
   VkAttachmentDescription depth_attachment = {};
   depth_attachment.format = depth_attachment_format_;
-  depth_attachment.samples = recommended_msaa_samples_;
+  depth_attachment.samples = msaa_samples_;
+  // depth (and stencil of combined formats) only lives in tile memory: cleared on load, never
+  // stored, so the previous contents are never read either
   depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  depth_attachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference depth_attachment_ref = {};
@@ -40,9 +118,11 @@ vulkan::VulkanRenderingContext::VulkanRenderingContext(
 
   VkAttachmentDescription color_attachment = {};
   color_attachment.format = color_attachment_format_;
-  color_attachment.samples = recommended_msaa_samples_;
+  color_attachment.samples = msaa_samples_;
+  // a multisampled color is resolved at the end of the subpass, its samples never leave tile
+  // memory
   color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -55,6 +135,7 @@ vulkan::VulkanRenderingContext::VulkanRenderingContext(
   VkAttachmentDescription color_attachment_resolve = {};
   color_attachment_resolve.format = color_attachment_format_;
   color_attachment_resolve.samples = VK_SAMPLE_COUNT_1_BIT;
+  // the resolve overwrites the render area, only the swapchain image is written to memory
   color_attachment_resolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   color_attachment_resolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   color_attachment_resolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -76,15 +157,47 @@ vulkan::VulkanRenderingContext::VulkanRenderingContext(
   VkSubpassDependency dependency = {};
   dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
   dependency.dstSubpass = 0;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.srcAccessMask = 0;
-  dependency.dstAccessMask =
-      VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  // passes and frames in flight share the multisampled targets, the clears of a pass wait for
+  // the attachment writes of the one before
+  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+      | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+      | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependency.srcAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+      | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
   dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
-  std::array<VkAttachmentDescription, 3>
-      attachments = {color_attachment, depth_attachment, color_attachment_resolve};
+  std::vector<VkAttachmentDescription> attachments =
+      {color_attachment, depth_attachment, color_attachment_resolve};
+  if (!IsMsaaEnabled()) {
+    // without msaa the swapchain image is the color attachment and nothing is resolved
+    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments = {color_attachment, depth_attachment};
+    sub_pass.pResolveAttachments = nullptr;
+  }
+
+  // the density map is read before rasterization and never written by the pass
+  VkAttachmentDescription density_map_attachment = {};
+  density_map_attachment.format = kDensityMapFormat;
+  density_map_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  density_map_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  density_map_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  density_map_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  density_map_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  density_map_attachment.initialLayout = VK_IMAGE_LAYOUT_FRAGMENT_DENSITY_MAP_OPTIMAL_EXT;
+  density_map_attachment.finalLayout = VK_IMAGE_LAYOUT_FRAGMENT_DENSITY_MAP_OPTIMAL_EXT;
+
+  VkRenderPassFragmentDensityMapCreateInfoEXT density_map_info = {};
+  density_map_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_FRAGMENT_DENSITY_MAP_CREATE_INFO_EXT;
+  density_map_info.fragmentDensityMapAttachment.attachment =
+      static_cast<uint32_t>(attachments.size());
+  density_map_info.fragmentDensityMapAttachment.layout =
+      VK_IMAGE_LAYOUT_FRAGMENT_DENSITY_MAP_OPTIMAL_EXT;
+  if (foveation_enabled_) {
+    attachments.push_back(density_map_attachment);
+  }
 
   VkRenderPassCreateInfo render_pass_info = {};
   render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -95,37 +208,276 @@ vulkan::VulkanRenderingContext::VulkanRenderingContext(
   render_pass_info.dependencyCount = 1;
   render_pass_info.pDependencies = &dependency;
 
+  // all views share the same geometry, so they are correlated for the implementation to
+  // optimize visibility work across them
+  const uint32_t kViewMask = (1u << view_count_) - 1u;
+  VkRenderPassMultiviewCreateInfo multiview_info = {};
+  multiview_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+  multiview_info.subpassCount = 1;
+  multiview_info.pViewMasks = &kViewMask;
+  multiview_info.correlationMaskCount = 1;
+  multiview_info.pCorrelationMasks = &kViewMask;
+  if (view_count_ > 1) {
+    render_pass_info.pNext = &multiview_info;
+  }
+  if (foveation_enabled_) {
+    density_map_info.pNext = render_pass_info.pNext;
+    render_pass_info.pNext = &density_map_info;
+  }
+
   if (vkCreateRenderPass(device_, &render_pass_info, nullptr, &render_pass_) != VK_SUCCESS) {
     throw std::runtime_error("failed to create render pass!");
   }
 }
 
-VkSampleCountFlagBits vulkan::VulkanRenderingContext::GetMaxUsableSampleCount() {
-  VkPhysicalDeviceProperties physical_device_properties;
-  vkGetPhysicalDeviceProperties(physical_device_,
-                                &physical_device_properties);
-  VkSampleCountFlags
-      counts = std::min(physical_device_properties.limits.framebufferColorSampleCounts,
-                        physical_device_properties.limits.framebufferDepthSampleCounts);
-  if (counts & VK_SAMPLE_COUNT_64_BIT) {
-    return VK_SAMPLE_COUNT_64_BIT;
+void vulkan::VulkanRenderingContext::CreateFrameResources() {
+  frame_command_buffers_.resize(kMaxFramesInFlight);
+  VkCommandBufferAllocateInfo alloc_info = {};
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.commandPool = graphics_pool_;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandBufferCount = static_cast<uint32_t>(frame_command_buffers_.size());
+  CHECK_VKCMD(vkAllocateCommandBuffers(device_, &alloc_info, frame_command_buffers_.data()));
+
+  VkSemaphoreTypeCreateInfoKHR timeline_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+      .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+      .initialValue = 0,
+  };
+  VkSemaphoreCreateInfo semaphore_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = &timeline_info,
+  };
+  CHECK_VKCMD(vkCreateSemaphore(device_, &semaphore_info, nullptr, &frame_timeline_));
+  CHECK_VKCMD(vkCreateSemaphore(device_, &semaphore_info, nullptr, &batch_timeline_));
+  // core entry points on Vulkan 1.2 devices, the extension ones otherwise
+  wait_semaphores_ = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+      vkGetDeviceProcAddr(device_, "vkWaitSemaphores"));
+  get_semaphore_counter_value_ = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+      vkGetDeviceProcAddr(device_, "vkGetSemaphoreCounterValue"));
+  if (wait_semaphores_ == nullptr || get_semaphore_counter_value_ == nullptr) {
+    wait_semaphores_ = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+        vkGetDeviceProcAddr(device_, "vkWaitSemaphoresKHR"));
+    get_semaphore_counter_value_ = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+        vkGetDeviceProcAddr(device_, "vkGetSemaphoreCounterValueKHR"));
+  }
+  if (wait_semaphores_ == nullptr || get_semaphore_counter_value_ == nullptr) {
+    throw std::runtime_error("timeline semaphore functions are not available");
+  }
+
+  gpu_timer_ = std::make_unique<VulkanGpuTimer>(physical_device_, device_, kMaxFramesInFlight);
+
+  CreateBuffer(kStagingRingSize,
+               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               GetVkMemoryType(MemoryType::HOST_VISIBLE),
+               &staging_buffer_,
+               &staging_memory_);
+  staging_ring_ = std::make_unique<VulkanStagingRing>(staging_buffer_,
+                                                      staging_memory_.mapped_data,
+                                                      kStagingRingSize);
+}
+
+void vulkan::VulkanRenderingContext::UploadBuffer(VkBuffer dst_buffer,
+                                                  const void *data,
+                                                  VkDeviceSize size,
+                                                  VkDeviceSize dst_offset) {
+  VkDeviceSize staging_offset = 0;
+  void *staging_data = nullptr;
+  bool staged = staging_ring_->Allocate(size, kStagingAlignment, &staging_offset, &staging_data);
+  if (!staged) {
+    // ranges of frames that completed since the last BeginFrame are free already
+    uint64_t completed_frames = 0;
+    CHECK_VKCMD(get_semaphore_counter_value_(device_, frame_timeline_, &completed_frames));
+    if (completed_frames > 0) {
+      staging_ring_->Retire(completed_frames - 1);
+      staged = staging_ring_->Allocate(size, kStagingAlignment, &staging_offset, &staging_data);
+    }
+  }
+  VkBuffer staging_buffer = staging_buffer_;
+  if (!staged) {
+    // the rest of the ring is held by frames in flight and copies not recorded yet, waiting
+    // would not free it in time, so the upload gets a buffer of its own
+    StagingOverflow overflow{};
+    CreateBuffer(size,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 GetVkMemoryType(MemoryType::HOST_VISIBLE),
+                 &overflow.buffer,
+                 &overflow.memory);
+    staging_overflows_.push_back(overflow);
+    staging_buffer = overflow.buffer;
+    staging_offset = 0;
+    staging_data = overflow.memory.mapped_data;
+  }
+  memcpy(staging_data, data, size);
+  VkBufferCopy region = {};
+  region.srcOffset = staging_offset;
+  region.dstOffset = dst_offset;
+  region.size = size;
+  pending_copies_.push_back({staging_buffer, dst_buffer, region});
+}
+
+void vulkan::VulkanRenderingContext::RecordPendingCopies(VkCommandBuffer command_buffer) {
+  // the frame being recorded is the last one to read the overflow buffers
+  for (const StagingOverflow &overflow: staging_overflows_) {
+    DeferDestroy(VK_OBJECT_TYPE_BUFFER, overflow.buffer, overflow.memory);
+  }
+  staging_overflows_.clear();
+  if (pending_copies_.empty()) {
+    return;
+  }
+  // the destination may still be read by earlier frames, a write after read only needs the
+  // reads to finish before the copies start
+  vkCmdPipelineBarrier(command_buffer,
+                       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+                           | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0,
+                       0, nullptr,
+                       0, nullptr,
+                       0, nullptr);
+  for (const auto &copy: pending_copies_) {
+    vkCmdCopyBuffer(command_buffer, copy.src_buffer, copy.dst_buffer, 1, &copy.region);
+  }
+  pending_copies_.clear();
+
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT
+      | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+                           | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       0,
+                       1, &barrier,
+                       0, nullptr,
+                       0, nullptr);
+}
+
+void vulkan::VulkanRenderingContext::DiscardPendingUploads(VkBuffer dst_buffer) {
+  pending_copies_.erase(std::remove_if(pending_copies_.begin(),
+                                       pending_copies_.end(),
+                                       [dst_buffer](const PendingCopy &copy) {
+                                         return copy.dst_buffer == dst_buffer;
+                                       }),
+                        pending_copies_.end());
+}
+
+void vulkan::VulkanRenderingContext::CreatePipelineCache() {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device_, &properties);
+
+  std::vector<char> initial_data{};
+  std::ifstream file(pipeline_cache_path_, std::ios::binary);
+  PipelineCachePrefix prefix{};
+  if (!file) {
+    spdlog::info("No pipeline cache at {}", pipeline_cache_path_);
+  } else if (!file.read(reinterpret_cast<char *>(&prefix), sizeof(prefix))
+      || prefix.magic != kPipelineCacheMagic
+      || prefix.vendor_id != properties.vendorID
+      || prefix.device_id != properties.deviceID
+      || prefix.driver_version != properties.driverVersion
+      || memcmp(prefix.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    spdlog::warn("Pipeline cache {} belongs to another device or driver, ignoring it",
+                 pipeline_cache_path_);
+  } else {
+    initial_data.resize(prefix.data_size);
+    VkPipelineCacheHeaderVersionOne header{};
+    if (!file.read(initial_data.data(), static_cast<std::streamsize>(initial_data.size()))
+        || initial_data.size() < sizeof(header)) {
+      spdlog::warn("Pipeline cache {} is truncated, ignoring it", pipeline_cache_path_);
+      initial_data.clear();
+    } else {
+      // the driver validates its own header as well, checking it here makes rejections visible
+      memcpy(&header, initial_data.data(), sizeof(header));
+      if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+          || header.vendorID != properties.vendorID
+          || header.deviceID != properties.deviceID
+          || memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        spdlog::warn("Pipeline cache {} has a mismatching header, ignoring it",
+                     pipeline_cache_path_);
+        initial_data.clear();
+      }
+    }
   }
-  if (counts & VK_SAMPLE_COUNT_32_BIT) {
-    return VK_SAMPLE_COUNT_32_BIT;
+
+  VkPipelineCacheCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  create_info.initialDataSize = initial_data.size();
+  create_info.pInitialData = initial_data.empty() ? nullptr : initial_data.data();
+  CHECK_VKCMD(vkCreatePipelineCache(device_, &create_info, nullptr, &pipeline_cache_));
+  pipeline_cache_warm_ = !initial_data.empty();
+  if (pipeline_cache_warm_) {
+    spdlog::info("Loaded {} bytes of pipeline cache", initial_data.size());
   }
-  if (counts & VK_SAMPLE_COUNT_16_BIT) {
-    return VK_SAMPLE_COUNT_16_BIT;
+}
+
+VkPipelineCache vulkan::VulkanRenderingContext::GetPipelineCache() const {
+  return pipeline_cache_;
+}
+
+void vulkan::VulkanRenderingContext::OnPipelineCreated(
+    std::chrono::steady_clock::duration creation_time) {
+  spdlog::info("Pipeline created in {:.3f}ms with a {} cache",
+               std::chrono::duration<float, std::milli>(creation_time).count(),
+               pipeline_cache_warm_ ? "warm" : "cold");
+  pipeline_cache_dirty_ = true;
+}
+
+void vulkan::VulkanRenderingContext::SavePipelineCache() {
+  if (!pipeline_cache_dirty_) {
+    return;
   }
-  if (counts & VK_SAMPLE_COUNT_8_BIT) {
-    return VK_SAMPLE_COUNT_8_BIT;
+  size_t data_size = 0;
+  CHECK_VKCMD(vkGetPipelineCacheData(device_, pipeline_cache_, &data_size, nullptr));
+  std::vector<char> data(data_size);
+  CHECK_VKCMD(vkGetPipelineCacheData(device_, pipeline_cache_, &data_size, data.data()));
+  data.resize(data_size);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device_, &properties);
+  PipelineCachePrefix prefix{};
+  prefix.magic = kPipelineCacheMagic;
+  prefix.vendor_id = properties.vendorID;
+  prefix.device_id = properties.deviceID;
+  prefix.driver_version = properties.driverVersion;
+  memcpy(prefix.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+  prefix.data_size = data.size();
+
+  // write next to the cache and rename, a crash while writing must not leave a broken cache
+  const std::string kTmpPath = pipeline_cache_path_ + ".tmp";
+  {
+    std::ofstream file(kTmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char *>(&prefix), sizeof(prefix))
+        || !file.write(data.data(), static_cast<std::streamsize>(data.size()))) {
+      spdlog::warn("Failed to write pipeline cache {}", kTmpPath);
+      return;
+    }
   }
-  if (counts & VK_SAMPLE_COUNT_4_BIT) {
-    return VK_SAMPLE_COUNT_4_BIT;
+  if (std::rename(kTmpPath.c_str(), pipeline_cache_path_.c_str()) != 0) {
+    spdlog::warn("Failed to replace pipeline cache {}", pipeline_cache_path_);
+    return;
   }
-  if (counts & VK_SAMPLE_COUNT_2_BIT) {
-    return VK_SAMPLE_COUNT_2_BIT;
+  pipeline_cache_dirty_ = false;
+  spdlog::info("Saved {} bytes of pipeline cache to {}", data.size(), pipeline_cache_path_);
+}
+
+VkSampleCountFlags vulkan::VulkanRenderingContext::GetSupportedMsaaSamples() const {
+  VkPhysicalDeviceProperties physical_device_properties;
+  vkGetPhysicalDeviceProperties(physical_device_,
+                                &physical_device_properties);
+  return physical_device_properties.limits.framebufferColorSampleCounts
+      & physical_device_properties.limits.framebufferDepthSampleCounts;
+}
+
+VkSampleCountFlagBits vulkan::VulkanRenderingContext::ClampMsaaSamples(uint32_t samples) const {
+  const VkSampleCountFlags kSupported = GetSupportedMsaaSamples();
+  uint32_t clamped = VK_SAMPLE_COUNT_64_BIT;
+  while (clamped > VK_SAMPLE_COUNT_1_BIT && (clamped > samples || (kSupported & clamped) == 0)) {
+    clamped >>= 1;
   }
-  return VK_SAMPLE_COUNT_1_BIT;
+  return static_cast<VkSampleCountFlagBits>(clamped);
 }
 
 VkDevice vulkan::VulkanRenderingContext::GetDevice() const {
@@ -153,12 +505,13 @@ VkFormat vulkan::VulkanRenderingContext::FindSupportedFormat(
 }
 void vulkan::VulkanRenderingContext::CreateImage(uint32_t width,
                                                  uint32_t height,
+                                                 uint32_t layers,
                                                  VkSampleCountFlagBits num_samples,
                                                  VkFormat format,
                                                  VkImageUsageFlags usage,
                                                  VkMemoryPropertyFlags properties,
                                                  VkImage *image,
-                                                 VkDeviceMemory *image_memory) const {
+                                                 MemoryAllocation *image_memory) {
   VkImageCreateInfo image_info = {};
   image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   image_info.imageType = VK_IMAGE_TYPE_2D;
@@ -166,7 +519,7 @@ void vulkan::VulkanRenderingContext::CreateImage(uint32_t width,
   image_info.extent.height = height;
   image_info.extent.depth = 1;
   image_info.mipLevels = 1;
-  image_info.arrayLayers = 1;
+  image_info.arrayLayers = layers;
   image_info.format = format;
   image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
   image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -175,97 +528,57 @@ void vulkan::VulkanRenderingContext::CreateImage(uint32_t width,
   image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
   if (vkCreateImage(device_, &image_info, nullptr, image) != VK_SUCCESS) {
+    // the handle is undefined after a failure, callers release what is not null
+    *image = VK_NULL_HANDLE;
     throw std::runtime_error("failed to create image!");
   }
 
-  VkMemoryRequirements mem_requirements;
-  vkGetImageMemoryRequirements(device_, *image, &mem_requirements);
-
-  VkMemoryAllocateInfo alloc_info = {};
-  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  alloc_info.allocationSize = mem_requirements.size;
-  alloc_info.memoryTypeIndex = FindMemoryType(mem_requirements.memoryTypeBits, properties);
+  VkMemoryDedicatedRequirements dedicated_requirements{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+  };
+  VkMemoryRequirements2 mem_requirements{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+      .pNext = &dedicated_requirements,
+  };
+  const VkImageMemoryRequirementsInfo2 kRequirementsInfo{
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+      .image = *image,
+  };
+  vkGetImageMemoryRequirements2(device_, &kRequirementsInfo, &mem_requirements);
 
-  if (vkAllocateMemory((device_), &alloc_info, nullptr, image_memory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate image memory!");
+  bool dedicated = dedicated_requirements.requiresDedicatedAllocation == VK_TRUE
+      || dedicated_requirements.prefersDedicatedAllocation == VK_TRUE
+      || mem_requirements.memoryRequirements.size >= kDedicatedImageSize;
+  // transient attachments are only backed on demand by tiled gpus, each gets its own
+  // allocation so the driver never has to commit a whole shared block
+  const VkMemoryPropertyFlags kLazyProperties =
+      properties | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+  if ((usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0
+      && allocator_->HasMemoryType(mem_requirements.memoryRequirements.memoryTypeBits,
+                                   kLazyProperties)) {
+    properties = kLazyProperties;
+    dedicated = true;
   }
-
-  vkBindImageMemory(device_, *image, *image_memory, 0);
+  const VkMemoryDedicatedAllocateInfo kDedicatedInfo{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+      .image = *image,
+  };
+  *image_memory = allocator_->Allocate(mem_requirements.memoryRequirements,
+                                       properties,
+                                       false,
+                                       dedicated ? &kDedicatedInfo : nullptr);
+  CHECK_VKCMD(vkBindImageMemory(device_, *image, image_memory->memory, image_memory->offset));
 }
 
 VkRenderPass vulkan::VulkanRenderingContext::GetRenderPass() const {
   return render_pass_;
 }
 
-void vulkan::VulkanRenderingContext::TransitionImageLayout(VkImage image,
-                                                           VkImageLayout old_layout,
-                                                           VkImageLayout new_layout) {
-  VkCommandBuffer command_buffer = BeginSingleTimeCommands(graphics_pool_);
-
-  VkImageMemoryBarrier barrier = {};
-  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  barrier.oldLayout = old_layout;
-  barrier.newLayout = new_layout;
-  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.image = image;
-  barrier.subresourceRange.baseMipLevel = 0;
-  barrier.subresourceRange.levelCount = 1;
-  barrier.subresourceRange.baseArrayLayer = 0;
-  barrier.subresourceRange.layerCount = 1;
-  VkPipelineStageFlags source_stage;
-  VkPipelineStageFlags destination_stage;
-  if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED
-      && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-  } else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
-      new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  } else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout ==
-      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
-        | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    destination_stage =
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  } else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout ==
-      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
-        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    destination_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  } else {
-    throw std::invalid_argument("unsupported layout transition!");
-  }
-  vkCmdPipelineBarrier(
-      command_buffer,
-      source_stage, destination_stage,
-      0,
-      0, nullptr,
-      0, nullptr,
-      1, &barrier
-  );
-
-  EndSingleTimeCommands(graphics_queue_, graphics_pool_, command_buffer);
-}
-
 void vulkan::VulkanRenderingContext::CreateBuffer(VkDeviceSize size,
                                                   VkBufferUsageFlags usage,
                                                   VkMemoryPropertyFlags properties,
                                                   VkBuffer *buffer,
-                                                  VkDeviceMemory *buffer_memory) {
+                                                  MemoryAllocation *buffer_memory) {
   VkBufferCreateInfo buffer_info = {};
   buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   buffer_info.size = size;
@@ -274,16 +587,29 @@ void vulkan::VulkanRenderingContext::CreateBuffer(VkDeviceSize size,
   if (vkCreateBuffer(device_, &buffer_info, nullptr, buffer) != VK_SUCCESS) {
     throw std::runtime_error("failed to create buffer!");
   }
-  VkMemoryRequirements mem_requirements;
-  vkGetBufferMemoryRequirements(device_, *buffer, &mem_requirements);
-  VkMemoryAllocateInfo alloc_info = {};
-  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  alloc_info.allocationSize = mem_requirements.size;
-  alloc_info.memoryTypeIndex = FindMemoryType(mem_requirements.memoryTypeBits, properties);
-  if (vkAllocateMemory(device_, &alloc_info, nullptr, buffer_memory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate buffer memory!");
-  }
-  vkBindBufferMemory(device_, *buffer, *buffer_memory, 0);
+  VkMemoryDedicatedRequirements dedicated_requirements{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS,
+  };
+  VkMemoryRequirements2 mem_requirements{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+      .pNext = &dedicated_requirements,
+  };
+  const VkBufferMemoryRequirementsInfo2 kRequirementsInfo{
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
+      .buffer = *buffer,
+  };
+  vkGetBufferMemoryRequirements2(device_, &kRequirementsInfo, &mem_requirements);
+  const bool kDedicated = dedicated_requirements.requiresDedicatedAllocation == VK_TRUE
+      || dedicated_requirements.prefersDedicatedAllocation == VK_TRUE;
+  const VkMemoryDedicatedAllocateInfo kDedicatedInfo{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+      .buffer = *buffer,
+  };
+  *buffer_memory = allocator_->Allocate(mem_requirements.memoryRequirements,
+                                        properties,
+                                        true,
+                                        kDedicated ? &kDedicatedInfo : nullptr);
+  CHECK_VKCMD(vkBindBufferMemory(device_, *buffer, buffer_memory->memory, buffer_memory->offset));
 }
 
 void vulkan::VulkanRenderingContext::CopyBuffer(VkBuffer src_buffer,
@@ -291,81 +617,497 @@ void vulkan::VulkanRenderingContext::CopyBuffer(VkBuffer src_buffer,
                                                 VkDeviceSize size,
                                                 VkDeviceSize src_offset,
                                                 VkDeviceSize dst_offset) {
-  VkCommandBuffer command_buffer = BeginSingleTimeCommands(graphics_pool_);
-  VkBufferCopy copy_region = {};
-  copy_region.size = size;
-  copy_region.srcOffset = src_offset;
-  copy_region.dstOffset = dst_offset;
-  vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
-  EndSingleTimeCommands(graphics_queue_, graphics_pool_, command_buffer);
+  VulkanCommandBatch batch(shared_from_this());
+  batch.CopyBuffer(src_buffer, dst_buffer, size, src_offset, dst_offset);
+  WaitForBatch(batch.Submit());
 }
 
 uint32_t vulkan::VulkanRenderingContext::FindMemoryType(uint32_t type_filter,
                                                         VkMemoryPropertyFlags properties) const {
-  VkPhysicalDeviceMemoryProperties mem_properties;
-  vkGetPhysicalDeviceMemoryProperties(physical_device_, &mem_properties);
+  return allocator_->FindMemoryType(type_filter, properties);
+}
+
+VkDeviceSize vulkan::VulkanRenderingContext::GetCommittedBytes(
+    const MemoryAllocation &allocation) const {
+  if (!allocation.lazily_allocated) {
+    return allocation.size;
+  }
+  VkDeviceSize committed = 0;
+  vkGetDeviceMemoryCommitment(device_, allocation.memory, &committed);
+  return committed;
+}
+
+void vulkan::VulkanRenderingContext::FreeMemory(const MemoryAllocation &allocation) {
+  allocator_->Free(allocation);
+}
 
-  for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
-    if (type_filter & (1u << i)
-        && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties) {
-      return i;
+std::shared_ptr<const vulkan::RenderTarget> vulkan::VulkanRenderingContext::AcquireRenderTarget(
+    VkFormat format,
+    VkExtent2D extent,
+    uint32_t layers,
+    VkSampleCountFlagBits samples,
+    VulkanCommandBatch &batch) {
+  std::erase_if(render_targets_, [](const std::weak_ptr<const RenderTarget> &target) {
+    return target.expired();
+  });
+  for (const auto &weak_target: render_targets_) {
+    auto target = weak_target.lock();
+    if (target->format == format && target->samples == samples && target->layers == layers
+        && target->extent.width >= extent.width && target->extent.height >= extent.height) {
+      spdlog::info("Render target {}x{} {} reused, {} KiB saved",
+                   target->extent.width,
+                   target->extent.height,
+                   magic_enum::enum_name(format),
+                   target->memory.size / 1024);
+      return target;
     }
   }
-  throw std::runtime_error("failed to find suitable memory type!");
+
+  const bool kDepth = IsDepthFormat(format);
+  // the deleter owns the target from the start, a failing step releases what was created
+  std::shared_ptr<RenderTarget> created(
+      new RenderTarget{
+          .format = format,
+          .extent = extent,
+          .layers = layers,
+          .samples = samples,
+      },
+      [context = shared_from_this()](const RenderTarget *released) {
+        if (released->view != VK_NULL_HANDLE) {
+          context->DeferDestroy(VK_OBJECT_TYPE_IMAGE_VIEW, released->view);
+        }
+        if (released->image != VK_NULL_HANDLE) {
+          context->DeferDestroy(VK_OBJECT_TYPE_IMAGE, released->image, released->memory);
+        }
+        delete released;
+      });
+  CreateImage(extent.width,
+              extent.height,
+              layers,
+              samples,
+              format,
+              VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT
+                  | (kDepth ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+                            : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT),
+              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+              &created->image,
+              &created->memory);
+  CreateImageView(created->image,
+                  format,
+                  kDepth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT,
+                  layers,
+                  &created->view);
+  batch.TransitionImageLayout(created->image,
+                              VK_IMAGE_LAYOUT_UNDEFINED,
+                              kDepth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                                     : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+  spdlog::info("Render target {}x{} {} created, {} KiB",
+               extent.width,
+               extent.height,
+               magic_enum::enum_name(format),
+               created->memory.size / 1024);
+
+  std::shared_ptr<const RenderTarget> target = std::move(created);
+  render_targets_.push_back(target);
+  return target;
+}
+
+std::vector<vulkan::MemoryTypeStats> vulkan::VulkanRenderingContext::GetMemoryStats() const {
+  return allocator_->GetStats();
+}
+
+void vulkan::VulkanRenderingContext::LogMemoryStats() const {
+  allocator_->LogStats();
 }
 
 void vulkan::VulkanRenderingContext::CreateImageView(VkImage image,
                                                      VkFormat format,
                                                      VkImageAspectFlagBits aspect_mask,
+                                                     uint32_t layer_count,
                                                      VkImageView *image_view) {
   VkImageViewCreateInfo view_info = {};
   view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
   view_info.image = image;
-  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.viewType = layer_count > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
   view_info.format = format;
   view_info.subresourceRange.aspectMask = aspect_mask;
   view_info.subresourceRange.baseMipLevel = 0;
   view_info.subresourceRange.levelCount = 1;
   view_info.subresourceRange.baseArrayLayer = 0;
-  view_info.subresourceRange.layerCount = 1;
+  view_info.subresourceRange.layerCount = layer_count;
   if (vkCreateImageView(device_, &view_info, nullptr, image_view) != VK_SUCCESS) {
+    *image_view = VK_NULL_HANDLE;
     throw std::runtime_error("failed to create texture image view!");
   }
 }
 
-VkCommandBuffer vulkan::VulkanRenderingContext::BeginSingleTimeCommands(VkCommandPool command_pool) {
+VkCommandBuffer vulkan::VulkanRenderingContext::BeginBatch() {
   VkCommandBufferAllocateInfo alloc_info = {};
   alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
   alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  alloc_info.commandPool = command_pool;
+  alloc_info.commandPool = graphics_pool_;
   alloc_info.commandBufferCount = 1;
-  VkCommandBuffer command_buffer;
-  vkAllocateCommandBuffers(device_, &alloc_info, &command_buffer);
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+  CHECK_VKCMD(vkAllocateCommandBuffers(device_, &alloc_info, &command_buffer));
   VkCommandBufferBeginInfo begin_info = {};
   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-  vkBeginCommandBuffer(command_buffer, &begin_info);
+  const VkResult kResult = vkBeginCommandBuffer(command_buffer, &begin_info);
+  if (kResult != VK_SUCCESS) {
+    vkFreeCommandBuffers(device_, graphics_pool_, 1, &command_buffer);
+    CHECK_VKCMD(kResult);
+  }
+  open_batch_count_++;
   return command_buffer;
 }
 
-void vulkan::VulkanRenderingContext::EndSingleTimeCommands(VkQueue queue,
-                                                           VkCommandPool pool,
-                                                           VkCommandBuffer command_buffer) {
-  vkEndCommandBuffer(command_buffer);
+void vulkan::VulkanRenderingContext::DiscardBatch(VkCommandBuffer command_buffer) {
+  vkFreeCommandBuffers(device_, graphics_pool_, 1, &command_buffer);
+  // objects destroyed meanwhile are only held by batches submitted before
+  CloseBatch(batch_value_);
+}
+
+void vulkan::VulkanRenderingContext::CloseBatch(uint64_t batch_value) {
+  if (--open_batch_count_ > 0) {
+    return;
+  }
+  // batches execute in submission order, so the last one closed covers the others
+  for (auto it = deferred_destructions_.rbegin();
+       it != deferred_destructions_.rend() && it->batch_value == kOpenBatchValue;
+       ++it) {
+    it->batch_value = batch_value;
+  }
+}
+
+uint64_t vulkan::VulkanRenderingContext::SubmitBatch(VkCommandBuffer command_buffer) {
+  const uint64_t kSignalValue = batch_value_ + 1;
+  VkTimelineSemaphoreSubmitInfoKHR timeline_submit_info = {
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+      .signalSemaphoreValueCount = 1,
+      .pSignalSemaphoreValues = &kSignalValue,
+  };
   VkSubmitInfo submit_info = {};
   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.pNext = &timeline_submit_info;
   submit_info.commandBufferCount = 1;
   submit_info.pCommandBuffers = &command_buffer;
-  vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
-  vkQueueWaitIdle(queue);
-  vkFreeCommandBuffers(device_, pool, 1, &command_buffer);
+  submit_info.signalSemaphoreCount = 1;
+  submit_info.pSignalSemaphores = &batch_timeline_;
+  SubmitToGraphicsQueue(submit_info, VK_NULL_HANDLE);
+  batch_value_ = kSignalValue;
+  submitted_batches_.push_back({kSignalValue, command_buffer});
+  CloseBatch(kSignalValue);
+  return kSignalValue;
+}
+
+bool vulkan::VulkanRenderingContext::IsBatchComplete(uint64_t token) const {
+  uint64_t completed = 0;
+  CHECK_VKCMD(get_semaphore_counter_value_(device_, batch_timeline_, &completed));
+  return completed >= token;
+}
+
+void vulkan::VulkanRenderingContext::WaitForBatch(uint64_t token) {
+  if (token == 0 || IsBatchComplete(token)) {
+    ReleaseCompletedBatches();
+    return;
+  }
+  VkSemaphoreWaitInfoKHR wait_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+      .semaphoreCount = 1,
+      .pSemaphores = &batch_timeline_,
+      .pValues = &token,
+  };
+  CHECK_VKCMD(wait_semaphores_(device_, &wait_info, UINT64_MAX));
+  ReleaseCompletedBatches();
+}
+
+void vulkan::VulkanRenderingContext::ReleaseCompletedBatches() {
+  if (submitted_batches_.empty()) {
+    return;
+  }
+  uint64_t completed = 0;
+  CHECK_VKCMD(get_semaphore_counter_value_(device_, batch_timeline_, &completed));
+  auto first_pending = submitted_batches_.begin();
+  while (first_pending != submitted_batches_.end() && first_pending->timeline_value <= completed) {
+    vkFreeCommandBuffers(device_, graphics_pool_, 1, &first_pending->command_buffer);
+    ++first_pending;
+  }
+  submitted_batches_.erase(submitted_batches_.begin(), first_pending);
+}
+
+VkSampleCountFlagBits vulkan::VulkanRenderingContext::GetMsaaSamples() const {
+  return msaa_samples_;
+}
+
+bool vulkan::VulkanRenderingContext::IsMsaaEnabled() const {
+  return msaa_samples_ != VK_SAMPLE_COUNT_1_BIT;
+}
+
+void vulkan::VulkanRenderingContext::SetMsaaSamples(uint32_t samples) {
+  if (frame_command_buffer_ != VK_NULL_HANDLE) {
+    throw std::runtime_error("msaa samples can not change while a frame is recorded");
+  }
+  const VkSampleCountFlagBits kSamples = ClampMsaaSamples(samples);
+  if (kSamples == msaa_samples_) {
+    return;
+  }
+  spdlog::info("Msaa changes from {}x to {}x", static_cast<uint32_t>(msaa_samples_),
+               static_cast<uint32_t>(kSamples));
+  // frames in flight still draw with the old render pass
+  DeferDestroy(VK_OBJECT_TYPE_RENDER_PASS, render_pass_);
+  msaa_samples_ = kSamples;
+  CreateRenderPass();
+}
+
+bool vulkan::VulkanRenderingContext::IsFoveationSupported() const {
+  return fragment_density_map_supported_;
+}
+
+bool vulkan::VulkanRenderingContext::IsFoveationEnabled() const {
+  return foveation_enabled_;
+}
+
+void vulkan::VulkanRenderingContext::SetFoveationEnabled(bool enabled) {
+  if (frame_command_buffer_ != VK_NULL_HANDLE) {
+    throw std::runtime_error("foveation can not change while a frame is recorded");
+  }
+  if (enabled && !fragment_density_map_supported_) {
+    throw std::runtime_error("device does not support fragment density maps");
+  }
+  if (enabled == foveation_enabled_) {
+    return;
+  }
+  spdlog::info("Fragment density map foveation {}", enabled ? "enabled" : "disabled");
+  // frames in flight still draw with the old render pass
+  DeferDestroy(VK_OBJECT_TYPE_RENDER_PASS, render_pass_);
+  foveation_enabled_ = enabled;
+  CreateRenderPass();
+}
+
+VkExtent2D vulkan::VulkanRenderingContext::GetDensityMapTexelSize() const {
+  return density_map_texel_size_;
+}
+
+uint32_t vulkan::VulkanRenderingContext::GetViewCount() const {
+  return view_count_;
 }
 
-VkSampleCountFlagBits vulkan::VulkanRenderingContext::GetRecommendedMsaaSamples() const {
-  return recommended_msaa_samples_;
+void vulkan::VulkanRenderingContext::SubmitToGraphicsQueue(const VkSubmitInfo &submit_info,
+                                                           VkFence fence) {
+  CHECK_VKCMD(vkQueueSubmit(graphics_queue_, 1, &submit_info, fence));
+  submit_count_++;
+}
+
+uint64_t vulkan::VulkanRenderingContext::WaitForFrameTimeline(uint64_t value) {
+  uint64_t completed = 0;
+  CHECK_VKCMD(get_semaphore_counter_value_(device_, frame_timeline_, &completed));
+  if (completed >= value) {
+    return completed;
+  }
+  const auto kWaitStart = std::chrono::steady_clock::now();
+  VkSemaphoreWaitInfoKHR wait_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+      .semaphoreCount = 1,
+      .pSemaphores = &frame_timeline_,
+      .pValues = &value,
+  };
+  CHECK_VKCMD(wait_semaphores_(device_, &wait_info, UINT64_MAX));
+  frame_gpu_wait_time_ += std::chrono::steady_clock::now() - kWaitStart;
+  return value;
+}
+
+VkCommandBuffer vulkan::VulkanRenderingContext::BeginFrame(uint64_t frame_id) {
+  if (frame_command_buffer_ != VK_NULL_HANDLE) {
+    throw std::runtime_error("frame is already being recorded");
+  }
+  frame_slot_ = static_cast<uint32_t>(frame_index_ % max_frames_in_flight_);
+  // the slot's last frame can be more recent than max frames in flight frames back when the
+  // limit was lowered, both must be done
+  uint64_t wait_value = slot_timeline_values_[frame_slot_];
+  if (frame_index_ >= max_frames_in_flight_) {
+    wait_value = std::max(wait_value, frame_index_ + 1 - max_frames_in_flight_);
+  }
+  frame_gpu_wait_time_ = std::chrono::nanoseconds(0);
+  const uint64_t kCompletedFrames = WaitForFrameTimeline(wait_value);
+  uint64_t completed_batches = 0;
+  CHECK_VKCMD(get_semaphore_counter_value_(device_, batch_timeline_, &completed_batches));
+  DestroyDeferred(kCompletedFrames, completed_batches);
+  ReleaseCompletedBatches();
+
+  frame_command_buffer_ = frame_command_buffers_[frame_slot_];
+  frame_start_submit_count_ = submit_count_;
+
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  CHECK_VKCMD(vkBeginCommandBuffer(frame_command_buffer_, &begin_info));
+  // the previous frame of the slot is complete, so are its timestamp results
+  gpu_timer_->BeginFrame(frame_command_buffer_, frame_slot_, frame_id);
+
+  // staging ranges of every completed frame can be reused
+  if (kCompletedFrames > 0) {
+    staging_ring_->Retire(kCompletedFrames - 1);
+  }
+  {
+    GpuTimerScope scope(*gpu_timer_, frame_command_buffer_, "uploads", 0);
+    RecordPendingCopies(frame_command_buffer_);
+  }
+  staging_ring_->MarkFrame(frame_index_);
+  return frame_command_buffer_;
+}
+
+void vulkan::VulkanRenderingContext::EndFrame() {
+  if (frame_command_buffer_ == VK_NULL_HANDLE) {
+    throw std::runtime_error("frame recording was not started");
+  }
+  gpu_timer_->EndFrame(frame_command_buffer_);
+  CHECK_VKCMD(vkEndCommandBuffer(frame_command_buffer_));
+
+  const uint64_t kSignalValue = frame_index_ + 1;
+  VkTimelineSemaphoreSubmitInfoKHR timeline_submit_info = {
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+      .signalSemaphoreValueCount = 1,
+      .pSignalSemaphoreValues = &kSignalValue,
+  };
+  VkSubmitInfo submit_info = {};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.pNext = &timeline_submit_info;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &frame_command_buffer_;
+  submit_info.signalSemaphoreCount = 1;
+  submit_info.pSignalSemaphores = &frame_timeline_;
+  // batches submitted since the last frame, e.g. layout transitions of new render targets
+  const VkPipelineStageFlags kBatchWaitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  if (batch_value_ > frame_waited_batch_value_) {
+    timeline_submit_info.waitSemaphoreValueCount = 1;
+    timeline_submit_info.pWaitSemaphoreValues = &batch_value_;
+    submit_info.waitSemaphoreCount = 1;
+    submit_info.pWaitSemaphores = &batch_timeline_;
+    submit_info.pWaitDstStageMask = &kBatchWaitStage;
+    frame_waited_batch_value_ = batch_value_;
+  }
+  SubmitToGraphicsQueue(submit_info, VK_NULL_HANDLE);
+  slot_timeline_values_[frame_slot_] = kSignalValue;
+
+  frame_submit_count_ = static_cast<uint32_t>(submit_count_ - frame_start_submit_count_);
+  frame_command_buffer_ = VK_NULL_HANDLE;
+  frame_index_++;
+}
+
+void vulkan::VulkanRenderingContext::EnqueueDestruction(VkObjectType type,
+                                                        uint64_t handle,
+                                                        const MemoryAllocation &memory) {
+  if (handle == 0) {
+    return;
+  }
+  // a frame being recorded may still reference the object, otherwise the last submitted one
+  const uint64_t kTimelineValue =
+      frame_command_buffer_ != VK_NULL_HANDLE ? frame_index_ + 1 : frame_index_;
+  // open batches may have recorded commands on the object, the last one to be submitted waits
+  const uint64_t kBatchValue = open_batch_count_ > 0 ? kOpenBatchValue : batch_value_;
+  deferred_destructions_.push_back({kTimelineValue, kBatchValue, type, handle, memory});
+}
+
+void vulkan::VulkanRenderingContext::DestroyDeferred(uint64_t completed_frames,
+                                                     uint64_t completed_batches) {
+  auto first_pending = deferred_destructions_.begin();
+  while (first_pending != deferred_destructions_.end()
+      && first_pending->timeline_value <= completed_frames
+      && first_pending->batch_value <= completed_batches) {
+    DestroyObject(*first_pending);
+    ++first_pending;
+  }
+  deferred_destructions_.erase(deferred_destructions_.begin(), first_pending);
+}
+
+void vulkan::VulkanRenderingContext::DestroyObject(const DeferredDestruction &destruction) {
+  switch (destruction.type) {
+    case VK_OBJECT_TYPE_BUFFER:
+      vkDestroyBuffer(device_, reinterpret_cast<VkBuffer>(destruction.handle), nullptr);
+      break;
+    case VK_OBJECT_TYPE_IMAGE:
+      vkDestroyImage(device_, reinterpret_cast<VkImage>(destruction.handle), nullptr);
+      break;
+    case VK_OBJECT_TYPE_IMAGE_VIEW:
+      vkDestroyImageView(device_, reinterpret_cast<VkImageView>(destruction.handle), nullptr);
+      break;
+    case VK_OBJECT_TYPE_FRAMEBUFFER:
+      vkDestroyFramebuffer(device_,
+                           reinterpret_cast<VkFramebuffer>(destruction.handle),
+                           nullptr);
+      break;
+    case VK_OBJECT_TYPE_PIPELINE:
+      vkDestroyPipeline(device_, reinterpret_cast<VkPipeline>(destruction.handle), nullptr);
+      break;
+    case VK_OBJECT_TYPE_RENDER_PASS:
+      vkDestroyRenderPass(device_, reinterpret_cast<VkRenderPass>(destruction.handle), nullptr);
+      break;
+    case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+      vkDestroyPipelineLayout(device_,
+                              reinterpret_cast<VkPipelineLayout>(destruction.handle),
+                              nullptr);
+      break;
+    default:
+      throw std::invalid_argument("deferred destruction of unsupported object type");
+  }
+  if (destruction.memory.memory != VK_NULL_HANDLE) {
+    FreeMemory(destruction.memory);
+  }
+}
+
+uint32_t vulkan::VulkanRenderingContext::GetMaxFramesInFlight() const {
+  return max_frames_in_flight_;
+}
+
+void vulkan::VulkanRenderingContext::SetMaxFramesInFlight(uint32_t count) {
+  if (count == 0 || count > kMaxFramesInFlight) {
+    throw std::invalid_argument("frames in flight must be in [1, kMaxFramesInFlight]");
+  }
+  if (frame_command_buffer_ != VK_NULL_HANDLE) {
+    throw std::runtime_error("frames in flight can not change while a frame is recorded");
+  }
+  if (count != max_frames_in_flight_) {
+    spdlog::info("Max frames in flight changed {}->{}", max_frames_in_flight_, count);
+    max_frames_in_flight_ = count;
+  }
+}
+
+std::chrono::nanoseconds vulkan::VulkanRenderingContext::GetFrameGpuWaitTime() const {
+  return frame_gpu_wait_time_;
+}
+
+uint32_t vulkan::VulkanRenderingContext::GetFrameSlot() const {
+  return frame_slot_;
+}
+
+vulkan::VulkanGpuTimer &vulkan::VulkanRenderingContext::GetGpuTimer() {
+  return *gpu_timer_;
+}
+
+uint32_t vulkan::VulkanRenderingContext::GetFrameSubmitCount() const {
+  return frame_submit_count_;
 }
 
 vulkan::VulkanRenderingContext::~VulkanRenderingContext() {
+  vkDeviceWaitIdle(device_);
+  DestroyDeferred(UINT64_MAX, UINT64_MAX);
+  for (const StagingOverflow &overflow: staging_overflows_) {
+    vkDestroyBuffer(device_, overflow.buffer, nullptr);
+    FreeMemory(overflow.memory);
+  }
+  ReleaseCompletedBatches();
+  SavePipelineCache();
+  vkDestroyPipelineCache(device_, pipeline_cache_, nullptr);
+  staging_ring_.reset();
+  vkDestroyBuffer(device_, staging_buffer_, nullptr);
+  FreeMemory(staging_memory_);
+  vkDestroySemaphore(device_, frame_timeline_, nullptr);
+  vkDestroySemaphore(device_, batch_timeline_, nullptr);
+  gpu_timer_.reset();
+  vkFreeCommandBuffers(device_,
+                       graphics_pool_,
+                       static_cast<uint32_t>(frame_command_buffers_.size()),
+                       frame_command_buffers_.data());
   vkDestroyRenderPass(device_, render_pass_, nullptr);
 }
 
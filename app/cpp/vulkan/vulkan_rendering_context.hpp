@@ -3,12 +3,39 @@
 #include <vulkan/vulkan.h>
 
 #include "data_type.hpp"
+#include "vulkan_gpu_timer.hpp"
+#include "vulkan_memory_allocator.hpp"
+#include "vulkan_staging_ring.hpp"
 
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace vulkan {
+class VulkanCommandBatch;
+
+// Multisampled attachment whose contents do not outlive a render pass, see
+// VulkanRenderingContext::AcquireRenderTarget.
+struct RenderTarget {
+  VkImage image = VK_NULL_HANDLE;
+  VkImageView view = VK_NULL_HANDLE;
+  MemoryAllocation memory{};
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  VkExtent2D extent{};
+  uint32_t layers = 0;
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
 class VulkanRenderingContext
     : public std::enable_shared_from_this<VulkanRenderingContext> {
+ public:
+  // per frame resources are allocated for this many slots up front
+  static constexpr uint32_t kMaxFramesInFlight = 4;
+  // horizontal and vertical density of the fragment density map, 255 shades every pixel
+  static constexpr VkFormat kDensityMapFormat = VK_FORMAT_R8G8_UNORM;
  private:
   VkFormat color_attachment_format_ = VK_FORMAT_UNDEFINED;
   VkFormat depth_attachment_format_ = VK_FORMAT_UNDEFINED;
@@ -17,16 +44,106 @@ class VulkanRenderingContext
   VkDevice device_;
   VkQueue graphics_queue_;
   VkCommandPool graphics_pool_;
-  VkSampleCountFlagBits recommended_msaa_samples_;
+  VkSampleCountFlagBits msaa_samples_;
+  uint32_t view_count_;
+  bool fragment_density_map_supported_;
+  // every density map texel covers this many framebuffer pixels
+  VkExtent2D density_map_texel_size_{1, 1};
+  bool foveation_enabled_ = false;
   VkRenderPass render_pass_ = VK_NULL_HANDLE;
+  std::unique_ptr<VulkanMemoryAllocator> allocator_;
+
+  const std::string pipeline_cache_path_;
+  VkPipelineCache pipeline_cache_ = VK_NULL_HANDLE;
+  // the cache was loaded from disk and matched this device and driver
+  bool pipeline_cache_warm_ = false;
+  bool pipeline_cache_dirty_ = false;
+
+  uint32_t max_frames_in_flight_ = 2;
+  std::vector<VkCommandBuffer> frame_command_buffers_{};
+  // counts completed frames, the frame with index i signals i + 1
+  VkSemaphore frame_timeline_ = VK_NULL_HANDLE;
+  PFN_vkWaitSemaphoresKHR wait_semaphores_ = nullptr;
+  PFN_vkGetSemaphoreCounterValueKHR get_semaphore_counter_value_ = nullptr;
+  // timeline value signaled by the last frame that used the slot
+  std::array<uint64_t, kMaxFramesInFlight> slot_timeline_values_{};
+  uint64_t frame_index_ = 0;
+  uint32_t frame_slot_ = 0;
+  VkCommandBuffer frame_command_buffer_ = VK_NULL_HANDLE;
+  std::chrono::nanoseconds frame_gpu_wait_time_{0};
+
+  struct SubmittedBatch {
+    uint64_t timeline_value;
+    VkCommandBuffer command_buffer;
+  };
+  // counts submitted command batches, frames wait on the gpu for the batches before them
+  VkSemaphore batch_timeline_ = VK_NULL_HANDLE;
+  uint64_t batch_value_ = 0;
+  uint64_t frame_waited_batch_value_ = 0;
+  std::vector<SubmittedBatch> submitted_batches_{};
+  // batches begun and neither submitted nor discarded yet
+  uint32_t open_batch_count_ = 0;
+
+  // batch value of objects destroyed while a batch was open, set once the last one is submitted
+  static constexpr uint64_t kOpenBatchValue = UINT64_MAX;
+  struct DeferredDestruction {
+    // frame timeline value after which the gpu no longer uses the object
+    uint64_t timeline_value;
+    // batch timeline value that must be reached as well, batches may use the object too
+    uint64_t batch_value;
+    VkObjectType type;
+    uint64_t handle;
+    MemoryAllocation memory;
+  };
+  // ordered by both values, entries are only appended with the current frame's and batch's
+  std::vector<DeferredDestruction> deferred_destructions_{};
+  std::unique_ptr<VulkanGpuTimer> gpu_timer_;
+  // targets stay alive as long as a framebuffer user holds them
+  std::vector<std::weak_ptr<const RenderTarget>> render_targets_{};
+
+  struct PendingCopy {
+    VkBuffer src_buffer;
+    VkBuffer dst_buffer;
+    VkBufferCopy region;
+  };
+  VkBuffer staging_buffer_ = VK_NULL_HANDLE;
+  MemoryAllocation staging_memory_{};
+  std::unique_ptr<VulkanStagingRing> staging_ring_;
+  std::vector<PendingCopy> pending_copies_{};
+  struct StagingOverflow {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    MemoryAllocation memory{};
+  };
+  // staging of uploads the ring had no room for, destroyed after the frame that copies them
+  std::vector<StagingOverflow> staging_overflows_{};
+
+  uint64_t submit_count_ = 0;
+  uint64_t frame_start_submit_count_ = 0;
+  uint32_t frame_submit_count_ = 0;
 
-  VkSampleCountFlagBits GetMaxUsableSampleCount();
+  [[nodiscard]] VkSampleCountFlagBits ClampMsaaSamples(uint32_t samples) const;
+  void CreateRenderPass();
+  void CreateFrameResources();
+  // Blocks until the frame timeline reached value, returns the number of completed frames.
+  // Blocked time is added to the gpu wait time of the frame.
+  uint64_t WaitForFrameTimeline(uint64_t value);
+  void ReleaseCompletedBatches();
+  void EnqueueDestruction(VkObjectType type, uint64_t handle, const MemoryAllocation &memory);
+  // Destroys every deferred object whose frames and batches are within the completed ones.
+  void DestroyDeferred(uint64_t completed_frames, uint64_t completed_batches);
+  void CloseBatch(uint64_t batch_value);
+  void DestroyObject(const DeferredDestruction &destruction);
+  void CreatePipelineCache();
+  void RecordPendingCopies(VkCommandBuffer command_buffer);
  public:
   VulkanRenderingContext(VkPhysicalDevice physical_device,
                          VkDevice device,
                          VkQueue graphics_queue,
                          VkCommandPool graphics_pool,
-                         VkFormat color_attachment_format);
+                         VkFormat color_attachment_format,
+                         uint32_t view_count,
+                         bool fragment_density_map_supported,
+                         std::string pipeline_cache_path);
 
   [[nodiscard]] VkDevice GetDevice() const;
 
@@ -40,41 +157,144 @@ class VulkanRenderingContext
                     VkBufferUsageFlags usage,
                     VkMemoryPropertyFlags properties,
                     VkBuffer *buffer,
-                    VkDeviceMemory *buffer_memory);
+                    MemoryAllocation *buffer_memory);
 
+  // Images with VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT get lazily allocated memory when the
+  // device has a matching memory type, properties otherwise.
   void CreateImage(uint32_t width,
                    uint32_t height,
+                   uint32_t layers,
                    VkSampleCountFlagBits num_samples,
                    VkFormat format,
                    VkImageUsageFlags usage,
                    VkMemoryPropertyFlags properties,
                    VkImage *image,
-                   VkDeviceMemory *image_memory) const;
+                   MemoryAllocation *image_memory);
 
+  // Bytes of the allocation backed by physical memory. Lazily allocated memory is only committed
+  // when a tiled gpu spills attachment contents, which the render pass never asks for.
+  [[nodiscard]] VkDeviceSize GetCommittedBytes(const MemoryAllocation &allocation) const;
+
+  // Returns memory obtained from CreateBuffer or CreateImage, the resource bound to it must
+  // already be destroyed.
+  void FreeMemory(const MemoryAllocation &allocation);
+
+  // Destroys the object, and frees memory when it is set, once the gpu completed the frame
+  // being recorded or the last submitted one, and every batch submitted or open so far.
+  // BeginFrame releases objects once both timelines passed them, nothing waits for them.
+  // Supported types are buffers, images, image views, framebuffers, render passes, pipelines
+  // and pipeline layouts.
+  template<typename Handle>
+  void DeferDestroy(VkObjectType type, Handle handle, const MemoryAllocation &memory = {}) {
+    EnqueueDestruction(type, reinterpret_cast<uint64_t>(handle), memory);
+  }
+
+  // Returns a transient attachment of format, sample count and layer count that covers at least
+  // extent. Render passes clear the attachments on load and never store them, and all passes
+  // are recorded one after the other into the queue, so every view and every swapchain shares
+  // the same target while it is alive. New targets are transitioned to their attachment layout
+  // in batch. The target is destroyed once the last holder released it and the gpu is done
+  // with it.
+  [[nodiscard]] std::shared_ptr<const RenderTarget> AcquireRenderTarget(
+      VkFormat format,
+      VkExtent2D extent,
+      uint32_t layers,
+      VkSampleCountFlagBits samples,
+      VulkanCommandBatch &batch);
+
+  [[nodiscard]] std::vector<MemoryTypeStats> GetMemoryStats() const;
+
+  void LogMemoryStats() const;
+
+  // Copies in a command batch of its own and waits for it.
   void CopyBuffer(VkBuffer src_buffer,
                   VkBuffer dst_buffer,
                   VkDeviceSize size,
                   VkDeviceSize src_offset = 0,
                   VkDeviceSize dst_offset = 0);
 
-  void TransitionImageLayout(VkImage image,
-                             VkImageLayout old_layout,
-                             VkImageLayout new_layout);
+  // Copies data into dst_buffer through the staging ring without waiting for the gpu. The copy
+  // is recorded at the start of the next frame command buffer, so the data is visible to
+  // that frame and every frame after it. The copies wait for the reads of frames submitted
+  // before, so dst_buffer may be in use by frames in flight. Uploads the ring has no room
+  // for are staged in a buffer of their own instead of waiting for the gpu.
+  void UploadBuffer(VkBuffer dst_buffer,
+                    const void *data,
+                    VkDeviceSize size,
+                    VkDeviceSize dst_offset);
+
+  // Drops uploads that were not recorded yet, must be called before dst_buffer is destroyed.
+  void DiscardPendingUploads(VkBuffer dst_buffer);
 
   void CreateImageView(VkImage image,
                        VkFormat format,
                        VkImageAspectFlagBits aspect_mask,
+                       uint32_t layer_count,
                        VkImageView *image_view);
 
-  VkCommandBuffer BeginSingleTimeCommands(VkCommandPool command_pool);
+  // Returns a command buffer of the graphics pool in the recording state. Objects destroyed
+  // from now on are kept until the batch is submitted and executed, as it may reference them.
+  // VulkanCommandBatch is the way to record one.
+  [[nodiscard]] VkCommandBuffer BeginBatch();
+
+  // Submits a command buffer of BeginBatch and takes ownership of it, it is freed once it
+  // executed. Frames submitted afterwards wait for it on the gpu. Returns the token of the
+  // batch.
+  uint64_t SubmitBatch(VkCommandBuffer command_buffer);
+
+  // Frees a command buffer of BeginBatch without submitting it.
+  void DiscardBatch(VkCommandBuffer command_buffer);
+
+  [[nodiscard]] bool IsBatchComplete(uint64_t token) const;
 
-  void EndSingleTimeCommands(VkQueue queue, VkCommandPool pool, VkCommandBuffer command_buffer);
+  void WaitForBatch(uint64_t token);
+
+  // every submission to the graphics queue must go through this call so it can be accounted
+  void SubmitToGraphicsQueue(const VkSubmitInfo &submit_info, VkFence fence);
+
+  // Starts recording of a frame. Waits only when the frame that used the same slot is still
+  // executing or max frames in flight frames would be queued otherwise. All views of the
+  // frame are recorded into the returned command buffer. frame_id identifies the frame in gpu
+  // times.
+  VkCommandBuffer BeginFrame(uint64_t frame_id);
+
+  // Ends recording and submits the frame with a single vkQueueSubmit that advances the frame
+  // timeline.
+  void EndFrame();
+
+  [[nodiscard]] uint32_t GetMaxFramesInFlight() const;
+
+  // Takes effect with the next BeginFrame, count must be in [1, kMaxFramesInFlight]. Frames
+  // already queued are not waited for, slots keep track of the frame that used them last.
+  void SetMaxFramesInFlight(uint32_t count);
+
+  // Time the last BeginFrame was blocked on the frame timeline.
+  [[nodiscard]] std::chrono::nanoseconds GetFrameGpuWaitTime() const;
+
+  // Slot of the frame being recorded, per frame resources indexed by it are no longer used by
+  // the gpu once BeginFrame returns.
+  [[nodiscard]] uint32_t GetFrameSlot() const;
+
+  // Times the frames, scopes may be added while a frame is recorded.
+  [[nodiscard]] VulkanGpuTimer &GetGpuTimer();
+
+  // Number of queue submissions done while recording the last finished frame, including
+  // the frame submission itself.
+  [[nodiscard]] uint32_t GetFrameSubmitCount() const;
 
   [[nodiscard]] uint32_t FindMemoryType(uint32_t type_filter,
                                         VkMemoryPropertyFlags properties) const;
 
   [[nodiscard]] VkRenderPass GetRenderPass() const;
 
+  [[nodiscard]] VkPipelineCache GetPipelineCache() const;
+
+  // Logs how long a pipeline took to create and marks the cache for saving.
+  void OnPipelineCreated(std::chrono::steady_clock::duration creation_time);
+
+  // Writes the cache to disk when pipelines were created since it was loaded or last saved.
+  void SavePipelineCache();
+
   VkCommandPool GetGraphicsPool() const;
 
   VkQueue GetGraphicsQueue() const;
@@ -83,6 +303,37 @@ class VulkanRenderingContext
                                              VkImageTiling tiling,
                                              VkFormatFeatureFlags features) const;
 
-  [[nodiscard]] VkSampleCountFlagBits GetRecommendedMsaaSamples() const;
+  // Sample counts usable for both color and depth attachments.
+  [[nodiscard]] VkSampleCountFlags GetSupportedMsaaSamples() const;
+
+  // Sample count of the render pass, pipelines and multisampled render targets.
+  [[nodiscard]] VkSampleCountFlagBits GetMsaaSamples() const;
+
+  // False when the swapchain images are drawn into directly, without a resolve.
+  [[nodiscard]] bool IsMsaaEnabled() const;
+
+  // Replaces the render pass with one for samples, lowered to the next supported count.
+  // Pipelines, framebuffers and render targets built for the previous render pass must be
+  // recreated by the caller. The previous render pass is destroyed once frames in flight are
+  // done with it. Must not be called while a frame is recorded.
+  void SetMsaaSamples(uint32_t samples);
+
+  // The device was created with the fragmentDensityMap feature of
+  // VK_EXT_fragment_density_map.
+  [[nodiscard]] bool IsFoveationSupported() const;
+
+  // The render pass reads a fragment density map as its last attachment.
+  [[nodiscard]] bool IsFoveationEnabled() const;
+
+  // Replaces the render pass with one with or without a fragment density map, like
+  // SetMsaaSamples. Throws when enabling it on a device without support.
+  void SetFoveationEnabled(bool enabled);
+
+  // Framebuffer pixels covered by a density map texel, density maps must have at least the
+  // framebuffer extent divided by it texels.
+  [[nodiscard]] VkExtent2D GetDensityMapTexelSize() const;
+
+  // Number of views rendered by the render pass, values greater than 1 mean multiview.
+  [[nodiscard]] uint32_t GetViewCount() const;
 };
 }
@@ -1,17 +1,20 @@
 #include "vulkan_rendering_pipeline.hpp"
 
+#include <chrono>
+
 vulkan::VulkanRenderingPipeline::VulkanRenderingPipeline(
     std::shared_ptr<VulkanRenderingContext> context,
     std::shared_ptr<VulkanShader> vertex_shader,
     std::shared_ptr<VulkanShader> fragment_shader,
-    const VertexBufferLayout &vbl,
+    const std::vector<VertexBufferLayout> &vbls,
     RenderingPipelineConfig config) :
     context_(context),
     device_(context_->GetDevice()),
-    config_(config) {
+    config_(config),
+    vertex_buffer_layouts_(vbls) {
   this->vertex_shader_ = std::dynamic_pointer_cast<VulkanShader>(vertex_shader);
   this->fragment_shader_ = std::dynamic_pointer_cast<VulkanShader>(fragment_shader);
-  CreatePipeline(vbl);
+  CreatePipeline();
 }
 
 void vulkan::VulkanRenderingPipeline::SetVertexBuffer(std::shared_ptr<VulkanBuffer> buffer) {
@@ -24,7 +27,13 @@ void vulkan::VulkanRenderingPipeline::SetIndexBuffer(std::shared_ptr<VulkanBuffe
   this->index_type_ = GetVkType(element_type);
 }
 
-void vulkan::VulkanRenderingPipeline::CreatePipeline(const VertexBufferLayout &vbl) {
+void vulkan::VulkanRenderingPipeline::Recreate() {
+  context_->DeferDestroy(VK_OBJECT_TYPE_PIPELINE, pipeline_);
+  context_->DeferDestroy(VK_OBJECT_TYPE_PIPELINE_LAYOUT, pipeline_layout_);
+  CreatePipeline();
+}
+
+void vulkan::VulkanRenderingPipeline::CreatePipeline() {
   VkPipelineShaderStageCreateInfo shader_stages[] = {
       vertex_shader_->GetShaderStageInfo(),
       fragment_shader_->GetShaderStageInfo()
@@ -63,12 +72,14 @@ void vulkan::VulkanRenderingPipeline::CreatePipeline(const VertexBufferLayout &v
   multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
   multisampling.sampleShadingEnable = VK_FALSE;
   multisampling.alphaToCoverageEnable = VK_FALSE;
-  multisampling.rasterizationSamples = context_->GetRecommendedMsaaSamples();
+  multisampling.rasterizationSamples = context_->GetMsaaSamples();
 
   VkPipelineColorBlendAttachmentState color_blend_attachment = {};
-  color_blend_attachment.colorWriteMask =
-      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT
-          | VK_COLOR_COMPONENT_A_BIT;
+  if (config_.enable_color_write) {
+    color_blend_attachment.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT
+            | VK_COLOR_COMPONENT_A_BIT;
+  }
   color_blend_attachment.blendEnable = VK_FALSE;
 
   VkPipelineColorBlendStateCreateInfo color_blending = {};
@@ -106,30 +117,34 @@ void vulkan::VulkanRenderingPipeline::CreatePipeline(const VertexBufferLayout &v
   dynamic_state_create_info.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
   dynamic_state_create_info.pDynamicStates = dynamic_states.data();
 
-  const auto &elements = vbl.GetElements();
-  auto stride = static_cast<uint32_t>(vbl.GetElementSize());
-  size_t offset = 0;
   std::vector<VkVertexInputAttributeDescription> attribute_descriptions{};
-  for (auto element: elements) {
-    VkVertexInputAttributeDescription description{
-        .location = element.binding_index,
-        .binding = 0,
-        .format = GetVkFormat(element.type, static_cast<uint32_t>(element.count)),
-        .offset = static_cast<uint32_t>(offset),
-    };
-    attribute_descriptions.push_back(description);
-    offset += element.count * GetDataTypeSizeInBytes(element.type);
+  std::vector<VkVertexInputBindingDescription> binding_descriptions{};
+  for (uint32_t binding = 0; binding < vertex_buffer_layouts_.size(); binding++) {
+    const auto &vbl = vertex_buffer_layouts_[binding];
+    size_t offset = 0;
+    for (auto element: vbl.GetElements()) {
+      VkVertexInputAttributeDescription description{
+          .location = element.binding_index,
+          .binding = binding,
+          .format = GetVkFormat(element.type, static_cast<uint32_t>(element.count)),
+          .offset = static_cast<uint32_t>(offset),
+      };
+      attribute_descriptions.push_back(description);
+      offset += element.count * GetDataTypeSizeInBytes(element.type);
+    }
+
+    VkVertexInputBindingDescription vertex_input_binding_description{};
+    vertex_input_binding_description.binding = binding;
+    vertex_input_binding_description.stride = static_cast<uint32_t>(vbl.GetElementSize());
+    vertex_input_binding_description.inputRate = GetVkVertexInputRate(vbl.GetInputRate());
+    binding_descriptions.push_back(vertex_input_binding_description);
   }
 
-  VkVertexInputBindingDescription vertex_input_binding_description{};
-  vertex_input_binding_description.binding = 0;
-  vertex_input_binding_description.stride = stride;
-  vertex_input_binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
   VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
   vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertex_input_info.vertexBindingDescriptionCount = 1;
-  vertex_input_info.pVertexBindingDescriptions = &vertex_input_binding_description;
+  vertex_input_info.vertexBindingDescriptionCount =
+      static_cast<uint32_t>(binding_descriptions.size());
+  vertex_input_info.pVertexBindingDescriptions = binding_descriptions.data();
   vertex_input_info.vertexAttributeDescriptionCount =
       static_cast<uint32_t>(attribute_descriptions.size());
   vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions.data();
@@ -153,12 +168,14 @@ void vulkan::VulkanRenderingPipeline::CreatePipeline(const VertexBufferLayout &v
   pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
   pipeline_info.pDynamicState = &dynamic_state_create_info;
 
+  const auto kCreationStart = std::chrono::steady_clock::now();
   CHECK_VKCMD(vkCreateGraphicsPipelines(device_,
-                                        VK_NULL_HANDLE,
+                                        context_->GetPipelineCache(),
                                         1,
                                         &pipeline_info,
                                         nullptr,
                                         &pipeline_));
+  context_->OnPipelineCreated(std::chrono::steady_clock::now() - kCreationStart);
 }
 
 void vulkan::VulkanRenderingPipeline::BindPipeline(VkCommandBuffer command_buffer) {
@@ -170,9 +187,8 @@ void vulkan::VulkanRenderingPipeline::BindPipeline(VkCommandBuffer command_buffe
 }
 
 vulkan::VulkanRenderingPipeline::~VulkanRenderingPipeline() {
-  context_->WaitForGpuIdle();
-  vkDestroyPipelineLayout(device_, pipeline_layout_, nullptr);
-  vkDestroyPipeline(device_, pipeline_, nullptr);
+  context_->DeferDestroy(VK_OBJECT_TYPE_PIPELINE, pipeline_);
+  context_->DeferDestroy(VK_OBJECT_TYPE_PIPELINE_LAYOUT, pipeline_layout_);
 }
 VkPipelineLayout vulkan::VulkanRenderingPipeline::GetPipelineLayout() const {
   return pipeline_layout_;
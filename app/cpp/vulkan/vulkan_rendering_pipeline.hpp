@@ -14,6 +14,7 @@ class VulkanRenderingPipeline {
   std::shared_ptr<VulkanRenderingContext> context_;
   VkDevice device_;
   RenderingPipelineConfig config_;
+  std::vector<VertexBufferLayout> vertex_buffer_layouts_;
 
   VkPipeline pipeline_{};
   VkPipelineLayout pipeline_layout_ = nullptr;
@@ -26,7 +27,7 @@ class VulkanRenderingPipeline {
   std::shared_ptr<VulkanShader> vertex_shader_ = nullptr;
   std::shared_ptr<VulkanShader> fragment_shader_ = nullptr;
 
-  void CreatePipeline(const VertexBufferLayout &vbl);
+  void CreatePipeline();
 
  public:
   VulkanRenderingPipeline() = delete;
@@ -34,11 +35,16 @@ class VulkanRenderingPipeline {
   VulkanRenderingPipeline(std::shared_ptr<VulkanRenderingContext> context,
                           std::shared_ptr<VulkanShader> vertex_shader,
                           std::shared_ptr<VulkanShader> fragment_shader,
-                          const VertexBufferLayout &vbl,
+                          const std::vector<VertexBufferLayout> &vbls,
                           RenderingPipelineConfig config);
 
   void SetIndexBuffer(std::shared_ptr<VulkanBuffer> buffer, DataType element_type);
   void SetVertexBuffer(std::shared_ptr<VulkanBuffer> buffer);
+  // Rebuilds the pipeline for the current render pass and sample count of the context, the
+  // previous pipeline is destroyed once frames in flight are done with it.
+  void Recreate();
+  // binds the pipeline together with the vertex buffer at binding 0 and the index buffer,
+  // per instance buffers are bound by the caller starting from binding 1
   void BindPipeline(VkCommandBuffer command_buffer);
   VkPipelineLayout GetPipelineLayout() const;
   virtual ~VulkanRenderingPipeline();
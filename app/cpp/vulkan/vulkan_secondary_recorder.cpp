@@ -0,0 +1,153 @@
+#include "vulkan_secondary_recorder.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <stdexcept>
+
+vulkan::VulkanSecondaryRecorder::VulkanSecondaryRecorder(VkDevice device,
+                                                         uint32_t queue_family_index,
+                                                         uint32_t thread_count)
+    : device_(device), thread_pools_(thread_count) {
+  if (thread_count == 0) {
+    throw std::invalid_argument("secondary recording needs at least the calling thread");
+  }
+  VkCommandPoolCreateInfo pool_info{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+      .queueFamilyIndex = queue_family_index,
+  };
+  for (ThreadPools &thread_pools: thread_pools_) {
+    for (VkCommandPool &pool: thread_pools.pools) {
+      CHECK_VKCMD(vkCreateCommandPool(device_, &pool_info, nullptr, &pool));
+    }
+  }
+  for (uint32_t thread = 1; thread < thread_count; thread++) {
+    workers_.emplace_back(&VulkanSecondaryRecorder::RunWorker, this, thread);
+  }
+  spdlog::info("Secondary command buffers are recorded on {} threads", thread_count);
+}
+
+vulkan::VulkanSecondaryRecorder::~VulkanSecondaryRecorder() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  job_ready_.notify_all();
+  for (std::thread &worker: workers_) {
+    worker.join();
+  }
+  vkDeviceWaitIdle(device_);
+  for (const ThreadPools &thread_pools: thread_pools_) {
+    for (VkCommandPool pool: thread_pools.pools) {
+      vkDestroyCommandPool(device_, pool, nullptr);
+    }
+  }
+}
+
+uint32_t vulkan::VulkanSecondaryRecorder::GetThreadCount() const {
+  return static_cast<uint32_t>(thread_pools_.size());
+}
+
+void vulkan::VulkanSecondaryRecorder::BeginFrame(uint32_t frame_slot) {
+  frame_slot_ = frame_slot;
+  for (ThreadPools &thread_pools: thread_pools_) {
+    CHECK_VKCMD(vkResetCommandPool(device_, thread_pools.pools.at(frame_slot), 0));
+    thread_pools.used = 0;
+  }
+}
+
+VkCommandBuffer vulkan::VulkanSecondaryRecorder::BeginBuffer(
+    uint32_t thread, const VkCommandBufferInheritanceInfo &inheritance) {
+  ThreadPools &thread_pools = thread_pools_[thread];
+  std::vector<VkCommandBuffer> &buffers = thread_pools.buffers[frame_slot_];
+  if (thread_pools.used == buffers.size()) {
+    VkCommandBufferAllocateInfo alloc_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = thread_pools.pools[frame_slot_],
+        .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+        .commandBufferCount = 1,
+    };
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    CHECK_VKCMD(vkAllocateCommandBuffers(device_, &alloc_info, &command_buffer));
+    buffers.push_back(command_buffer);
+  }
+  const VkCommandBuffer kCommandBuffer = buffers[thread_pools.used++];
+  VkCommandBufferBeginInfo begin_info{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT
+          | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+      .pInheritanceInfo = &inheritance,
+  };
+  CHECK_VKCMD(vkBeginCommandBuffer(kCommandBuffer, &begin_info));
+  return kCommandBuffer;
+}
+
+void vulkan::VulkanSecondaryRecorder::RecordChunks(uint32_t thread) {
+  // chunks are taken one at a time, so threads that record faster take more of them
+  for (uint32_t chunk = next_chunk_.fetch_add(1); chunk < chunk_count_;
+       chunk = next_chunk_.fetch_add(1)) {
+    try {
+      const VkCommandBuffer kCommandBuffer = BeginBuffer(thread, *inheritance_);
+      record_function_(record_, kCommandBuffer, chunk);
+      CHECK_VKCMD(vkEndCommandBuffer(kCommandBuffer));
+      chunk_buffers_[chunk] = kCommandBuffer;
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (error_ == nullptr) {
+        error_ = std::current_exception();
+      }
+    }
+  }
+}
+
+void vulkan::VulkanSecondaryRecorder::RunWorker(uint32_t thread) {
+  uint64_t last_job_id = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      job_ready_.wait(lock, [&] { return stopping_ || job_id_ != last_job_id; });
+      if (stopping_) {
+        return;
+      }
+      last_job_id = job_id_;
+    }
+    RecordChunks(thread);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--busy_workers_ == 0) {
+        job_done_.notify_one();
+      }
+    }
+  }
+}
+
+std::span<const VkCommandBuffer> vulkan::VulkanSecondaryRecorder::Dispatch(
+    const VkCommandBufferInheritanceInfo &inheritance,
+    uint32_t chunk_count,
+    RecordFunction record_function,
+    const void *record) {
+  if (chunk_buffers_.size() < chunk_count) {
+    chunk_buffers_.resize(chunk_count);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    inheritance_ = &inheritance;
+    record_function_ = record_function;
+    record_ = record;
+    chunk_count_ = chunk_count;
+    next_chunk_.store(0, std::memory_order_relaxed);
+    error_ = nullptr;
+    busy_workers_ = static_cast<uint32_t>(workers_.size());
+    job_id_++;
+  }
+  job_ready_.notify_all();
+  RecordChunks(0);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_done_.wait(lock, [this] { return busy_workers_ == 0; });
+  }
+  if (error_ != nullptr) {
+    std::rethrow_exception(error_);
+  }
+  return {chunk_buffers_.data(), chunk_count};
+}
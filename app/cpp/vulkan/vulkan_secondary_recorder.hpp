@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "vulkan_rendering_context.hpp"
+#include "vulkan_utils.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace vulkan {
+// Records secondary command buffers of a render pass on worker threads. Every thread, the
+// calling one included, owns a command pool per frame slot and the pools of a slot are reset
+// when a frame begins with it, so recording never shares a pool between threads and stops
+// allocating once the busiest frame allocated its buffers.
+class VulkanSecondaryRecorder {
+ private:
+  using RecordFunction = void (*)(const void *record, VkCommandBuffer command_buffer,
+                                  uint32_t chunk);
+
+  struct ThreadPools {
+    std::array<VkCommandPool, VulkanRenderingContext::kMaxFramesInFlight> pools{};
+    std::array<std::vector<VkCommandBuffer>, VulkanRenderingContext::kMaxFramesInFlight>
+        buffers{};
+    // buffers of the current frame slot handed out so far
+    uint32_t used = 0;
+  };
+
+  VkDevice device_;
+  uint32_t frame_slot_ = 0;
+  // pools of the calling thread come first, the workers own the others
+  std::vector<ThreadPools> thread_pools_{};
+  std::vector<std::thread> workers_{};
+
+  // job state, published to the workers under the mutex by bumping job_id_
+  std::mutex mutex_;
+  std::condition_variable job_ready_;
+  std::condition_variable job_done_;
+  uint64_t job_id_ = 0;
+  bool stopping_ = false;
+  uint32_t busy_workers_ = 0;
+  const VkCommandBufferInheritanceInfo *inheritance_ = nullptr;
+  RecordFunction record_function_ = nullptr;
+  const void *record_ = nullptr;
+  uint32_t chunk_count_ = 0;
+  std::atomic<uint32_t> next_chunk_ = 0;
+  std::vector<VkCommandBuffer> chunk_buffers_{};
+  std::exception_ptr error_;
+
+  VkCommandBuffer BeginBuffer(uint32_t thread, const VkCommandBufferInheritanceInfo &inheritance);
+  void RecordChunks(uint32_t thread);
+  void RunWorker(uint32_t thread);
+  std::span<const VkCommandBuffer> Dispatch(const VkCommandBufferInheritanceInfo &inheritance,
+                                            uint32_t chunk_count,
+                                            RecordFunction record_function,
+                                            const void *record);
+ public:
+  // thread_count counts the calling thread, so thread_count - 1 workers are started.
+  VulkanSecondaryRecorder(VkDevice device, uint32_t queue_family_index, uint32_t thread_count);
+  VulkanSecondaryRecorder(const VulkanSecondaryRecorder &) = delete;
+  // Waits for the gpu, buffers of frames in flight are freed with their pools.
+  ~VulkanSecondaryRecorder();
+
+  [[nodiscard]] uint32_t GetThreadCount() const;
+
+  // The previous frame of the slot must have completed on the gpu, its buffers are reused.
+  void BeginFrame(uint32_t frame_slot);
+
+  // Records a single buffer on the calling thread, record(command_buffer) fills it.
+  template<typename F>
+  VkCommandBuffer RecordOnCaller(const VkCommandBufferInheritanceInfo &inheritance,
+                                 const F &record) {
+    const VkCommandBuffer kCommandBuffer = BeginBuffer(0, inheritance);
+    record(kCommandBuffer);
+    CHECK_VKCMD(vkEndCommandBuffer(kCommandBuffer));
+    return kCommandBuffer;
+  }
+
+  // Records chunk_count buffers spread over all threads and blocks until they are done.
+  // record(command_buffer, chunk) fills the buffer of one chunk and is called concurrently, it
+  // must only read state shared with other chunks. The returned buffers are in chunk order and
+  // valid until the next call. An exception of any chunk is rethrown once all are done.
+  template<typename F>
+  std::span<const VkCommandBuffer> Record(const VkCommandBufferInheritanceInfo &inheritance,
+                                          uint32_t chunk_count,
+                                          const F &record) {
+    return Dispatch(inheritance,
+                    chunk_count,
+                    [](const void *callable, VkCommandBuffer command_buffer, uint32_t chunk) {
+                      (*static_cast<const F *>(callable))(command_buffer, chunk);
+                    },
+                    &record);
+  }
+};
+}
@@ -0,0 +1,56 @@
+#include "vulkan_staging_ring.hpp"
+
+vulkan::VulkanStagingRing::VulkanStagingRing(VkBuffer buffer,
+                                             void *mapped_data,
+                                             VkDeviceSize capacity)
+    : buffer_(buffer),
+      mapped_data_(static_cast<char *>(mapped_data)),
+      capacity_(capacity) {}
+
+bool vulkan::VulkanStagingRing::Allocate(VkDeviceSize size,
+                                         VkDeviceSize alignment,
+                                         VkDeviceSize *offset,
+                                         void **mapped_data) {
+  if (size > capacity_) {
+    return false;
+  }
+  VkDeviceSize start = (head_ + alignment - 1) / alignment * alignment;
+  // an allocation never straddles the end of the buffer, the remainder is skipped
+  if (start % capacity_ + size > capacity_) {
+    start = (start / capacity_ + 1) * capacity_;
+  }
+  if (start + size - tail_ > capacity_) {
+    return false;
+  }
+  head_ = start + size;
+  *offset = start % capacity_;
+  *mapped_data = mapped_data_ + *offset;
+  return true;
+}
+
+void vulkan::VulkanStagingRing::MarkFrame(uint64_t frame_index) {
+  if (!frame_marks_.empty() && frame_marks_.back().head == head_) {
+    return;
+  }
+  frame_marks_.push_back({frame_index, head_});
+}
+
+void vulkan::VulkanStagingRing::Retire(uint64_t completed_frame_index) {
+  while (!frame_marks_.empty() && frame_marks_.front().frame_index <= completed_frame_index) {
+    tail_ = frame_marks_.front().head;
+    frame_marks_.pop_front();
+  }
+}
+
+void vulkan::VulkanStagingRing::Reset() {
+  frame_marks_.clear();
+  tail_ = head_;
+}
+
+VkBuffer vulkan::VulkanStagingRing::GetBuffer() const {
+  return buffer_;
+}
+
+VkDeviceSize vulkan::VulkanStagingRing::GetCapacity() const {
+  return capacity_;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+
+namespace vulkan {
+// Ring allocator over a persistently mapped host visible buffer. Offsets grow monotonically
+// and wrap around the buffer, ranges are handed back in the order of the frames that
+// consumed them.
+class VulkanStagingRing {
+ private:
+  struct FrameMark {
+    uint64_t frame_index;
+    VkDeviceSize head;
+  };
+
+  VkBuffer buffer_;
+  char *mapped_data_;
+  VkDeviceSize capacity_;
+  VkDeviceSize head_ = 0;
+  VkDeviceSize tail_ = 0;
+  std::deque<FrameMark> frame_marks_{};
+ public:
+  VulkanStagingRing(VkBuffer buffer, void *mapped_data, VkDeviceSize capacity);
+  VulkanStagingRing(const VulkanStagingRing &) = delete;
+
+  // Returns false when the ring does not have enough free space, nothing is reserved then.
+  bool Allocate(VkDeviceSize size,
+                VkDeviceSize alignment,
+                VkDeviceSize *offset,
+                void **mapped_data);
+
+  // Everything allocated so far is consumed by the frame with the given index.
+  void MarkFrame(uint64_t frame_index);
+
+  // Releases ranges of all frames up to and including the given index.
+  void Retire(uint64_t completed_frame_index);
+
+  // Releases everything, the gpu must not read the ring anymore.
+  void Reset();
+
+  [[nodiscard]] VkBuffer GetBuffer() const;
+
+  [[nodiscard]] VkDeviceSize GetCapacity() const;
+};
+}
@@ -35,6 +35,18 @@ std::vector<VkExtensionProperties> vulkan::GetAvailableInstanceExtensions(std::s
   return available_extensions;
 }
 
+std::vector<VkExtensionProperties> vulkan::GetAvailableDeviceExtensions(
+    VkPhysicalDevice physical_device) {
+  uint32_t count = 0;
+  CHECK_VKCMD(vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, nullptr));
+  std::vector<VkExtensionProperties> available_extensions(count);
+  CHECK_VKCMD(vkEnumerateDeviceExtensionProperties(physical_device,
+                                                   nullptr,
+                                                   &count,
+                                                   available_extensions.data()));
+  return available_extensions;
+}
+
 VkFormat vulkan::GetVkFormat(DataType type, uint32_t count) {
   switch (type) {
     case DataType::BYTE:
@@ -89,6 +101,14 @@ VkShaderStageFlagBits vulkan::GetVkShaderStageFlag(ShaderType shader_type) {
   }
 }
 
+VkVertexInputRate vulkan::GetVkVertexInputRate(VertexInputRate input_rate) {
+  switch (input_rate) {
+    case VertexInputRate::VERTEX:return VK_VERTEX_INPUT_RATE_VERTEX;
+    case VertexInputRate::INSTANCE:return VK_VERTEX_INPUT_RATE_INSTANCE;
+    default: throw std::runtime_error("unsupported input rate");
+  }
+}
+
 VkPrimitiveTopology vulkan::GetVkDrawMode(DrawMode draw_mode) {
   switch (draw_mode) {
     case DrawMode::POINT_LIST:return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
@@ -22,6 +22,8 @@ std::vector<VkExtensionProperties> GetAvailableInstanceExtensions(std::string la
 
 std::vector<VkLayerProperties> GetAvailableInstanceLayers();
 
+std::vector<VkExtensionProperties> GetAvailableDeviceExtensions(VkPhysicalDevice physical_device);
+
 VkBufferUsageFlags GetVkBufferUsage(BufferUsage buffer_usage);
 
 VkMemoryPropertyFlags GetVkMemoryType(MemoryType memory_property);
@@ -39,4 +41,6 @@ VkFrontFace GetVkFrontFace(FrontFace front_face);
 VkCompareOp GetVkCompareOp(CompareOp compare_op);
 
 VkShaderStageFlagBits GetVkShaderStageFlag(ShaderType shader_type);
+
+VkVertexInputRate GetVkVertexInputRate(VertexInputRate input_rate);
 }
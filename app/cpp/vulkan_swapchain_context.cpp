@@ -1,30 +1,40 @@
 #include "vulkan_swapchain_context.hpp"
 
+#include "trace.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+// below this many instances per chunk a secondary command buffer costs more than it saves
+constexpr uint32_t kMinInstancesPerChunk = 256;
+// chunks per recording thread, threads that finish early take over the remaining ones
+constexpr uint32_t kChunksPerThread = 4;
+}
+
 VulkanSwapchainContext::VulkanSwapchainContext(std::shared_ptr<vulkan::VulkanRenderingContext>
                                                vulkan_rendering_context,
+                                               std::shared_ptr<vulkan::VulkanSecondaryRecorder>
+                                               secondary_recorder,
                                                uint32_t capacity,
                                                const XrSwapchainCreateInfo &swapchain_create_info
 ) :
     rendering_context_(vulkan_rendering_context),
+    secondary_recorder_(std::move(secondary_recorder)),
     swapchain_image_format_(static_cast<VkFormat>(swapchain_create_info.format)),
-    swapchain_extent_({swapchain_create_info.width, swapchain_create_info.height}) {
+    swapchain_extent_({swapchain_create_info.width, swapchain_create_info.height}),
+    layer_count_(swapchain_create_info.arraySize) {
+  if (layer_count_ != vulkan_rendering_context->GetViewCount()) {
+    throw std::runtime_error("swapchain array size must match the render pass view count");
+  }
   swapchain_images_.resize(capacity);
   swapchain_image_views_.resize(capacity);
   swapchain_frame_buffers_.resize(capacity);
 
-  viewport_ = {
-      .x = 0.0F,
-      .y = static_cast<float>(swapchain_extent_.height),
-      .width = static_cast<float>(swapchain_extent_.width),
-      .height = -static_cast<float>(swapchain_extent_.height),
-      .minDepth = 0.0,
-      .maxDepth = 1.0,
-  };
-  scissor_.extent = {
-      .width = static_cast<uint32_t>(swapchain_extent_.width),
-      .height = static_cast<uint32_t>(swapchain_extent_.height),
-  };
-
   for (auto &image: swapchain_images_) {
     image.type = XR_TYPE_SWAPCHAIN_IMAGE_VULKAN_KHR;
   }
@@ -34,7 +44,7 @@ XrSwapchainImageBaseHeader *VulkanSwapchainContext::GetFirstImagePointer() {
   return reinterpret_cast<XrSwapchainImageBaseHeader *>(&swapchain_images_[0]);
 }
 
-void VulkanSwapchainContext::InitSwapchainImageViews() {
+void VulkanSwapchainContext::InitSwapchainImageViews(vulkan::VulkanCommandBatch &batch) {
   if (inited_) {
     throw std::runtime_error("cannot double init");
   }
@@ -43,90 +53,360 @@ void VulkanSwapchainContext::InitSwapchainImageViews() {
         swapchain_images_[i].image,
         swapchain_image_format_,
         VK_IMAGE_ASPECT_COLOR_BIT,
+        layer_count_,
         &swapchain_image_views_[i]);
   }
-  CreateColorResources();
-  CreateDepthResources();
+  CreateRenderTargets(batch);
   CreateFrameBuffers();
-  CreateCommandBuffers();
-  CreateSyncObjects();
+  LogAttachmentMemory();
 
   inited_ = true;
 }
 
-void VulkanSwapchainContext::Draw(uint32_t image_index,
-                                  std::shared_ptr<vulkan::VulkanRenderingPipeline> pipeline,
-                                  uint32_t index_count,
-                                  std::vector<glm::mat4> transforms) {
-  if (images_in_flight_[current_fame_] != VK_NULL_HANDLE) {
-    vkWaitForFences(rendering_context_->GetDevice(),
-                    1,
-                    &images_in_flight_[current_fame_],
-                    VK_TRUE,
-                    UINT64_MAX);
+void VulkanSwapchainContext::RecreateRenderTargets(vulkan::VulkanCommandBatch &batch) {
+  if (!inited_) {
+    throw std::runtime_error("swapchain render targets are not created yet");
+  }
+  for (auto &framebuffer: swapchain_frame_buffers_) {
+    rendering_context_->DeferDestroy(VK_OBJECT_TYPE_FRAMEBUFFER, framebuffer);
+    framebuffer = VK_NULL_HANDLE;
   }
-  images_in_flight_[current_fame_] = in_flight_fences_[current_fame_];
+  // targets of the old sample count are destroyed once no swapchain holds them anymore
+  color_target_ = nullptr;
+  depth_target_ = nullptr;
+  DestroyDensityMap();
+  CreateRenderTargets(batch);
+  CreateFrameBuffers();
+  LogAttachmentMemory();
+}
 
-  VkCommandBufferBeginInfo begin_info = {};
-  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-  vkBeginCommandBuffer(graphics_command_buffers_[current_fame_], &begin_info);
+void VulkanSwapchainContext::CreateRenderTargets(vulkan::VulkanCommandBatch &batch) {
+  const VkSampleCountFlagBits kSamples = rendering_context_->GetMsaaSamples();
+  if (rendering_context_->IsMsaaEnabled()) {
+    color_target_ = rendering_context_->AcquireRenderTarget(swapchain_image_format_,
+                                                            swapchain_extent_,
+                                                            layer_count_,
+                                                            kSamples,
+                                                            batch);
+  }
+  depth_target_ = rendering_context_->AcquireRenderTarget(
+      rendering_context_->GetDepthAttachmentFormat(),
+      swapchain_extent_,
+      layer_count_,
+      kSamples,
+      batch);
+  if (rendering_context_->IsFoveationEnabled()) {
+    CreateDensityMap(batch);
+  }
+}
 
+void VulkanSwapchainContext::SetFoveationProfile(const FoveationProfile &profile) {
+  foveation_profile_ = profile;
+  density_map_area_ = {};
+}
+
+void VulkanSwapchainContext::CreateDensityMap(vulkan::VulkanCommandBatch &batch) {
+  const VkExtent2D kTexelSize = rendering_context_->GetDensityMapTexelSize();
+  density_map_extent_ = {
+      (swapchain_extent_.width + kTexelSize.width - 1) / kTexelSize.width,
+      (swapchain_extent_.height + kTexelSize.height - 1) / kTexelSize.height,
+  };
+  rendering_context_->CreateImage(density_map_extent_.width,
+                                  density_map_extent_.height,
+                                  layer_count_,
+                                  VK_SAMPLE_COUNT_1_BIT,
+                                  vulkan::VulkanRenderingContext::kDensityMapFormat,
+                                  VK_IMAGE_USAGE_FRAGMENT_DENSITY_MAP_BIT_EXT
+                                      | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                  &density_map_,
+                                  &density_map_memory_);
+  rendering_context_->CreateImageView(density_map_,
+                                      vulkan::VulkanRenderingContext::kDensityMapFormat,
+                                      VK_IMAGE_ASPECT_COLOR_BIT,
+                                      layer_count_,
+                                      &density_map_view_);
+  batch.TransitionImageLayout(density_map_,
+                              VK_IMAGE_LAYOUT_UNDEFINED,
+                              VK_IMAGE_LAYOUT_FRAGMENT_DENSITY_MAP_OPTIMAL_EXT);
+  // two bytes per texel
+  density_texels_.resize(
+      size_t{2} * density_map_extent_.width * density_map_extent_.height * layer_count_);
+  density_map_staging_ = std::make_shared<vulkan::VulkanBuffer>(
+      rendering_context_,
+      density_texels_.size() * vulkan::VulkanRenderingContext::kMaxFramesInFlight,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      vulkan::GetVkMemoryType(vulkan::MemoryType::HOST_VISIBLE));
+  density_map_area_ = {};
+  spdlog::info("Fragment density map: {}x{} texels per view of {}x{} pixels each",
+               density_map_extent_.width,
+               density_map_extent_.height,
+               kTexelSize.width,
+               kTexelSize.height);
+}
+
+void VulkanSwapchainContext::DestroyDensityMap() {
+  if (density_map_ == VK_NULL_HANDLE) {
+    return;
+  }
+  rendering_context_->DeferDestroy(VK_OBJECT_TYPE_IMAGE_VIEW, density_map_view_);
+  rendering_context_->DeferDestroy(VK_OBJECT_TYPE_IMAGE, density_map_, density_map_memory_);
+  density_map_view_ = VK_NULL_HANDLE;
+  density_map_ = VK_NULL_HANDLE;
+  density_map_memory_ = {};
+  density_map_staging_ = nullptr;
+}
+
+void VulkanSwapchainContext::UpdateDensityMap(VkCommandBuffer command_buffer,
+                                              const VkRect2D &render_area) {
+  if (std::memcmp(&render_area, &density_map_area_, sizeof(VkRect2D)) == 0) {
+    return;
+  }
+  TRACE_SCOPE("UpdateDensityMap");
+  density_map_area_ = render_area;
+  const VkExtent2D kTexelSize = rendering_context_->GetDensityMapTexelSize();
+  const float kHalfWidth = 0.5f * static_cast<float>(render_area.extent.width);
+  const float kHalfHeight = 0.5f * static_cast<float>(render_area.extent.height);
+  const float kCenterX = static_cast<float>(render_area.offset.x) + kHalfWidth;
+  const float kCenterY = static_cast<float>(render_area.offset.y) + kHalfHeight;
+  // the views share the render area, so every layer gets the same texels
+  size_t texel = 0;
+  for (uint32_t layer = 0; layer < layer_count_; layer++) {
+    for (uint32_t y = 0; y < density_map_extent_.height; y++) {
+      const float kPixelY = (static_cast<float>(y) + 0.5f) * static_cast<float>(kTexelSize.height);
+      for (uint32_t x = 0; x < density_map_extent_.width; x++) {
+        const float kPixelX =
+            (static_cast<float>(x) + 0.5f) * static_cast<float>(kTexelSize.width);
+        const float kDensity = GetFoveationDensity(foveation_profile_,
+                                                   (kPixelX - kCenterX) / kHalfWidth,
+                                                   (kPixelY - kCenterY) / kHalfHeight);
+        const auto kValue = static_cast<uint8_t>(std::lround(kDensity * 255.0f));
+        density_texels_[texel++] = kValue;
+        density_texels_[texel++] = kValue;
+      }
+    }
+  }
+  // the slot's region is no longer read by the gpu once the frame has begun
+  const size_t kStagingOffset = density_texels_.size() * rendering_context_->GetFrameSlot();
+  density_map_staging_->Update(density_texels_.data(), density_texels_.size(), kStagingOffset);
+
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  // earlier frames may still read the map
+  barrier.srcAccessMask = VK_ACCESS_FRAGMENT_DENSITY_MAP_READ_BIT_EXT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_FRAGMENT_DENSITY_MAP_OPTIMAL_EXT;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = density_map_;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, layer_count_};
+  vkCmdPipelineBarrier(command_buffer,
+                       VK_PIPELINE_STAGE_FRAGMENT_DENSITY_PROCESS_BIT_EXT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0,
+                       0, nullptr,
+                       0, nullptr,
+                       1, &barrier);
+  VkBufferImageCopy region = {};
+  region.bufferOffset = kStagingOffset;
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, layer_count_};
+  region.imageExtent = {density_map_extent_.width, density_map_extent_.height, 1};
+  vkCmdCopyBufferToImage(command_buffer,
+                         density_map_staging_->GetBuffer(),
+                         density_map_,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         1,
+                         &region);
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_FRAGMENT_DENSITY_MAP_READ_BIT_EXT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_FRAGMENT_DENSITY_MAP_OPTIMAL_EXT;
+  vkCmdPipelineBarrier(command_buffer,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_DENSITY_PROCESS_BIT_EXT,
+                       0,
+                       0, nullptr,
+                       0, nullptr,
+                       1, &barrier);
+}
+
+void VulkanSwapchainContext::Draw(VkCommandBuffer command_buffer,
+                                  uint32_t image_index,
+                                  uint32_t view_index,
+                                  const VkRect2D &render_area,
+                                  const VisibilityMaskDraw &visibility_mask,
+                                  const std::shared_ptr<vulkan::VulkanRenderingPipeline> &pipeline,
+                                  uint32_t index_count,
+                                  const std::shared_ptr<vulkan::VulkanBuffer> &instance_buffer,
+                                  uint32_t instance_count,
+                                  std::span<const glm::mat4> view_projections) {
+  TRACE_SCOPE("RecordRenderPass");
+  if (view_projections.size() != layer_count_
+      || (visibility_mask.index_count > 0 && visibility_mask.projections.size() != layer_count_)) {
+    throw std::runtime_error("view projection count must match the swapchain layer count");
+  }
+  if (render_area.offset.x < 0 || render_area.offset.y < 0
+      || static_cast<uint32_t>(render_area.offset.x) + render_area.extent.width
+          > swapchain_extent_.width
+      || static_cast<uint32_t>(render_area.offset.y) + render_area.extent.height
+          > swapchain_extent_.height) {
+    throw std::runtime_error("render area must lie within the swapchain extent");
+  }
+  if (density_map_ != VK_NULL_HANDLE) {
+    // barriers and copies are not allowed inside the render pass
+    UpdateDensityMap(command_buffer, render_area);
+  }
+  vulkan::VulkanGpuTimer &gpu_timer = rendering_context_->GetGpuTimer();
+  vulkan::GpuTimerScope render_pass_scope(gpu_timer, command_buffer, "render_pass", view_index);
   VkRenderPassBeginInfo render_pass_info = {};
   render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   render_pass_info.renderPass = rendering_context_->GetRenderPass();
   render_pass_info.framebuffer = swapchain_frame_buffers_[image_index];
-  render_pass_info.renderArea.offset = {0, 0};
-  render_pass_info.renderArea.extent = swapchain_extent_;
+  render_pass_info.renderArea = render_area;
 
   std::array<VkClearValue, 2> clear_values = {};
   clear_values[0].color = {{0.184313729f, 0.309803933f, 0.309803933f, 1.0f}};
   clear_values[1].depthStencil = {1.0f, 0};
   render_pass_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
   render_pass_info.pClearValues = clear_values.data();
-  vkCmdBeginRenderPass(graphics_command_buffers_[current_fame_],
+  const uint32_t kChunkCount = GetChunkCount(instance_count);
+  if (kChunkCount < 2) {
+    vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+    RecordViewState(command_buffer, render_area);
+    RecordVisibilityMask(command_buffer, view_index, visibility_mask);
+    if (instance_count > 0) {
+      // inside a multiview pass every timestamp takes one query per layer
+      vulkan::GpuTimerScope draw_scope(gpu_timer, command_buffer, "draw", view_index, layer_count_);
+      RecordInstances(command_buffer,
+                      *pipeline,
+                      index_count,
+                      instance_buffer->GetBuffer(),
+                      0,
+                      instance_count,
+                      view_projections);
+    }
+    vkCmdEndRenderPass(command_buffer);
+    return;
+  }
+
+  vkCmdBeginRenderPass(command_buffer,
                        &render_pass_info,
-                       VK_SUBPASS_CONTENTS_INLINE);
-////render
-  pipeline->BindPipeline(graphics_command_buffers_[current_fame_]);
-  vkCmdSetViewport(graphics_command_buffers_[current_fame_], 0, 1, &viewport_);
-  vkCmdSetScissor(graphics_command_buffers_[current_fame_], 0, 1, &scissor_);
-  for (const auto &transform: transforms) {
-    vkCmdPushConstants(graphics_command_buffers_[current_fame_],
-                       pipeline->GetPipelineLayout(),
-                       VK_SHADER_STAGE_VERTEX_BIT,
-                       0,
-                       sizeof(transform),
-                       &transform);
-    vkCmdDrawIndexed(graphics_command_buffers_[current_fame_],
-                     static_cast<uint32_t>(index_count),
-                     1,
-                     0,
-                     0,
-                     0);
+                       VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  const VkCommandBufferInheritanceInfo kInheritance{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+      .renderPass = render_pass_info.renderPass,
+      .subpass = 0,
+      .framebuffer = render_pass_info.framebuffer,
+  };
+  // the gpu timer is not thread safe, its timestamps are written by buffers of this thread
+  uint32_t draw_scope = vulkan::VulkanGpuTimer::kNoScope;
+  const VkCommandBuffer kPrologue = secondary_recorder_->RecordOnCaller(
+      kInheritance,
+      [&](VkCommandBuffer secondary) {
+        RecordViewState(secondary, render_area);
+        RecordVisibilityMask(secondary, view_index, visibility_mask);
+        draw_scope = gpu_timer.BeginScope(secondary, "draw", view_index, layer_count_);
+      });
+  const VkBuffer kInstanceBuffer = instance_buffer->GetBuffer();
+  const std::span<const VkCommandBuffer> kChunks = secondary_recorder_->Record(
+      kInheritance,
+      kChunkCount,
+      [&](VkCommandBuffer secondary, uint32_t chunk) {
+        TRACE_SCOPE("RecordChunk");
+        const auto kFirst =
+            static_cast<uint32_t>(uint64_t{instance_count} * chunk / kChunkCount);
+        const auto kEnd =
+            static_cast<uint32_t>(uint64_t{instance_count} * (chunk + 1) / kChunkCount);
+        RecordViewState(secondary, render_area);
+        RecordInstances(secondary,
+                        *pipeline,
+                        index_count,
+                        kInstanceBuffer,
+                        kFirst,
+                        kEnd - kFirst,
+                        view_projections);
+      });
+  const VkCommandBuffer kEpilogue = secondary_recorder_->RecordOnCaller(
+      kInheritance,
+      [&](VkCommandBuffer secondary) {
+        gpu_timer.EndScope(secondary, draw_scope, layer_count_);
+      });
+  vkCmdExecuteCommands(command_buffer, 1, &kPrologue);
+  vkCmdExecuteCommands(command_buffer, static_cast<uint32_t>(kChunks.size()), kChunks.data());
+  vkCmdExecuteCommands(command_buffer, 1, &kEpilogue);
+  vkCmdEndRenderPass(command_buffer);
+}
+
+uint32_t VulkanSwapchainContext::GetChunkCount(uint32_t instance_count) const {
+  const uint32_t kThreadCount = secondary_recorder_->GetThreadCount();
+  if (kThreadCount < 2) {
+    return 1;
   }
-////render
-  vkCmdEndRenderPass(graphics_command_buffers_[current_fame_]);
-  vkEndCommandBuffer(graphics_command_buffers_[current_fame_]);
+  return std::clamp(instance_count / kMinInstancesPerChunk, 1u, kThreadCount * kChunksPerThread);
+}
 
-  VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  VkSubmitInfo submit_info = {};
-  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submit_info.waitSemaphoreCount = 0;
-  submit_info.pWaitDstStageMask = wait_stages;
-  submit_info.commandBufferCount = 1;
-  submit_info.pCommandBuffers = &graphics_command_buffers_[current_fame_];
-  submit_info.signalSemaphoreCount = 0;
+void VulkanSwapchainContext::RecordViewState(VkCommandBuffer command_buffer,
+                                             const VkRect2D &render_area) {
+  // flipped so +Y is up in clip space
+  const VkViewport kViewport = {
+      .x = static_cast<float>(render_area.offset.x),
+      .y = static_cast<float>(render_area.offset.y + render_area.extent.height),
+      .width = static_cast<float>(render_area.extent.width),
+      .height = -static_cast<float>(render_area.extent.height),
+      .minDepth = 0.0,
+      .maxDepth = 1.0,
+  };
+  vkCmdSetViewport(command_buffer, 0, 1, &kViewport);
+  vkCmdSetScissor(command_buffer, 0, 1, &render_area);
+}
 
-  vkResetFences(rendering_context_->GetDevice(), 1, &in_flight_fences_[current_fame_]);
-  if (vkQueueSubmit(rendering_context_->GetGraphicsQueue(),
-                    1,
-                    &submit_info,
-                    in_flight_fences_[current_fame_])
-      != VK_SUCCESS) {
-    throw std::runtime_error("failed to submit draw command buffer!");
+void VulkanSwapchainContext::RecordVisibilityMask(VkCommandBuffer command_buffer,
+                                                  uint32_t view_index,
+                                                  const VisibilityMaskDraw &visibility_mask) const {
+  if (visibility_mask.index_count == 0) {
+    return;
   }
-  current_fame_ = (current_fame_ + 1) % max_frames_in_flight_;
+  vulkan::GpuTimerScope mask_scope(rendering_context_->GetGpuTimer(),
+                                   command_buffer,
+                                   "visibility_mask",
+                                   view_index,
+                                   layer_count_);
+  const auto kProjectionsSize =
+      static_cast<uint32_t>(sizeof(glm::mat4) * visibility_mask.projections.size());
+  visibility_mask.pipeline->BindPipeline(command_buffer);
+  vkCmdPushConstants(command_buffer,
+                     visibility_mask.pipeline->GetPipelineLayout(),
+                     VK_SHADER_STAGE_VERTEX_BIT,
+                     0,
+                     kProjectionsSize,
+                     visibility_mask.projections.data());
+  vkCmdDrawIndexed(command_buffer, visibility_mask.index_count, 1, visibility_mask.first_index,
+                   0, 0);
+}
+
+void VulkanSwapchainContext::RecordInstances(VkCommandBuffer command_buffer,
+                                             vulkan::VulkanRenderingPipeline &pipeline,
+                                             uint32_t index_count,
+                                             VkBuffer instance_buffer,
+                                             uint32_t first_instance,
+                                             uint32_t instance_count,
+                                             std::span<const glm::mat4> view_projections) {
+  pipeline.BindPipeline(command_buffer);
+  VkDeviceSize instance_offset = 0;
+  vkCmdBindVertexBuffers(command_buffer, 1, 1, &instance_buffer, &instance_offset);
+  vkCmdPushConstants(command_buffer,
+                     pipeline.GetPipelineLayout(),
+                     VK_SHADER_STAGE_VERTEX_BIT,
+                     0,
+                     static_cast<uint32_t>(sizeof(glm::mat4) * view_projections.size()),
+                     view_projections.data());
+  vkCmdDrawIndexed(command_buffer,
+                   index_count,
+                   instance_count,
+                   0,
+                   0,
+                   first_instance);
 }
 
 [[nodiscard]] bool VulkanSwapchainContext::IsInited() const {
@@ -134,75 +414,31 @@ void VulkanSwapchainContext::Draw(uint32_t image_index,
 }
 
 VulkanSwapchainContext::~VulkanSwapchainContext() {
-  for (const auto &fence: in_flight_fences_) {
-    vkDestroyFence(rendering_context_->GetDevice(), fence, nullptr);
-  }
-  vkFreeCommandBuffers(rendering_context_->GetDevice(),
-                       rendering_context_->GetGraphicsPool(),
-                       graphics_command_buffers_.size(),
-                       &graphics_command_buffers_[0]);
+  rendering_context_->WaitForGpuIdle();
   for (const auto &framebuffer: swapchain_frame_buffers_) {
     vkDestroyFramebuffer(rendering_context_->GetDevice(), framebuffer, nullptr);
   }
-  if (depth_image_view_ != VK_NULL_HANDLE) {
-    vkDestroyImageView(rendering_context_->GetDevice(), depth_image_view_, nullptr);
-    vkDestroyImage(rendering_context_->GetDevice(), depth_image_, nullptr);
-    vkFreeMemory(rendering_context_->GetDevice(), depth_image_memory_, nullptr);
-  }
-  if (color_image_view_ != VK_NULL_HANDLE) {
-    vkDestroyImageView(rendering_context_->GetDevice(), color_image_view_, nullptr);
-    vkDestroyImage(rendering_context_->GetDevice(), color_image_, nullptr);
-    vkFreeMemory(rendering_context_->GetDevice(), color_image_memory_, nullptr);
-  }
   for (auto image_view: swapchain_image_views_) {
     vkDestroyImageView(rendering_context_->GetDevice(), image_view, nullptr);
   }
-}
-
-void VulkanSwapchainContext::CreateColorResources() {
-  rendering_context_->CreateImage(swapchain_extent_.width,
-                                  swapchain_extent_.height,
-                                  rendering_context_->GetRecommendedMsaaSamples(),
-                                  swapchain_image_format_,
-                                  VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
-                                      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                  &color_image_,
-                                  &color_image_memory_);
-  rendering_context_->CreateImageView(color_image_,
-                                      swapchain_image_format_,
-                                      VK_IMAGE_ASPECT_COLOR_BIT,
-                                      &color_image_view_);
-  rendering_context_->TransitionImageLayout(color_image_,
-                                            VK_IMAGE_LAYOUT_UNDEFINED,
-                                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-}
-
-void VulkanSwapchainContext::CreateDepthResources() {
-  VkFormat depth_format = rendering_context_->GetDepthAttachmentFormat();
-  rendering_context_->CreateImage(swapchain_extent_.width, swapchain_extent_.height,
-                                  rendering_context_->GetRecommendedMsaaSamples(),
-                                  depth_format,
-                                  VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                  &depth_image_,
-                                  &depth_image_memory_);
-  rendering_context_->CreateImageView(depth_image_,
-                                      depth_format,
-                                      VK_IMAGE_ASPECT_DEPTH_BIT,
-                                      &depth_image_view_);
-  rendering_context_->TransitionImageLayout(depth_image_,
-                                            VK_IMAGE_LAYOUT_UNDEFINED,
-                                            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+  if (density_map_ != VK_NULL_HANDLE) {
+    vkDestroyImageView(rendering_context_->GetDevice(), density_map_view_, nullptr);
+    vkDestroyImage(rendering_context_->GetDevice(), density_map_, nullptr);
+    rendering_context_->FreeMemory(density_map_memory_);
+  }
 }
 
 void VulkanSwapchainContext::CreateFrameBuffers() {
   for (size_t i = 0; i < swapchain_image_views_.size(); i++) {
-    std::array<VkImageView, 3> attachments = {
-        color_image_view_,
-        depth_image_view_,
-        swapchain_image_views_[i]
-    };
+    // attachment order of the render pass, the swapchain image is the resolve target with msaa
+    std::vector<VkImageView> attachments = {swapchain_image_views_[i], depth_target_->view};
+    if (color_target_ != nullptr) {
+      attachments = {color_target_->view, depth_target_->view, swapchain_image_views_[i]};
+    }
+    // a foveated render pass reads the density map as its last attachment
+    if (density_map_ != VK_NULL_HANDLE) {
+      attachments.push_back(density_map_view_);
+    }
 
     VkFramebufferCreateInfo framebuffer_info = {};
     framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -211,7 +447,7 @@ void VulkanSwapchainContext::CreateFrameBuffers() {
     framebuffer_info.pAttachments = attachments.data();
     framebuffer_info.width = swapchain_extent_.width;
     framebuffer_info.height = swapchain_extent_.height;
-    framebuffer_info.layers = 1;
+    framebuffer_info.layers = 1; // multiview render passes broadcast to layers via the view mask
     CHECK_VKCMD(vkCreateFramebuffer(rendering_context_->GetDevice(),
                                     &framebuffer_info,
                                     nullptr,
@@ -219,31 +455,25 @@ void VulkanSwapchainContext::CreateFrameBuffers() {
   }
 }
 
-void VulkanSwapchainContext::CreateCommandBuffers() {
-  graphics_command_buffers_.resize(max_frames_in_flight_);
-  VkCommandBufferAllocateInfo alloc_info = {};
-  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  alloc_info.commandPool = rendering_context_->GetGraphicsPool();
-  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  alloc_info.commandBufferCount = static_cast<uint32_t>(graphics_command_buffers_.size());
-  CHECK_VKCMD(vkAllocateCommandBuffers(rendering_context_->GetDevice(),
-                                       &alloc_info,
-                                       graphics_command_buffers_.data()));
-}
-
-void VulkanSwapchainContext::CreateSyncObjects() {
-  in_flight_fences_.resize(max_frames_in_flight_);
-  images_in_flight_.resize(swapchain_images_.size(), VK_NULL_HANDLE);
-  VkFenceCreateInfo fence_info = {
-      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-      .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+void VulkanSwapchainContext::LogAttachmentMemory() const {
+  const auto kLogAttachment = [this](const char *name, const vulkan::RenderTarget &target) {
+    const VkDeviceSize kBytesPerEye = target.memory.size / layer_count_;
+    const VkDeviceSize kCommittedPerEye =
+        rendering_context_->GetCommittedBytes(target.memory) / layer_count_;
+    spdlog::info("{} attachment: {} KiB per eye, {} KiB committed, {} KiB saved{}",
+                 name,
+                 kBytesPerEye / 1024,
+                 kCommittedPerEye / 1024,
+                 (kBytesPerEye - kCommittedPerEye) / 1024,
+                 target.memory.lazily_allocated ? " (lazily allocated)" : "");
   };
-  for (size_t i = 0; i < max_frames_in_flight_; i++) {
-    if (vkCreateFence(rendering_context_->GetDevice(),
-                      &fence_info,
-                      nullptr,
-                      &in_flight_fences_[i]) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create sync objects for a frame!");
-    }
+  VkDeviceSize skipped_store_bytes = depth_target_->memory.size;
+  if (color_target_ != nullptr) {
+    kLogAttachment("Msaa color", *color_target_);
+    skipped_store_bytes += color_target_->memory.size;
   }
-}
\ No newline at end of file
+  kLogAttachment("Depth", *depth_target_);
+  // neither multisampled attachment is stored, only the resolved swapchain image is written
+  spdlog::info("Attachment stores skipped: {} KiB per eye per frame",
+               skipped_store_bytes / layer_count_ / 1024);
+}
@@ -3,60 +3,118 @@
 #include "openxr-include.hpp"
 #include <glm/glm.hpp>
 
+#include <span>
+
+#include "foveation.hpp"
+#include "vulkan/vulkan_buffer.hpp"
+#include "vulkan/vulkan_command_batch.hpp"
 #include "vulkan/vulkan_rendering_context.hpp"
 #include "vulkan/vulkan_rendering_pipeline.hpp"
+#include "vulkan/vulkan_secondary_recorder.hpp"
 #include "vulkan/vulkan_utils.hpp"
 
+// Hidden area mesh drawn into depth at the start of a pass, so early depth tests reject the
+// fragments the lens hides. Nothing is drawn when index_count is 0.
+struct VisibilityMaskDraw {
+  vulkan::VulkanRenderingPipeline *pipeline = nullptr;
+  uint32_t first_index = 0;
+  uint32_t index_count = 0;
+  // one projection per swapchain layer
+  std::span<const glm::mat4> projections{};
+};
+
 class VulkanSwapchainContext {
  private:
   std::shared_ptr<vulkan::VulkanRenderingContext> rendering_context_;
+  // records the draws of large instance counts in parallel, shared with the other swapchains
+  std::shared_ptr<vulkan::VulkanSecondaryRecorder> secondary_recorder_;
   VkFormat swapchain_image_format_;
   VkExtent2D swapchain_extent_;
+  uint32_t layer_count_;
   std::vector<XrSwapchainImageVulkan2KHR> swapchain_images_{};
   std::vector<VkImageView> swapchain_image_views_{};
 
   std::vector<VkFramebuffer> swapchain_frame_buffers_{};
 
-  VkImage color_image_ = VK_NULL_HANDLE;
-  VkDeviceMemory color_image_memory_ = VK_NULL_HANDLE;
-  VkImageView color_image_view_ = VK_NULL_HANDLE;
-
-  VkImage depth_image_ = VK_NULL_HANDLE;
-  VkDeviceMemory depth_image_memory_ = VK_NULL_HANDLE;
-  VkImageView depth_image_view_ = VK_NULL_HANDLE;
-
-  std::vector<VkCommandBuffer> graphics_command_buffers_{};
-  const uint32_t max_frames_in_flight_ = 2;
-
-  std::vector<VkFence> in_flight_fences_;
-  std::vector<VkFence> images_in_flight_;
+  // multisampled targets from the rendering context's pool, shared with the other swapchains,
+  // there is no color target when msaa is off
+  std::shared_ptr<const vulkan::RenderTarget> color_target_;
+  std::shared_ptr<const vulkan::RenderTarget> depth_target_;
+
+  // fragment density map with one layer per view, only while the render pass is foveated
+  FoveationProfile foveation_profile_{};
+  VkImage density_map_ = VK_NULL_HANDLE;
+  vulkan::MemoryAllocation density_map_memory_{};
+  VkImageView density_map_view_ = VK_NULL_HANDLE;
+  VkExtent2D density_map_extent_{};
+  std::vector<uint8_t> density_texels_{};
+  // the texels of every frame slot, copied into the map by the frame that generated them
+  std::shared_ptr<vulkan::VulkanBuffer> density_map_staging_;
+  // render area the map was generated for, the profile is centered on it
+  VkRect2D density_map_area_{};
 
   bool inited_ = false;
 
-  uint32_t current_fame_ = 0;
-
-  VkViewport viewport_ = {0, 0, 0, 0, 0, 1.0};
-  VkRect2D scissor_ = {{0, 0}, {0, 0}};
-
-  void CreateColorResources();
-  void CreateDepthResources();
+  void CreateRenderTargets(vulkan::VulkanCommandBatch &batch);
+  void CreateDensityMap(vulkan::VulkanCommandBatch &batch);
+  void DestroyDensityMap();
+  // Regenerates the density map for render_area when it moved or the profile changed.
+  void UpdateDensityMap(VkCommandBuffer command_buffer, const VkRect2D &render_area);
   void CreateFrameBuffers();
-  void CreateCommandBuffers();
-  void CreateSyncObjects();
+  void LogAttachmentMemory() const;
+  // Chunks the instances are recorded in, below 2 they are recorded inline.
+  [[nodiscard]] uint32_t GetChunkCount(uint32_t instance_count) const;
+  // Dynamic state is not inherited, every secondary command buffer records it.
+  static void RecordViewState(VkCommandBuffer command_buffer, const VkRect2D &render_area);
+  void RecordVisibilityMask(VkCommandBuffer command_buffer,
+                            uint32_t view_index,
+                            const VisibilityMaskDraw &visibility_mask) const;
+  // Binds the pipeline and draws instances [first_instance, first_instance + instance_count).
+  static void RecordInstances(VkCommandBuffer command_buffer,
+                              vulkan::VulkanRenderingPipeline &pipeline,
+                              uint32_t index_count,
+                              VkBuffer instance_buffer,
+                              uint32_t first_instance,
+                              uint32_t instance_count,
+                              std::span<const glm::mat4> view_projections);
  public:
   VulkanSwapchainContext() = delete;
   VulkanSwapchainContext(std::shared_ptr<vulkan::VulkanRenderingContext> vulkan_rendering_context,
+                         std::shared_ptr<vulkan::VulkanSecondaryRecorder> secondary_recorder,
                          uint32_t capacity,
                          const XrSwapchainCreateInfo &swapchain_create_info);
 
   XrSwapchainImageBaseHeader *GetFirstImagePointer();
 
-  void InitSwapchainImageViews();
-
-  void Draw(uint32_t image_index,
-            std::shared_ptr<vulkan::VulkanRenderingPipeline> pipeline,
+  // Layout transitions of the render targets are recorded into batch, it must be submitted
+  // before the first frame that draws into the swapchain is.
+  void InitSwapchainImageViews(vulkan::VulkanCommandBatch &batch);
+
+  // Rebuilds render targets and framebuffers for the current render pass of the rendering
+  // context, e.g. after its sample count changed. Framebuffers of frames in flight are
+  // destroyed once the gpu is done with them. Transitions are recorded into batch.
+  void RecreateRenderTargets(vulkan::VulkanCommandBatch &batch);
+
+  // Profile of the density map, regenerated by the next Draw. The map is only drawn with while
+  // the rendering context's render pass is foveated.
+  void SetFoveationProfile(const FoveationProfile &profile);
+
+  // Records the render pass into command_buffer, submission is left to the caller.
+  // Instances are drawn with indexed draws, instance_buffer holds their per instance vertex
+  // data and view_projections one matrix per swapchain layer. Large instance counts are split
+  // into ranges recorded into secondary command buffers on the recorder's threads. Only
+  // render_area of the image is cleared and drawn, it must lie within the swapchain extent.
+  // view_index is the first view drawn and labels the gpu timer scopes.
+  void Draw(VkCommandBuffer command_buffer,
+            uint32_t image_index,
+            uint32_t view_index,
+            const VkRect2D &render_area,
+            const VisibilityMaskDraw &visibility_mask,
+            const std::shared_ptr<vulkan::VulkanRenderingPipeline> &pipeline,
             uint32_t index_count,
-            std::vector<glm::mat4> transforms);
+            const std::shared_ptr<vulkan::VulkanBuffer> &instance_buffer,
+            uint32_t instance_count,
+            std::span<const glm::mat4> view_projections);
 
   [[nodiscard]] bool IsInited() const;
 